@@ -0,0 +1,92 @@
+#include "ArtistCharts.h"
+
+#include "ParallelFor.h"
+
+#include <algorithm>
+#include <atomic>
+
+namespace bestversion {
+
+//------------------------------------------------------------------------------
+
+std::vector<ArtistChart> getArtistCharts(
+	const std::vector<std::string>& artists,
+	const t_size maxRequestsInFlight,
+	const ArtistChartSource& getChart,
+	const std::function<void (const std::string&)>& log,
+	const std::function<void (t_size)>& onWait,
+	abort_callback& abort
+)
+{
+	std::vector<ArtistChart> charts(artists.size());
+	std::atomic<t_size> numFetched(0);
+
+	// The workers spend nearly all their time waiting on the network, so the thread count is what bounds the requests in flight.
+	parallelFor(
+		artists.size(),
+		maxRequestsInFlight,
+		[&](t_size index)
+		{
+			try
+			{
+				charts[index] = getChart(artists[index], abort);
+			}
+			catch(const exception_aborted&)
+			{
+				throw;
+			}
+			catch(const std::exception& e)
+			{
+				// One artist missing from last.fm shouldn't spoil everyone else's charts.
+				log("Couldn't get top tracks for " + artists[index] + ": " + e.what());
+			}
+
+			++numFetched;
+		},
+		[&]()
+		{
+			onWait(numFetched);
+		},
+		abort
+	);
+
+	abort.check();
+
+	return charts;
+}
+
+//------------------------------------------------------------------------------
+
+MergedChart mergeArtistCharts(const std::vector<std::string>& artists, const std::vector<ArtistChart>& charts)
+{
+	MergedChart mergedChart;
+
+	for(size_t artistIndex = 0; artistIndex < artists.size() && artistIndex < charts.size(); ++artistIndex)
+	{
+		const ArtistChart& chart = charts[artistIndex];
+
+		unsigned long maxPlayCount = 0;
+		for(const auto& chartEntry : chart)
+		{
+			maxPlayCount = std::max(maxPlayCount, chartEntry.playCount);
+		}
+
+		for(const auto& chartEntry : chart)
+		{
+			const float score = maxPlayCount > 0 ? static_cast<float>(chartEntry.playCount) / static_cast<float>(maxPlayCount) : 0.0f;
+			mergedChart.push_back(MergedChartEntry{ score, artists[artistIndex], chartEntry.track, chartEntry.trackMBID, chartEntry.artistMBID });
+		}
+	}
+
+	// Stable, so tracks with the same score stay in artist order and then chart order.
+	std::stable_sort(mergedChart.begin(), mergedChart.end(), [](const MergedChartEntry& lhs, const MergedChartEntry& rhs)
+	{
+		return lhs.score > rhs.score;
+	});
+
+	return mergedChart;
+}
+
+//------------------------------------------------------------------------------
+
+} // namespace bestversion
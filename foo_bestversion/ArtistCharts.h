@@ -0,0 +1,44 @@
+#pragma once
+
+#include "FoobarSDKWrapper.h"
+
+#include "LastFm.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace bestversion {
+
+// Gets one artist's chart; getArtistChart in practice, but anything will do.
+typedef std::function<ArtistChart (const std::string& artist, abort_callback& abort)> ArtistChartSource;
+
+// Fetches the charts of all the given artists, with up to maxRequestsInFlight requests running at once,
+// so it takes about as long as the slowest request rather than all of them added together.
+// charts[i] is the chart of artists[i]; it's left empty if it couldn't be fetched, which is logged.
+// onWait is called on the calling thread every so often with the number of charts done so far.
+std::vector<ArtistChart> getArtistCharts(
+	const std::vector<std::string>& artists,
+	t_size maxRequestsInFlight,
+	const ArtistChartSource& getChart,
+	const std::function<void (const std::string&)>& log,
+	const std::function<void (t_size)>& onWait,
+	abort_callback& abort
+);
+
+struct MergedChartEntry
+{
+	float score;			// The track's play count as a proportion of its artist's most played track.
+	std::string artist;
+	std::string title;
+	std::string trackMBID;
+	std::string artistMBID;
+};
+
+typedef std::vector<MergedChartEntry> MergedChart;
+
+// Merges several artists' charts into one, most popular first. Play counts are normalised per artist
+// first, so each artist's top track ranks alongside the others' rather than the biggest artist swamping the rest.
+MergedChart mergeArtistCharts(const std::vector<std::string>& artists, const std::vector<ArtistChart>& charts);
+
+} // namespace bestversion
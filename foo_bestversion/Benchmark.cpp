@@ -0,0 +1,641 @@
+#include "Benchmark.h"
+
+#ifdef BESTVERSION_BENCHMARKS
+
+#include "BestVersion.h"
+#include "BestVersionMemo.h"
+#include "BestVersionSearch.h"
+#include "Checks.h"
+#include "FuzzyMatch.h"
+#include "LastFm.h"
+#include "LibraryIndex.h"
+#include "Normalise.h"
+#include "ParallelFor.h"
+#include "ScoringKernels.h"
+#include "TitleCanonicaliser.h"
+#include "TrackListParser.h"
+#include "TrackMetadata.h"
+#include "Xspf.h"
+#include "ToString.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+namespace {
+
+//------------------------------------------------------------------------------
+
+// Only while benchmarks are running, so the rest of the component pays no more than a load for the hook.
+std::atomic<bool> countingAllocations(false);
+std::atomic<t_size> numAllocations(0);
+std::atomic<t_size> numLiveBytes(0);	// Allocated while counting and not yet freed.
+std::atomic<t_size> peakLiveBytes(0);
+
+// Every allocation starts with one of these, so delete knows how much is being freed, and whether it was counted.
+struct AllocationHeader
+{
+	size_t size;
+	bool counted;
+};
+
+// Rounded up so what's handed out is as aligned as malloc's.
+static const size_t allocationHeaderSize = (sizeof(AllocationHeader) + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) * alignof(std::max_align_t);
+
+//------------------------------------------------------------------------------
+
+void countAllocation(const size_t size)
+{
+	++numAllocations;
+
+	const t_size liveBytes = numLiveBytes += size;
+
+	t_size peak = peakLiveBytes.load(std::memory_order_relaxed);
+	while(liveBytes > peak && !peakLiveBytes.compare_exchange_weak(peak, liveBytes, std::memory_order_relaxed))
+	{
+	}
+}
+
+//------------------------------------------------------------------------------
+
+void freeAllocation(void* ptr)
+{
+	if(ptr == nullptr)
+	{
+		return;
+	}
+
+	AllocationHeader* header = reinterpret_cast<AllocationHeader*>(static_cast<char*>(ptr) - allocationHeaderSize);
+	if(header->counted)
+	{
+		numLiveBytes -= header->size;
+	}
+
+	free(header);
+}
+
+//------------------------------------------------------------------------------
+
+} // anonymous namespace
+
+// Count every allocation made through new in this module while the benchmarks run, and how many bytes are live at the most.
+// pfc's containers use malloc, so they don't show up; std::string and the standard containers do. Each module gets its own
+// operator new from the CRT it links, so this only replaces the component's, not foobar2000's or any other component's;
+// and only builds with BESTVERSION_BENCHMARKS have it at all.
+void* operator new(const size_t size)
+{
+	AllocationHeader* header = static_cast<AllocationHeader*>(malloc(allocationHeaderSize + size));
+	if(header == nullptr)
+	{
+		throw std::bad_alloc();
+	}
+
+	header->size = size;
+	header->counted = countingAllocations.load(std::memory_order_relaxed);
+
+	if(header->counted)
+	{
+		countAllocation(size);
+	}
+
+	return reinterpret_cast<char*>(header) + allocationHeaderSize;
+}
+
+void* operator new[](const size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+	freeAllocation(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+	freeAllocation(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+	freeAllocation(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+	freeAllocation(ptr);
+}
+
+namespace {
+
+using namespace bestversion;
+
+//------------------------------------------------------------------------------
+
+// Counts allocations for as long as it's in scope.
+struct AllocationCountingScope
+{
+	AllocationCountingScope()
+	{
+		countingAllocations = true;
+	}
+
+	~AllocationCountingScope()
+	{
+		countingAllocations = false;
+	}
+};
+
+//------------------------------------------------------------------------------
+
+struct Benchmark
+{
+	Benchmark(const std::string& name_, const std::function<void (t_size iteration)>& run_, const t_size numItems_ = 0, const char* itemName_ = nullptr)
+		: name(name_)
+		, run(run_)
+		, numItems(numItems_)
+		, itemName(itemName_)
+	{
+	}
+
+	std::string name;
+	std::function<void (t_size iteration)> run;
+	t_size numItems;		// If each run goes through a batch of something, how many, so the rate can be reported too.
+	const char* itemName;
+};
+
+//------------------------------------------------------------------------------
+
+// Runs the benchmark for long enough to get a steady figure and reports the average time and allocations per call,
+// and the most memory allocated with new at any one time, over and above what already was.
+void runBenchmark(const Benchmark& benchmark, const std::function<void (const std::string&)>& report, abort_callback& abort)
+{
+	static const auto minDuration = std::chrono::milliseconds(250);
+	static const t_size minIterations = 10;
+	static const t_size iterationsBetweenChecks = 10;
+
+	// Once first, so anything that's cached on first use isn't counted.
+	benchmark.run(0);
+
+	const t_size allocationsBefore = numAllocations;
+	const t_size liveBytesBefore = numLiveBytes;
+	peakLiveBytes = liveBytesBefore;
+
+	const auto start = std::chrono::steady_clock::now();
+
+	t_size numIterations = 0;
+	std::chrono::steady_clock::duration elapsed;
+
+	do
+	{
+		abort.check();
+
+		for(t_size index = 0; index < iterationsBetweenChecks; ++index)
+		{
+			benchmark.run(numIterations++);
+		}
+
+		elapsed = std::chrono::steady_clock::now() - start;
+	}
+	while(elapsed < minDuration || numIterations < minIterations);
+
+	const t_size allocations = numAllocations - allocationsBefore;
+	const double nanosecondsPerOp = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) / numIterations;
+	const double allocationsPerOp = static_cast<double>(allocations) / numIterations;
+
+	const t_size peakBytes = peakLiveBytes - liveBytesBefore;
+
+	const std::string rate = benchmark.numItems > 0 ? to_string(benchmark.numItems * 1e9 / nanosecondsPerOp, 6) + " " + benchmark.itemName + "/s, " : std::string();
+
+	report(
+		benchmark.name + ": " + to_string(nanosecondsPerOp, 6) + " ns/op, " + rate + to_string(allocationsPerOp, 3) + " allocs/op, " +
+		to_string(peakBytes) + " peak bytes, " + to_string(numIterations) + " runs"
+	);
+}
+
+//------------------------------------------------------------------------------
+
+// The tracks whose indices are in the given range.
+metadb_handle_list getRange(const metadb_handle_list& tracks, const t_size first, const t_size count)
+{
+	metadb_handle_list range;
+
+	for(t_size index = first; index < first + count && index < tracks.get_count(); ++index)
+	{
+		range.add_item(tracks[index]);
+	}
+
+	return range;
+}
+
+//------------------------------------------------------------------------------
+
+class BenchmarkProcess : public threaded_process_callback
+{
+public:
+	explicit BenchmarkProcess(const SyntheticLibrarySettings& settings_)
+		: settings(settings_)
+	{
+	}
+
+	virtual void run(threaded_process_status& p_status, abort_callback& p_abort)
+	{
+		try
+		{
+			const auto report = [](const std::string& message){ console::print(message.c_str()); };
+
+			const t_size numFailed = runChecks(settings, report, p_abort);
+			report(numFailed == 0 ? std::string("All checks passed") : to_string(numFailed) + " checks FAILED");
+
+			runBenchmarks(
+				settings,
+				report,
+				[&](t_size done, t_size total){ p_status.set_progress(done, total); },
+				p_abort
+			);
+		}
+		catch(exception_aborted&)
+		{
+		}
+	}
+
+private:
+	const SyntheticLibrarySettings settings;
+};
+
+//------------------------------------------------------------------------------
+
+class BenchmarkMenuCommands : public mainmenu_commands
+{
+public:
+	enum Command
+	{
+		RunBenchmarks,
+		RunBenchmarksOnLargeLibrary,
+		NumCommands,
+	};
+
+	virtual t_uint32 get_command_count()
+	{
+		return NumCommands;
+	}
+
+	virtual GUID get_command(t_uint32 p_index)
+	{
+		// {2A6C1D43-7E0B-4F4C-9C1E-5B8E2D7A3F61}
+		static const GUID runBenchmarksGUID = { 0x2a6c1d43, 0x7e0b, 0x4f4c, { 0x9c, 0x1e, 0x5b, 0x8e, 0x2d, 0x7a, 0x3f, 0x61 } };
+		// {5D0F6E1B-93A4-4C7E-B2D8-0E6A1F4C9B37}
+		static const GUID runBenchmarksOnLargeLibraryGUID = { 0x5d0f6e1b, 0x93a4, 0x4c7e, { 0xb2, 0xd8, 0x0e, 0x6a, 0x1f, 0x4c, 0x9b, 0x37 } };
+
+		return p_index == RunBenchmarksOnLargeLibrary ? runBenchmarksOnLargeLibraryGUID : runBenchmarksGUID;
+	}
+
+	virtual void get_name(t_uint32 p_index, pfc::string_base& p_out)
+	{
+		p_out = p_index == RunBenchmarksOnLargeLibrary ? "Run Best Version benchmarks (400000 tracks)" : "Run Best Version benchmarks";
+	}
+
+	virtual bool get_description(t_uint32 p_index, pfc::string_base& p_out)
+	{
+		p_out = p_index == RunBenchmarksOnLargeLibrary ?
+			"As Run Best Version benchmarks, but against a synthetic library of 400000 tracks rather than 30000." :
+			"Checks the best version functions against fakes and a synthetic library, times them, and writes the results to the console.";
+		return true;
+	}
+
+	virtual GUID get_parent()
+	{
+		return mainmenu_groups::library;
+	}
+
+	virtual void execute(t_uint32 p_index, service_ptr_t<service_base> /*p_callback*/)
+	{
+		static_api_ptr_t<threaded_process> tp;
+
+		const SyntheticLibrarySettings settings = p_index == RunBenchmarksOnLargeLibrary ? getLargeSyntheticLibrarySettings() : getDefaultSyntheticLibrarySettings();
+
+		tp->run_modeless(
+			new service_impl_t<BenchmarkProcess>(settings),
+			tp->flag_show_abort | tp->flag_show_progress,
+			core_api::get_main_window(),
+			"Running Best Version benchmarks",
+			pfc_infinite
+		);
+	}
+};
+
+static mainmenu_commands_factory_t<BenchmarkMenuCommands> benchmarkMenuCommandsFactory;
+
+//------------------------------------------------------------------------------
+
+} // anonymous namespace
+
+namespace bestversion {
+
+//------------------------------------------------------------------------------
+
+void runBenchmarks(
+	const SyntheticLibrarySettings& settings,
+	const std::function<void (const std::string&)>& report,
+	const std::function<void (t_size, t_size)>& onProgress,
+	abort_callback& abort
+)
+{
+	const metadb_handle_list library = generateSyntheticLibrary(settings);
+	const t_size numTracks = library.get_count();
+
+	if(numTracks == 0)
+	{
+		report("The synthetic library is empty; nothing to benchmark");
+		return;
+	}
+
+	report(
+		"Benchmarking against a synthetic library of " + to_string(numTracks) + " tracks: " +
+		to_string(settings.numArtists) + " artists, " +
+		to_string(settings.numTitlesPerArtist) + " titles each, " +
+		to_string(settings.numVersionsPerTitle) + " versions of each title, " +
+		to_string(settings.tagSparsity) + " tag sparsity"
+	);
+
+	// What a lookup usually has to work with: an artist's tracks, or the versions of one title.
+	const t_size numTracksPerArtist = settings.numTitlesPerArtist * settings.numVersionsPerTitle;
+	const metadb_handle_list artistTracks = getRange(library, 0, numTracksPerArtist);
+	const metadb_handle_list versions = getRange(library, 0, settings.numVersionsPerTitle);
+	const std::string artist = getArtist(library[0]);
+	const std::string title = getTitle(library[0]);
+
+	std::vector<float> versionRatings;
+	for(t_size index = 0; index < versions.get_count(); ++index)
+	{
+		versionRatings.push_back(calculateTrackRating(title, versions[index]));
+	}
+
+	const std::string topTracksJson = generateSyntheticTopTracks(artist, 0, 100);
+	const std::string similarTracksJson = generateSyntheticSimilarTracks(settings.numArtists, 100);
+	const std::string longTopTracksJson = generateSyntheticTopTracks(artist, 0, 1000);
+	const std::string longSimilarTracksJson = generateSyntheticSimilarTracks(settings.numArtists, 1000);
+
+	// The made-up tracks are remembered in a memo of their own, so the shared one is left alone for real jobs.
+	BestVersionMemo memo;
+
+	const std::string xspf = generateSyntheticXspf(settings, 50000);
+	const std::shared_ptr<const LibrarySnapshot> librarySnapshot = LibrarySnapshot::build(library, memo);
+
+	report(
+		"Library snapshot string pool: " + to_string(librarySnapshot->getStrings().getCount()) + " strings in " +
+		to_string(librarySnapshot->getStrings().getMemoryUsage() / 1024) + "KB"
+	);
+	std::vector<XspfTrack> xspfTracks;
+
+	const auto readXspf = [&]()
+	{
+		static const size_t chunkSize = 64 * 1024;
+
+		xspfTracks.clear();
+		XspfReader reader([&](const XspfTrack& track){ xspfTracks.push_back(track); });
+
+		for(size_t offset = 0; offset < xspf.size(); offset += chunkSize)
+		{
+			reader.feed(xspf.data() + offset, std::min(chunkSize, xspf.size() - offset));
+		}
+
+		reader.finish();
+	};
+
+	readXspf();
+	std::vector<metadb_handle_ptr> xspfBestVersions;
+
+	const std::string trackList = generateSyntheticTrackList(settings, 10000);
+	std::vector<TrackName> trackListNames;
+	std::vector<metadb_handle_ptr> trackListBestVersions;
+
+	const auto readTrackList = [&]()
+	{
+		t_size numUnrecognisedLines = 0;
+		trackListNames.clear();
+		parseTrackList(trackList, trackListNames, numUnrecognisedLines);
+	};
+
+	// Accented names, half with the accents typed as separate combining characters, to compare against one of them.
+	static const char* const accentedArtists[] = { "Sigur R\xC3\xB3s", "Bj\xC3\xB6rk", "Mot\xC3\xB6rhead", "Beyonc\xC3\xA9", "Sigur Ro\xCC\x81s", "BJO\xCC\x88RK", "Moto\xCC\x88rhead", "BEYONCE\xCC\x81" };
+	const t_size numAccentedArtists = sizeof(accentedArtists) / sizeof(accentedArtists[0]);
+
+	std::vector<std::string> artistNames;
+	std::vector<std::string> foldedArtistNames;
+	for(t_size index = 0; index < 1000; ++index)
+	{
+		artistNames.push_back(index % 2 == 0 ? accentedArtists[index / 2 % numAccentedArtists] : "Artist " + to_string(index));
+		foldedArtistNames.push_back(foldCase(artistNames.back().c_str()));
+	}
+
+	const std::string foldedAccentedArtist = foldCase(accentedArtists[1]);
+	t_size numArtistMatches = 0;
+
+	const auto compareWithStricmp = [&]()
+	{
+		numArtistMatches = 0;
+		for(const auto& name : artistNames)
+		{
+			numArtistMatches += stricmp_utf8(name.c_str(), accentedArtists[1]) == 0 ? 1 : 0;
+		}
+	};
+
+	const auto compareFolded = [&]()
+	{
+		const FoldedString accentedArtist = { foldedAccentedArtist.c_str(), foldedAccentedArtist.size() };
+
+		numArtistMatches = 0;
+		for(const auto& name : foldedArtistNames)
+		{
+			const FoldedString folded = { name.c_str(), name.size() };
+			numArtistMatches += folded == accentedArtist ? 1 : 0;
+		}
+	};
+
+	compareFolded();
+	report("Folded comparison found " + to_string(numArtistMatches) + " of 1000 names the same as \"" + accentedArtists[1] + "\"");
+
+	// A prolific artist with 6000 tracks, and a chart of 100 of their titles, some with a qualifier on the end.
+	SyntheticLibrarySettings prolificSettings = settings;
+	prolificSettings.numArtists = 2;
+	prolificSettings.numTitlesPerArtist = 1000;
+	prolificSettings.numVersionsPerTitle = 6;
+
+	const std::shared_ptr<const LibrarySnapshot> prolificLibrary = LibrarySnapshot::build(generateSyntheticLibrary(prolificSettings), memo);
+
+	std::vector<std::string> chartTitles;
+	for(t_size index = 0; index < 100; ++index)
+	{
+		chartTitles.push_back("Title " + to_string(index * 7 + 1) + (index % 10 == 9 ? " (Remastered)" : ""));
+	}
+
+	std::vector<metadb_handle_ptr> chartBestVersions;
+
+	// The same tracks by name alone, and by name and MusicBrainz ID.
+	std::vector<TrackName> similarTrackNames;
+	std::vector<TrackName> similarTrackNamesWithMBIDs;
+	for(const auto& similarTrack : parseSimilarTracks(similarTracksJson))
+	{
+		const TrackName name = { similarTrack.artist, similarTrack.track, std::string(), std::string() };
+		similarTrackNames.push_back(name);
+
+		const TrackName nameWithMBIDs = { similarTrack.artist, similarTrack.track, similarTrack.trackMBID, similarTrack.artistMBID };
+		similarTrackNamesWithMBIDs.push_back(nameWithMBIDs);
+	}
+
+	std::vector<metadb_handle_ptr> similarTrackBestVersions;
+
+	const auto findSimilarTrackBestVersionsOneByOne = [&]()
+	{
+		similarTrackBestVersions.clear();
+		for(const auto& name : similarTrackNames)
+		{
+			similarTrackBestVersions.push_back(findBestVersion(*librarySnapshot, name.artist, name.title));
+		}
+	};
+
+	const auto findChartBestVersionsOneByOne = [&]()
+	{
+		chartBestVersions.clear();
+		for(const auto& chartTitle : chartTitles)
+		{
+			chartBestVersions.push_back(findBestVersion(*prolificLibrary, "Artist 1", chartTitle));
+		}
+	};
+
+	// A prolific artist's titles to look titles up among fuzzily, as the library index does, and the titles to look up:
+	// every other one is in the index, and the rest are titles in it with a letter missing.
+	static const t_size numIndexedTitles = 2000;
+	static const t_size numTitleQueries = 1000;
+
+	const std::vector<std::string> indexedTitles = generateSyntheticTitles(settings.seed, numIndexedTitles);
+
+	FuzzyTitleIndex titleIndex;
+	for(const auto& indexedTitle : indexedTitles)
+	{
+		titleIndex.add(indexedTitle);
+	}
+
+	std::vector<std::string> titleQueries;
+	for(t_size index = 0; index < numTitleQueries; ++index)
+	{
+		std::string query = indexedTitles[index * 7 % numIndexedTitles];
+		if(index % 2 == 1)
+		{
+			query.erase(query.size() / 2, 1);
+		}
+		titleQueries.push_back(query);
+	}
+
+	t_size numSimilarTitles = 0;
+	std::vector<const std::string*> similarTitles;
+
+	const auto findSimilarTitles = [&]()
+	{
+		numSimilarTitles = 0;
+		for(const auto& query : titleQueries)
+		{
+			similarTitles.clear();
+			titleIndex.findSimilar(query, similarTitles);
+			numSimilarTitles += similarTitles.size();
+		}
+	};
+
+	findSimilarTitles();
+	report("FuzzyTitleIndex found " + to_string(numSimilarTitles) + " similar titles for " + to_string(numTitleQueries) + " titles, half with a letter missing");
+
+	// Enough rating to be worth spreading over threads, to compare with the cost of handing out the work.
+	const t_size numTracksToRate = std::min<t_size>(numTracks, 10000);
+	const t_size numThreads = getDefaultThreadCount();
+
+	const auto rateTracksInParallel = [&](const t_size numThreadsToUse)
+	{
+		parallelFor(numTracksToRate, numThreadsToUse, [&](t_size index) { calculateTrackRating(title, library[index]); }, [](){}, abort);
+	};
+
+	std::vector<Benchmark> benchmarks =
+	{
+		{ "getMainArtist (an artist's tracks)", [&](t_size) { getMainArtist(artistTracks); } },
+		{ "getArtists (an artist's tracks)", [&](t_size) { getArtists(artistTracks); } },
+		{ "getArtist", [&](t_size iteration) { getArtist(library[iteration % numTracks]); } },
+		{ "getTitle", [&](t_size iteration) { getTitle(library[iteration % numTracks]); } },
+		{ "isTrackByArtist", [&](t_size iteration) { isTrackByArtist(artist, library[iteration % numTracks]); } },
+		{ "doesTrackHaveSimilarTitle", [&](t_size iteration) { doesTrackHaveSimilarTitle(title, library[iteration % numTracks]); } },
+		{ "doesTrackHaveCloseTitle", [&](t_size iteration) { doesTrackHaveCloseTitle(title, library[iteration % numTracks]); } },
+		{ "fileTitlesMatchExcludingBracketsOnLhs", [&](t_size) { fileTitlesMatchExcludingBracketsOnLhs("Title 1 (Remastered 2011)", title); } },
+		{ "canonicaliseTitle (three qualifiers)", [&](t_size) { canonicaliseTitle("Title 1 - Radio Edit (feat. Someone) [Remastered 2011]"); } },
+		{ "FuzzyTitleIndex::findSimilar (1000 titles, half with a letter missing, against 2000)", [&](t_size) { findSimilarTitles(); }, numTitleQueries, "queries" },
+		{ "calculateTrackRating", [&](t_size iteration) { calculateTrackRating(title, library[iteration % numTracks]); } },
+		{ "stricmp_utf8 (1000 names, half accented, against one)", [&](t_size) { compareWithStricmp(); } },
+		{ "foldCase (names, half accented)", [&](t_size iteration) { foldCase(artistNames[iteration % artistNames.size()].c_str()); } },
+		{ "Folded comparison (1000 names, folded beforehand, against one)", [&](t_size) { compareFolded(); } },
+		{ "TrackMetadata (an artist's tracks)", [&](t_size) { TrackMetadata metadata(artistTracks); } },
+		{ "filterTracksByArtist (an artist's tracks, copied)", [&](t_size) { metadb_handle_list tracks(artistTracks); filterTracksByArtist(artist, tracks); } },
+		{ "LibrarySnapshot::filterTracksByArtist (an artist's tracks, copied)", [&](t_size) { metadb_handle_list tracks(artistTracks); librarySnapshot->filterTracksByArtist(artist, tracks); } },
+		{ "filterTracksByCloseTitle (an artist's tracks, copied)", [&](t_size) { metadb_handle_list tracks(artistTracks); filterTracksByCloseTitle(title, tracks); } },
+		{ "LibrarySnapshot::filterTracksByCloseTitle (an artist's tracks, copied)", [&](t_size) { metadb_handle_list tracks(artistTracks); librarySnapshot->filterTracksByCloseTitle(title, tracks); } },
+		{ "pickBestTrack (one title's versions)", [&](t_size) { pickBestTrack(title, versions, versionRatings); } },
+		{ "getBestTrackByTitle (one title's versions)", [&](t_size) { getBestTrackByTitle(title, versions); } },
+		{ "parallelFor (one empty task, 1 thread)", [&](t_size) { parallelFor(1, 1, [](t_size){}, [](){}, abort); } },
+		{ "parallelFor (one empty task per core, every core)", [&](t_size) { parallelFor(numThreads, numThreads, [](t_size){}, [](){}, abort); } },
+		{ "parallelFor calculateTrackRating (10000 tracks, 1 thread)", [&](t_size) { rateTracksInParallel(1); } },
+		{ "parallelFor calculateTrackRating (10000 tracks, every core)", [&](t_size) { rateTracksInParallel(numThreads); } },
+		{ "parseArtistChart (100 tracks)", [&](t_size) { parseArtistChart(topTracksJson); } },
+		{ "parseSimilarTracks (100 tracks)", [&](t_size) { parseSimilarTracks(similarTracksJson); } },
+		{ "parseArtistChart (1000 tracks)", [&](t_size) { parseArtistChart(longTopTracksJson); } },
+		{ "parseSimilarTracks (1000 tracks)", [&](t_size) { parseSimilarTracks(longSimilarTracksJson); } },
+		{ "XspfReader (50000 tracks, 64KB chunks)", [&](t_size) { readXspf(); } },
+		{ "parseTrackList (10000 lines)", [&](t_size) { readTrackList(); } },
+		{ "parseTrackList and findBestVersions (10000 lines, memo cleared)", [&](t_size) { memo.clear(); readTrackList(); findBestVersions(*librarySnapshot, trackListNames, trackListBestVersions, [](t_size, t_size){}, abort); } },
+		{ "findBestVersion per chart title (100 titles, 6000-track artist, memo cleared)", [&](t_size) { memo.clear(); findChartBestVersionsOneByOne(); } },
+		{ "findBestVersionsByArtist (100 titles, 6000-track artist, memo cleared)", [&](t_size) { memo.clear(); findBestVersionsByArtist(*prolificLibrary, "Artist 1", chartTitles, chartBestVersions); } },
+		{ "findBestVersion per similar track (100 tracks, memo cleared)", [&](t_size) { memo.clear(); findSimilarTrackBestVersionsOneByOne(); } },
+		{ "findBestVersions grouped by artist (100 similar tracks, memo cleared)", [&](t_size) { memo.clear(); findBestVersions(*librarySnapshot, similarTrackNames, similarTrackBestVersions, [](t_size, t_size){}, abort); } },
+		{ "findBestVersions by MusicBrainz ID (100 similar tracks, memo cleared)", [&](t_size) { memo.clear(); findBestVersions(*librarySnapshot, similarTrackNamesWithMBIDs, similarTrackBestVersions, [](t_size, t_size){}, abort); } },
+		{ "resolveXspfTracks (50000 tracks, memo cleared)", [&](t_size) { memo.clear(); resolveXspfTracks(*librarySnapshot, xspfTracks, xspfBestVersions, abort); } },
+	};
+
+	// Each scoring kernel this CPU can run, on the same batch of candidates.
+	static const ScoringKernel kernels[] = { ScoringKernel::Scalar, ScoringKernel::SSE2, ScoringKernel::AVX2 };
+	static const t_size numCandidatesToScore = 1000;
+
+	const SyntheticCandidates candidates = generateSyntheticCandidates(settings.seed, numCandidatesToScore);
+	const CandidateColumns candidateColumns = candidates.getColumns();
+	std::vector<float> candidateRatings(numCandidatesToScore);
+
+	for(const ScoringKernel kernel : kernels)
+	{
+		if(kernel <= getBestScoringKernel())
+		{
+			benchmarks.push_back(Benchmark(
+				std::string("scoreCandidates (1000 candidates, ") + getScoringKernelName(kernel) + ")",
+				[&, kernel](t_size) { scoreCandidates(kernel, candidateColumns, numCandidatesToScore, candidateRatings.data()); },
+				numCandidatesToScore,
+				"candidates"
+			));
+		}
+	}
+
+	const t_size numBenchmarks = benchmarks.size();
+
+	const AllocationCountingScope countingScope;
+
+	for(t_size index = 0; index < numBenchmarks; ++index)
+	{
+		onProgress(index, numBenchmarks);
+		runBenchmark(benchmarks[index], report, abort);
+	}
+
+	onProgress(numBenchmarks, numBenchmarks);
+}
+
+//------------------------------------------------------------------------------
+
+} // namespace bestversion
+
+#endif
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "FoobarSDKWrapper.h"
+
+#include "SyntheticLibrary.h"
+
+#include <functional>
+#include <string>
+
+#ifdef BESTVERSION_BENCHMARKS
+
+namespace bestversion {
+
+// Times each of the public functions in BestVersion.h, and the last.fm response parsing, against a synthetic library.
+// Reports the time, the number of heap allocations and the peak heap use of each call, one line per function.
+// Only built when BESTVERSION_BENCHMARKS is defined; it adds "Run Best Version benchmarks" commands to the Library menu, one for
+// the default synthetic library and one for the large one.
+void runBenchmarks(
+	const SyntheticLibrarySettings& settings,
+	const std::function<void (const std::string&)>& report,
+	const std::function<void (t_size, t_size)>& onProgress,
+	abort_callback& abort
+);
+
+} // namespace bestversion
+
+#endif
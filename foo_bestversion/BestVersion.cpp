@@ -1,37 +1,141 @@
 #include "BestVersion.h"
 
+#include "FuzzyMatch.h"
+#include "Log.h"
 #include "Maths.h"
+#include "Normalise.h"
+#include "RatingFeatures.h"
+#include "ScoringKernels.h"
+#include "TitleCanonicaliser.h"
 #include "ToString.h"
+#include "Trace.h"
+#include "TrackMetadata.h"
 
-#include <limits>
+#include <cstring>
 #include <map>
+#include <unordered_set>
+
+namespace {
+
+using namespace bestversion;
+
+//------------------------------------------------------------------------------
+
+struct CStringLess
+{
+	bool operator()(const char* lhs, const char* rhs) const
+	{
+		return strcmp(lhs, rhs) < 0;
+	}
+};
+
+//------------------------------------------------------------------------------
+
+FoldedString makeFoldedString(const std::string& folded)
+{
+	const FoldedString foldedString = { folded.c_str(), folded.size() };
+	return foldedString;
+}
+
+//------------------------------------------------------------------------------
+
+bool doesTrackHaveArtist(const FoldedString& artist, const TrackMetadata& metadata, const t_size track)
+{
+	// todo: ignore slight differences, e.g. in punctuation
+
+	for(t_size index = 0; index < metadata.getNumArtists(track); ++index)
+	{
+		if(metadata.getFoldedArtist(track, index) == artist)
+		{
+			return true;
+		}
+	}
+
+	for(t_size index = 0; index < metadata.getNumAlbumArtists(track); ++index)
+	{
+		if(metadata.getFoldedAlbumArtist(track, index) == artist)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+//------------------------------------------------------------------------------
+
+// Whether the file title is a version of the one being looked for. normalisedFileTitle is set to the file title's normalised form
+// if it had to be worked out, for isTitleClose, and left empty if the titles were the same but for case.
+bool isTitleSimilar(const TitleQuery& query, const char* fileTitleTag, const FoldedString& foldedFileTitle, std::string& normalisedFileTitle)
+{
+	if(foldedFileTitle == makeFoldedString(query.foldedTitle))
+	{
+		return true;
+	}
+
+	const std::string fileTitle = fileTitleTag;
+	const CanonicalTitle canonicalFileTitle = canonicaliseTitle(fileTitle);
+
+	// The same again, but ignoring punctuation. Both titles have to have the same base,
+	// so that the library index, which files tracks by that, can find everything this matches.
+	normalisedFileTitle = simplifyTitle(canonicalFileTitle.base);
+
+	// The track's title without its qualifiers, so "Song (Live)" and "Song - Radio Edit" are both versions of "Song".
+	if(canonicalFileTitle.qualifiers != 0 && foldCase(canonicalFileTitle.base.c_str()) == query.foldedTitle)
+	{
+		return true;
+	}
+
+	return normalisedFileTitle == query.simplifiedTitle
+		|| (normalisedFileTitle == query.normalisedTitle && simplifyTitle(fileTitle) == query.simplifiedTitle);
+}
+
+//------------------------------------------------------------------------------
+
+bool isTitleClose(const TitleQuery& query, const std::string& normalisedFileTitle)
+{
+	return areTitlesSimilar(normalisedFileTitle, query.simplifiedTitle);
+}
+
+//------------------------------------------------------------------------------
+
+} // anonymous namespace
 
 namespace bestversion {
 
 //------------------------------------------------------------------------------
 
+TitleQuery::TitleQuery(const std::string& title_)
+	: title(title_)
+	, foldedTitle(foldCase(title_.c_str()))
+	, simplifiedTitle(simplifyTitle(title_))
+{
+	const CanonicalTitle canonicalTitle = canonicaliseTitle(title_);
+
+	// The same as normaliseTitle, without canonicalising the title twice.
+	normalisedTitle = simplifyTitle(canonicalTitle.base);
+	titleQualifiers = canonicalTitle.qualifiers;
+}
+
+//------------------------------------------------------------------------------
+
 std::string getMainArtist(metadb_handle_list_cref tracks)
 {
 	// Don't look at too many tracks - this method should be quick but won't be if we don't limit ourselves.
 	static const t_size maxNumberOfTracksToConsider = 100;
 
-	// Keep track of the number of each artist name we encounter.
-	std::map<const char*, t_size> artists;
+	const TrackMetadata metadata(tracks, maxNumberOfTracksToConsider);
+
+	// Keep track of the number of each artist name we encounter. The names point into metadata, which outlives the map.
+	std::map<const char*, t_size, CStringLess> artists;
 
 	// For each track, increment the number of occurrences of its artist.
-	for(t_size i = 0; i < tracks.get_count() && i < maxNumberOfTracksToConsider; i++)
+	for(t_size i = 0; i < metadata.getCount(); i++)
 	{
-		service_ptr_t<metadb_info_container> outInfo;
-		if(tracks[i]->get_async_info_ref(outInfo))
+		const char* artist = metadata.getMainArtist(i);
+		if(artist != nullptr)
 		{
-			const file_info& fileInfo = outInfo->info();
-			const bool has_artist_tag = fileInfo.meta_exists("artist");
-			const bool has_album_artist_tag = fileInfo.meta_exists("album artist");
-			if(has_artist_tag || has_album_artist_tag)
-			{
-				const char * artist = has_artist_tag ? fileInfo.meta_get("artist", 0) : fileInfo.meta_get("album artist", 0);
-				++artists[artist];
-			}
+			++artists[artist];
 		}
 	}
 
@@ -47,12 +151,34 @@ std::string getMainArtist(metadb_handle_list_cref tracks)
 		}
 	}
 
-	// We've kept the database locked this whole time because we're just storing char* in the map, not copying the strings.
 	return maxArtist;
 }
 
 //------------------------------------------------------------------------------
 
+std::vector<std::string> getArtists(metadb_handle_list_cref tracks)
+{
+	std::vector<std::string> artists;
+	std::unordered_set<std::string> normalisedArtists;
+
+	const TrackMetadata metadata(tracks);
+
+	for(t_size i = 0; i < metadata.getCount(); i++)
+	{
+		const char* artist = metadata.getMainArtist(i);
+
+		// Keep the first spelling we come across of each artist.
+		if(artist != nullptr && normalisedArtists.insert(normaliseArtist(artist)).second)
+		{
+			artists.push_back(artist);
+		}
+	}
+
+	return artists;
+}
+
+//------------------------------------------------------------------------------
+
 std::string getArtist(metadb_handle_ptr track)
 {
 	service_ptr_t<metadb_info_container> outInfo;
@@ -100,17 +226,21 @@ std::string getTitle(metadb_handle_ptr track)
 
 //------------------------------------------------------------------------------
 
-inline bool isTrackByArtist(const std::string& artist, const metadb_handle_ptr& track)
+bool isTrackByArtist(const std::string& artist, const metadb_handle_ptr& track)
 {
 	// todo: ignore slight differences, e.g. in punctuation
 
 	service_ptr_t<metadb_info_container> outInfo;
 	if(track->get_async_info_ref(outInfo))
 	{
+		const std::string foldedArtist = foldCase(artist.c_str());
+		std::string folded;
+
 		const file_info& fileInfo = outInfo->info();
 		for(t_size j = 0; j < fileInfo.meta_get_count_by_name("artist"); j++)
 		{
-			if(stricmp_utf8(fileInfo.meta_get("artist", j), artist.c_str()) == 0)
+			foldCase(fileInfo.meta_get("artist", j), folded);
+			if(folded == foldedArtist)
 			{
 				return true;
 			}
@@ -118,7 +248,8 @@ inline bool isTrackByArtist(const std::string& artist, const metadb_handle_ptr&
 
 		for(t_size j = 0; j < fileInfo.meta_get_count_by_name("album artist"); j++)
 		{
-			if(stricmp_utf8(fileInfo.meta_get("album artist", j), artist.c_str()) == 0)
+			foldCase(fileInfo.meta_get("album artist", j), folded);
+			if(folded == foldedArtist)
 			{
 				return true;
 			}
@@ -132,7 +263,13 @@ inline bool isTrackByArtist(const std::string& artist, const metadb_handle_ptr&
 
 bool doesTrackHaveSimilarTitle(const std::string& title, const metadb_handle_ptr& track)
 {
-	// todo: ignore slight differences, e.g. in punctuation
+	return doesTrackHaveSimilarTitle(TitleQuery(title), track);
+}
+
+//------------------------------------------------------------------------------
+
+bool doesTrackHaveSimilarTitle(const TitleQuery& query, const metadb_handle_ptr& track)
+{
 	service_ptr_t<metadb_info_container> outInfo;
 	if (!track->get_async_info_ref(outInfo))
 	{
@@ -146,31 +283,53 @@ bool doesTrackHaveSimilarTitle(const std::string& title, const metadb_handle_ptr
 		return false;
 	}
 
+	const char* fileTitle = fileInfo.meta_get("title", 0);
+	const std::string foldedFileTitle = foldCase(fileTitle);
 
-	const std::string fileTitle = fileInfo.meta_get("title", 0);
+	std::string normalisedFileTitle;
+	return isTitleSimilar(query, fileTitle, makeFoldedString(foldedFileTitle), normalisedFileTitle);
+}
+
+//------------------------------------------------------------------------------
 
-	if(stricmp_utf8(fileTitle.c_str(), title.c_str()) == 0)
+bool doesTrackHaveCloseTitle(const std::string& title, const metadb_handle_ptr& track)
+{
+	return doesTrackHaveCloseTitle(TitleQuery(title), track);
+}
+
+//------------------------------------------------------------------------------
+
+bool doesTrackHaveCloseTitle(const TitleQuery& query, const metadb_handle_ptr& track)
+{
+	service_ptr_t<metadb_info_container> outInfo;
+	if (!track->get_async_info_ref(outInfo))
 	{
-		return true;
+		return false;
 	}
-	else if(fileTitlesMatchExcludingBracketsOnLhs(fileTitle, title))
+
+	const file_info& fileInfo = outInfo->info();
+
+	if(!fileInfo.meta_exists("title"))
 	{
-		return true;
+		return false;
 	}
 
-	return false;
+	return isTitleClose(query, normaliseTitle(fileInfo.meta_get("title", 0)));
 }
 
 //------------------------------------------------------------------------------
 
 void filterTracksByArtist(const std::string& artist, pfc::list_base_t<metadb_handle_ptr>& tracks)
 {
+	const TrackMetadata metadata(tracks);
+	const std::string foldedArtist = foldCase(artist.c_str());
+
 	const t_size n = tracks.get_count();
 	bit_array_bittable deleteMask(n);
 
 	for(t_size i = 0; i < n; i++)
 	{
-		deleteMask.set(i, !isTrackByArtist(artist, tracks[i]));
+		deleteMask.set(i, !doesTrackHaveArtist(makeFoldedString(foldedArtist), metadata, i));
 	}
 
 	tracks.remove_mask(deleteMask);
@@ -180,12 +339,32 @@ void filterTracksByArtist(const std::string& artist, pfc::list_base_t<metadb_han
 
 void filterTracksByCloseTitle(const std::string& title, pfc::list_base_t<metadb_handle_ptr>& tracks)
 {
+	const TrackMetadata metadata(tracks);
+	const TitleQuery query(title);
+
 	const t_size n = tracks.get_count();
 	bit_array_bittable deleteMask(n);
+	bool anySimilar = false;
+
+	// Kept from the first pass so no title is canonicalised twice.
+	std::vector<std::string> normalisedFileTitles(n);
 
 	for(t_size i = 0; i < n; i++)
 	{
-		deleteMask.set(i, !doesTrackHaveSimilarTitle(title, tracks[i]));
+		const char* fileTitle = metadata.getTitle(i);
+		const bool similar = fileTitle != nullptr && isTitleSimilar(query, fileTitle, metadata.getFoldedTitle(i), normalisedFileTitles[i]);
+		deleteMask.set(i, !similar);
+		anySimilar = anySimilar || similar;
+	}
+
+	// Only settle for a title with a typo in it if there's nothing better; it could be a different song.
+	// Nothing was similar, so every title with a title tag had its normalised form worked out above.
+	if(!anySimilar)
+	{
+		for(t_size i = 0; i < n; i++)
+		{
+			deleteMask.set(i, metadata.getTitle(i) == nullptr || !isTitleClose(query, normalisedFileTitles[i]));
+		}
 	}
 
 	tracks.remove_mask(deleteMask);
@@ -195,23 +374,22 @@ void filterTracksByCloseTitle(const std::string& title, pfc::list_base_t<metadb_
 
 bool fileTitlesMatchExcludingBracketsOnLhs(const std::string& lhs, const std::string& rhs)
 {
-	auto lhsBracketPos = strcspn(lhs.c_str(),"([");
-	if(lhsBracketPos != pfc_infinite)
-	{
-		if((stricmp_utf8_ex(lhs.c_str(), lhsBracketPos - 1u, rhs.c_str(), pfc_infinite) == 0)
-			|| (stricmp_utf8_ex(lhs.c_str(), lhsBracketPos, rhs.c_str(), pfc_infinite) == 0))
-		{
-			return true;
-		}
-	}
-
-	return false;
+	return foldCase(canonicaliseTitle(lhs).base.c_str()) == foldCase(rhs.c_str());
 }
 
 //------------------------------------------------------------------------------
 
 float calculateTrackRating(const std::string& title, const metadb_handle_ptr& track)
 {
+	return calculateTrackRating(TitleQuery(title), track);
+}
+
+//------------------------------------------------------------------------------
+
+float calculateTrackRating(const TitleQuery& query, const metadb_handle_ptr& track)
+{
+	countTrace(TraceCounter::TrackRatings);
+
 	service_ptr_t<metadb_info_container> outInfo;
 	if(!track->get_async_info_ref(outInfo))
 	{
@@ -232,7 +410,7 @@ float calculateTrackRating(const std::string& title, const metadb_handle_ptr& tr
 	const std::string fileTitle = fileInfo.meta_get("title", 0);
 
 	// Assume title is already roughly correct.
-	if(stricmp_utf8(fileTitle.c_str(), title.c_str()) == 0)
+	if(foldCase(fileTitle.c_str()) == query.foldedTitle)
 	{
 		static const float ratingForExactTitleMatch = 2.0f;
 
@@ -245,6 +423,8 @@ float calculateTrackRating(const std::string& title, const metadb_handle_ptr& tr
 		totalRating += ratingForTitleMatchWithBrackets;
 	}
 
+	totalRating += calculateTitleQualifierRating(canonicaliseTitle(fileTitle).qualifiers, query.titleQualifiers);
+
 	if(fileInfo.meta_exists("PLAY_COUNTER"))
 	{
 		const int playCount = atoi(fileInfo.meta_get("PLAY_COUNTER",0));
@@ -352,39 +532,55 @@ float calculateTrackRating(const std::string& title, const metadb_handle_ptr& tr
 // all tracks will be analysed; try to cut the size of the list down before calling.
 metadb_handle_ptr getBestTrackByTitle(const std::string& title, const pfc::list_base_t<metadb_handle_ptr>& tracks)
 {
-	if(tracks.get_count() == 1)
+	const TitleQuery query(title);
+
+	std::vector<float> ratings;
+	ratings.reserve(tracks.get_count());
+
+	for(t_size index = 0; index < tracks.get_count(); index++)
 	{
-		console::info(("Only one version of " + title + " exists in library").c_str());
-		return tracks[0];
+		ratings.push_back(calculateTrackRating(query, tracks[index]));
 	}
 
-	console::info(("Finding best version of " + title + ". " + to_string(tracks.get_count()) + " candidates").c_str());
+	return pickBestTrack(title, tracks, ratings);
+}
 
-	metadb_handle_ptr bestTrack = 0;
-	float bestTrackRating = std::numeric_limits<float>::min();
+//------------------------------------------------------------------------------
 
-	for(t_size index = 0; index < tracks.get_count(); index++)
+metadb_handle_ptr pickBestTrack(const std::string& title, const pfc::list_base_t<metadb_handle_ptr>& tracks, const std::vector<float>& ratings)
+{
+	countTrace(TraceCounter::Picks);
+	countTrace(TraceCounter::Candidates, tracks.get_count());
+
+	if(tracks.get_count() == 1)
 	{
-		const float trackRating = calculateTrackRating(title, tracks[index]);
+		BESTVERSION_LOG_TRACE("Only one version of " + title + " exists in library");
+		return tracks[0];
+	}
 
-		console::info(("Rating: " + to_string(trackRating, 2) + ": " + tracks[index]->get_path()).c_str());
+	// This is called for every title in a chart, so only list the candidates when tracing's switched on.
+	if(isLogging(LogLevel::Trace))
+	{
+		log(LogLevel::Trace, "Finding best version of " + title + ". " + to_string(tracks.get_count()) + " candidates");
 
-		if(trackRating >= 0.0f && trackRating > bestTrackRating)
+		for(t_size index = 0; index < tracks.get_count(); index++)
 		{
-			bestTrackRating = trackRating;
-			bestTrack = tracks[index];
+			log(LogLevel::Trace, "Rating: " + to_string(ratings[index], 2) + ": " + tracks[index]->get_path());
 		}
 	}
 
-	if(bestTrack == 0)
-	{
-		console::info(("Couldn't find a match for " + title).c_str());
-	}
-	else
+	const t_size bestIndex = pickBestCandidate(ratings.data(), tracks.get_count());
+
+	if(bestIndex == pfc_infinite)
 	{
-		console::info(("Picked track with rating: " + to_string(bestTrackRating, 2) + ": " + bestTrack->get_path()).c_str());
+		BESTVERSION_LOG_TRACE("Couldn't find a match for " + title);
+		return metadb_handle_ptr();
 	}
 
+	const metadb_handle_ptr bestTrack = tracks[bestIndex];
+
+	BESTVERSION_LOG_TRACE("Picked track with rating: " + to_string(ratings[bestIndex], 2) + ": " + bestTrack->get_path());
+
 	return bestTrack;
 }
 
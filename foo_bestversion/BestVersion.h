@@ -3,26 +3,56 @@
 #include "FoobarSDKWrapper.h"
 
 #include <string>
+#include <vector>
 
 namespace bestversion {
 
+// The forms of a title being looked for that the title checks and ratings compare against; make one to check or rate many tracks
+// against the same title, rather than working them out again for each track.
+struct TitleQuery
+{
+	explicit TitleQuery(const std::string& title);
+
+	std::string title;
+	std::string foldedTitle;
+	std::string simplifiedTitle;
+	std::string normalisedTitle;
+	t_uint16 titleQualifiers;	// TitleQualifier flags from canonicaliseTitle.
+};
+
 std::string getMainArtist(metadb_handle_list_cref tracks);
+
+// Every distinct artist of the given tracks, in the order they first appear.
+std::vector<std::string> getArtists(metadb_handle_list_cref tracks);
+
 std::string getArtist(metadb_handle_ptr track);
 std::string getTitle(metadb_handle_ptr track);
 
 bool isTrackByArtist(const std::string& artist, const metadb_handle_ptr& track);
 
+// Whether the track's title is the given one, give or take case, punctuation and qualifiers on the track's title, like "(Live)".
 bool doesTrackHaveSimilarTitle(const std::string& title, const metadb_handle_ptr& track);
+bool doesTrackHaveSimilarTitle(const TitleQuery& query, const metadb_handle_ptr& track);
+
+// Whether the track's title is within a few typos of the given one; see areTitlesSimilar.
+bool doesTrackHaveCloseTitle(const std::string& title, const metadb_handle_ptr& track);
+bool doesTrackHaveCloseTitle(const TitleQuery& query, const metadb_handle_ptr& track);
 
 void filterTracksByArtist(const std::string& artist, pfc::list_base_t<metadb_handle_ptr>& tracks);
 
+// Keeps the tracks with a similar title, or failing that, the ones with a close title.
 void filterTracksByCloseTitle(const std::string& title, pfc::list_base_t<metadb_handle_ptr>& tracks);
 
+// Whether lhs is rhs, ignoring case, once lhs has had its qualifiers taken off; see canonicaliseTitle.
 bool fileTitlesMatchExcludingBracketsOnLhs(const std::string& lhs, const std::string& rhs);
 
 float calculateTrackRating(const std::string& title, const metadb_handle_ptr& track);
+float calculateTrackRating(const TitleQuery& query, const metadb_handle_ptr& track);
 
 // all tracks will be analysed; try to cut the size of the list down before calling.
 metadb_handle_ptr getBestTrackByTitle(const std::string& title, const pfc::list_base_t<metadb_handle_ptr>& tracks);
 
+// As getBestTrackByTitle, but with the ratings already calculated; ratings[i] is the rating of tracks[i].
+metadb_handle_ptr pickBestTrack(const std::string& title, const pfc::list_base_t<metadb_handle_ptr>& tracks, const std::vector<float>& ratings);
+
 } // namespace bestversion
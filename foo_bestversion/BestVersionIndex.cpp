@@ -0,0 +1,366 @@
+#include "BestVersionIndex.h"
+
+#include "Normalise.h"
+#include "RatingFeatures.h"
+#include "ToString.h"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+namespace {
+
+//------------------------------------------------------------------------------
+
+// Give the index a new GUID whenever the keys change, or foobar2000 will carry on using the hashes it worked out with the old ones.
+// {4290750D-6629-40BE-9826-8BCA1176697E}
+const GUID bestVersionIndexGUID = { 0x4290750d, 0x6629, 0x40be, { 0x98, 0x26, 0x8b, 0xca, 0x11, 0x76, 0x69, 0x7e } };
+
+// Remembered picks that haven't been looked at for this long are dropped, and picks older than this aren't trusted.
+const t_filetimestamp rememberedPickRetentionPeriod = system_time_periods::week * 4;
+
+// Bump this if what's remembered for a pick changes.
+const char* const rememberedPickVersion = "2";
+
+// Whether the index was registered; it won't be on versions of foobar2000 without metadb_index_manager.
+bool isIndexRegistered = false;
+
+//------------------------------------------------------------------------------
+
+// The artist a track is filed under: its artist tag, or album artist if it hasn't got one.
+const char* getIndexedArtist(const file_info& info)
+{
+	const bool has_artist_tag = info.meta_exists("artist");
+	const bool has_album_artist_tag = info.meta_exists("album artist");
+
+	return has_artist_tag ? info.meta_get("artist", 0) : has_album_artist_tag ? info.meta_get("album artist", 0) : "";
+}
+
+//------------------------------------------------------------------------------
+
+class BestVersionIndexClient : public metadb_index_client
+{
+public:
+	virtual metadb_index_hash transform(const file_info& info, const playable_location& /*location*/)
+	{
+		const char* title = info.meta_exists("title") ? info.meta_get("title", 0) : "";
+
+		return bestversion::hashArtistAndTitle(getIndexedArtist(info), title);
+	}
+};
+
+//------------------------------------------------------------------------------
+
+metadb_index_client::ptr getIndexClient()
+{
+	static const metadb_index_client::ptr client = new service_impl_single_t<BestVersionIndexClient>();
+	return client;
+}
+
+//------------------------------------------------------------------------------
+
+// What a pick is stored with: the version of the format, and the rating settings it was picked with, so changing them forgets every pick.
+std::string getRememberedPickVersion()
+{
+	return std::string(rememberedPickVersion) + ", " + bestversion::getRatingSettingsKey();
+}
+
+//------------------------------------------------------------------------------
+
+// A remembered pick is the title it was the best version of, when it was picked, and where the pick is, each followed by a nul.
+std::string encodeRememberedPick(const std::string& title, const t_filetimestamp pickedAt, const metadb_handle_ptr& pick)
+{
+	std::string data;
+
+	data += getRememberedPickVersion();
+	data += '\0';
+	data += bestversion::foldCase(title.c_str());
+	data += '\0';
+	data += to_string(pickedAt);
+	data += '\0';
+	data += pick->get_path();
+	data += '\0';
+	data += to_string(pick->get_subsong_index());
+	data += '\0';
+
+	return data;
+}
+
+//------------------------------------------------------------------------------
+
+// Returns the pick remembered for the given title, and when it was picked, or nothing if there isn't one or it's for a different title.
+metadb_handle_ptr decodeRememberedPick(const pfc::array_t<t_uint8>& data, const std::string& title, t_filetimestamp& pickedAt)
+{
+	std::vector<std::string> fields;
+
+	std::string field;
+	for(t_size index = 0; index < data.get_size(); ++index)
+	{
+		if(data[index] == 0)
+		{
+			fields.push_back(field);
+			field.clear();
+		}
+		else
+		{
+			field += static_cast<char>(data[index]);
+		}
+	}
+
+	if(fields.size() != 5 || fields[0] != getRememberedPickVersion())
+	{
+		return metadb_handle_ptr();
+	}
+
+	// Titles with the same key can still have different bests; "Song (Live)" shouldn't get the pick for "Song".
+	if(fields[1] != bestversion::foldCase(title.c_str()))
+	{
+		return metadb_handle_ptr();
+	}
+
+	pickedAt = from_string<t_filetimestamp>(fields[2]);
+
+	const playable_location_impl location(fields[3].c_str(), from_string<t_uint32>(fields[4]));
+
+	metadb_handle_ptr pick;
+	static_api_ptr_t<metadb>()->handle_create(pick, location);
+	return pick;
+}
+
+//------------------------------------------------------------------------------
+
+// Whether the index files the track under the given key.
+bool isTrackFiledUnder(const metadb_handle_ptr& track, const metadb_index_hash hash)
+{
+	metadb_index_hash trackHash = 0;
+	return getIndexClient()->hashHandle(track, trackHash) && trackHash == hash;
+}
+
+//------------------------------------------------------------------------------
+
+// The key under which the last time one of an artist's tracks was added or changed is kept. Track keys are the artist,
+// a newline and the title, so starting with the newline keeps it apart from all of them.
+metadb_index_hash hashArtistChange(const std::string& artist)
+{
+	const std::string key = '\n' + bestversion::normaliseArtist(artist);
+
+	return metadb_index_client::from_md5(static_api_ptr_t<hasher_md5>()->process_single_string(key.c_str()));
+}
+
+//------------------------------------------------------------------------------
+
+// When one of the artist's tracks was last added or changed, or 0 if it's not known.
+t_filetimestamp getArtistChangeTime(const std::string& artist)
+{
+	pfc::array_t<t_uint8> data;
+	static_api_ptr_t<metadb_index_manager>()->get_user_data_t(bestVersionIndexGUID, hashArtistChange(artist), data);
+
+	if(data.get_size() == 0)
+	{
+		return 0;
+	}
+
+	return from_string<t_filetimestamp>(std::string(reinterpret_cast<const char*>(data.get_ptr()), data.get_size()));
+}
+
+//------------------------------------------------------------------------------
+
+// Forgets the remembered picks for every title by the artists of the given tracks. A new or better version can be filed under
+// a different key from the pick it should replace, e.g. with a slightly different title, so it's not enough to forget the tracks' own keys.
+// Nothing's filed under an artist's change time, so foobar2000 drops it after the retention period; but by then every pick
+// from before the change is too old to be trusted anyway.
+void forgetRememberedPicks(metadb_handle_list_cref tracks)
+{
+	if(!isIndexRegistered)
+	{
+		return;
+	}
+
+	static_api_ptr_t<metadb_index_manager> indexManager;
+
+	const std::string changedAt = to_string(filetimestamp_from_system_timer());
+
+	std::vector<std::string> artists;
+
+	for(t_size index = 0; index < tracks.get_count(); ++index)
+	{
+		metadb_info_container::ptr info;
+		if(!tracks[index]->get_info_ref(info))
+		{
+			continue;
+		}
+
+		const std::string artist = bestversion::normaliseArtist(getIndexedArtist(info->info()));
+		if(std::find(artists.begin(), artists.end(), artist) == artists.end())
+		{
+			artists.push_back(artist);
+			indexManager->set_user_data(bestVersionIndexGUID, hashArtistChange(artist), changedAt.data(), changedAt.size());
+		}
+	}
+}
+
+//------------------------------------------------------------------------------
+
+} // anonymous namespace
+
+namespace bestversion {
+
+//------------------------------------------------------------------------------
+
+metadb_index_hash hashArtistAndTitle(const std::string& artist, const std::string& title)
+{
+	// The same keys the library index uses, so the two agree on what counts as the same track.
+	const std::string key = normaliseArtist(artist) + '\n' + normaliseTitle(title);
+
+	return metadb_index_client::from_md5(static_api_ptr_t<hasher_md5>()->process_single_string(key.c_str()));
+}
+
+//------------------------------------------------------------------------------
+
+BestVersionLookup::BestVersionLookup()
+	: hash(0)
+	, indexed(false)
+	, lookedUpAt(0)
+{
+}
+
+//------------------------------------------------------------------------------
+
+BestVersionLookup lookUpBestVersion(const std::string& artist, const std::string& title)
+{
+	BestVersionLookup lookup;
+	lookup.title = title;
+
+	if(!isIndexRegistered)
+	{
+		return lookup;
+	}
+
+	lookup.hash = hashArtistAndTitle(artist, title);
+	lookup.indexed = true;
+	lookup.lookedUpAt = filetimestamp_from_system_timer();
+
+	pfc::array_t<t_uint8> data;
+	static_api_ptr_t<metadb_index_manager>()->get_user_data_t(bestVersionIndexGUID, lookup.hash, data);
+
+	t_filetimestamp pickedAt = 0;
+	const metadb_handle_ptr rememberedPick = decodeRememberedPick(data, title, pickedAt);
+
+	if(rememberedPick == nullptr)
+	{
+		return lookup;
+	}
+
+	// One of the artist's tracks may have been added or changed since, and be better; or it may be so long ago that we can't tell.
+	const bool isCurrent = pickedAt > getArtistChangeTime(artist) && lookup.lookedUpAt - pickedAt < rememberedPickRetentionPeriod;
+
+	// It may have been retagged since.
+	if(isCurrent && isTrackFiledUnder(rememberedPick, lookup.hash))
+	{
+		lookup.rememberedPick = rememberedPick;
+	}
+
+	return lookup;
+}
+
+//------------------------------------------------------------------------------
+
+void rememberBestVersion(const BestVersionLookup& lookup, const metadb_handle_ptr& bestVersion)
+{
+	if(!lookup.indexed || lookup.rememberedPick != nullptr || bestVersion == nullptr)
+	{
+		return;
+	}
+
+	// It wouldn't be trusted next time if the index doesn't know it's a version of this track.
+	if(!isTrackFiledUnder(bestVersion, lookup.hash))
+	{
+		return;
+	}
+
+	// As of when it was looked up, so anything added while it was being worked out still makes it out of date.
+	const std::string data = encodeRememberedPick(lookup.title, lookup.lookedUpAt, bestVersion);
+
+	static_api_ptr_t<metadb_index_manager>()->set_user_data(bestVersionIndexGUID, lookup.hash, data.data(), data.size());
+}
+
+//------------------------------------------------------------------------------
+
+} // namespace bestversion
+
+namespace {
+
+//------------------------------------------------------------------------------
+
+class BestVersionIndexInitStage : public init_stage_callback
+{
+public:
+	virtual void on_init_stage(t_uint32 stage)
+	{
+		// The index has to be there before the configuration is read, or what it remembers won't be loaded.
+		if(stage != init_stages::before_config_read)
+		{
+			return;
+		}
+
+		try
+		{
+			static_api_ptr_t<metadb_index_manager>()->add(getIndexClient(), bestVersionIndexGUID, rememberedPickRetentionPeriod);
+			isIndexRegistered = true;
+		}
+		catch(const std::exception& e)
+		{
+			console::printf("Couldn't register the best version index: %s", e.what());
+		}
+	}
+};
+
+//------------------------------------------------------------------------------
+
+// A new version of a track, or a change to one that might make it better or worse, means the best pick needs working out again.
+class BestVersionIndexCallback : public library_callback_dynamic_impl_base
+{
+public:
+	virtual void on_items_added(metadb_handle_list_cref p_data)
+	{
+		forgetRememberedPicks(p_data);
+	}
+
+	virtual void on_items_removed(metadb_handle_list_cref /*p_data*/)
+	{
+		// Nothing to do; a pick that's gone from the library is ignored when it's looked up.
+	}
+
+	virtual void on_items_modified(metadb_handle_list_cref p_data)
+	{
+		forgetRememberedPicks(p_data);
+	}
+};
+
+//------------------------------------------------------------------------------
+
+class BestVersionIndexInitQuit : public initquit
+{
+private:
+	std::unique_ptr<BestVersionIndexCallback> callback;
+
+public:
+	virtual void on_init()
+	{
+		callback.reset(new BestVersionIndexCallback());
+	}
+
+	virtual void on_quit()
+	{
+		callback.reset();
+	}
+};
+
+//------------------------------------------------------------------------------
+
+static service_factory_single_t<BestVersionIndexInitStage> bestVersionIndexInitStageFactory;
+static initquit_factory_t<BestVersionIndexInitQuit> bestVersionIndexInitQuitFactory;
+
+//------------------------------------------------------------------------------
+
+} // anonymous namespace
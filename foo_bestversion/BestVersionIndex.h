@@ -0,0 +1,37 @@
+#pragma once
+
+#include "FoobarSDKWrapper.h"
+
+#include <string>
+
+namespace bestversion {
+
+// foobar2000's own index of the library by normalised artist and bracket-stripped title, registered with metadb_index_manager.
+// It remembers the best pick for each artist and title, so the next lookup for the same track doesn't have to rate anything.
+// Adding or changing any of an artist's tracks forgets the picks for all of their titles, and changing the rating settings forgets every pick.
+// Tracks are filed under their artist tag, or album artist if they haven't got one, as getArtist reads them.
+// The versions themselves come from the library index; metadb_index_manager only hands out library tracks on the main thread.
+
+// The index key of an artist and title.
+metadb_index_hash hashArtistAndTitle(const std::string& artist, const std::string& title);
+
+// What the index knows about the versions of one track.
+struct BestVersionLookup
+{
+	BestVersionLookup();
+
+	std::string title;							// The title looked up.
+	metadb_index_hash hash;
+	bool indexed;								// False if the index isn't available, in which case the rest is empty.
+	t_filetimestamp lookedUpAt;					// When the lookup was made; what's remembered from it is as of then.
+	metadb_handle_ptr rememberedPick;			// The best version picked last time for this title, if it's still filed under it.
+												// It may have gone from the library since; check before using it.
+};
+
+// Gathers what the index knows about the versions of the given track. Any thread.
+BestVersionLookup lookUpBestVersion(const std::string& artist, const std::string& title);
+
+// Remembers the best version found for a lookup that didn't have one, for next time. Any thread.
+void rememberBestVersion(const BestVersionLookup& lookup, const metadb_handle_ptr& bestVersion);
+
+} // namespace bestversion
@@ -0,0 +1,312 @@
+#include "BestVersionMemo.h"
+
+#include "Log.h"
+#include "Normalise.h"
+#include "ToString.h"
+
+#include <algorithm>
+
+namespace {
+
+//------------------------------------------------------------------------------
+
+// Past this many entries the memo starts again from scratch, rather than growing without limit.
+const size_t maxEntries = 20000;
+
+//------------------------------------------------------------------------------
+
+std::string getKey(const std::string& artist, const std::string& title)
+{
+	// Only the case is ignored; filterTracksByCloseTitle treats "Song" and "Song (Live)" differently, so they need their own entries.
+	return bestversion::normaliseArtist(artist) + '\n' + bestversion::foldCase(title.c_str());
+}
+
+//------------------------------------------------------------------------------
+
+// The artists of every entry the track might be a version of: each of its artists and album artists.
+void getTrackArtists(const metadb_handle_ptr& track, std::vector<std::string>& artists)
+{
+	service_ptr_t<metadb_info_container> outInfo;
+	if(!track->get_async_info_ref(outInfo))
+	{
+		return;
+	}
+
+	const file_info& fileInfo = outInfo->info();
+
+	static const char* const artistFields[] = { "artist", "album artist" };
+
+	for(const char* field : artistFields)
+	{
+		for(t_size index = 0; index < fileInfo.meta_get_count_by_name(field); ++index)
+		{
+			artists.push_back(bestversion::normaliseArtist(fileInfo.meta_get(field, index)));
+		}
+	}
+}
+
+//------------------------------------------------------------------------------
+
+void eraseKey(std::vector<std::string>& keys, const std::string& key)
+{
+	keys.erase(std::remove(keys.begin(), keys.end(), key), keys.end());
+}
+
+//------------------------------------------------------------------------------
+
+} // anonymous namespace
+
+namespace bestversion {
+
+//------------------------------------------------------------------------------
+
+BestVersionMemo::BestVersionMemo()
+	: generation(0)
+	, hits(0)
+	, misses(0)
+{
+}
+
+//------------------------------------------------------------------------------
+
+t_uint64 BestVersionMemo::getGeneration() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return generation;
+}
+
+//------------------------------------------------------------------------------
+
+bool BestVersionMemo::find(const std::string& artist, const std::string& title, Result& out)
+{
+	const std::string key = getKey(artist, title);
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		const auto entryIter = entries.find(key);
+		if(entryIter != entries.end())
+		{
+			out = entryIter->second.result;
+			++hits;
+			return true;
+		}
+	}
+
+	++misses;
+	return false;
+}
+
+//------------------------------------------------------------------------------
+
+void BestVersionMemo::add(const std::string& artist, const std::string& title, const Result& result, metadb_handle_list_cref candidates, const t_uint64 resultGeneration)
+{
+	const std::string key = getKey(artist, title);
+
+	Entry entry;
+	entry.result = result;
+	entry.artist = normaliseArtist(artist);
+	entry.candidates.reserve(candidates.get_count());
+
+	for(t_size index = 0; index < candidates.get_count(); ++index)
+	{
+		entry.candidates.push_back(candidates[index].get_ptr());
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	// Something's changed since the result was worked out, so it may be out of date already.
+	if(resultGeneration != generation)
+	{
+		return;
+	}
+
+	if(entries.size() >= maxEntries)
+	{
+		entries.clear();
+		keysByTrack.clear();
+		keysByArtist.clear();
+	}
+
+	// Another thread may have got there first.
+	if(entries.find(key) != entries.end())
+	{
+		return;
+	}
+
+	for(const metadb_handle* candidate : entry.candidates)
+	{
+		keysByTrack[candidate].push_back(key);
+	}
+
+	keysByArtist[entry.artist].push_back(key);
+
+	entries.emplace(key, std::move(entry));
+}
+
+//------------------------------------------------------------------------------
+
+t_uint64 BestVersionMemo::invalidateTracks(metadb_handle_list_cref tracks, metadb_handle_list_cref newTracks)
+{
+	// Read the tags before taking the lock.
+	std::vector<std::string> artists;
+
+	for(t_size index = 0; index < newTracks.get_count(); ++index)
+	{
+		getTrackArtists(newTracks[index], artists);
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	++generation;
+
+	// Entries the tracks were candidates for; their tags or play counts may have changed.
+	for(t_size index = 0; index < tracks.get_count(); ++index)
+	{
+		const auto trackIter = keysByTrack.find(tracks[index].get_ptr());
+		if(trackIter == keysByTrack.end())
+		{
+			continue;
+		}
+
+		const std::vector<std::string> keys = trackIter->second;
+		for(const auto& key : keys)
+		{
+			eraseEntry(key);
+		}
+	}
+
+	// Entries the tracks might be candidates for now. That's any title by the same artist, not just the same title:
+	// a title a typo away can be a version too, and so can one that had no versions at all before.
+	for(const auto& artist : artists)
+	{
+		const auto artistIter = keysByArtist.find(artist);
+		if(artistIter == keysByArtist.end())
+		{
+			continue;
+		}
+
+		const std::vector<std::string> keys = artistIter->second;
+		for(const auto& key : keys)
+		{
+			eraseEntry(key);
+		}
+	}
+
+	return generation;
+}
+
+//------------------------------------------------------------------------------
+
+void BestVersionMemo::clear()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	// The library hasn't changed, so the generation stays as it is; results being worked out now are still good.
+	entries.clear();
+	keysByTrack.clear();
+	keysByArtist.clear();
+}
+
+//------------------------------------------------------------------------------
+
+BestVersionMemo::Stats BestVersionMemo::getStats() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	const Stats stats = { hits, misses, entries.size() };
+	return stats;
+}
+
+//------------------------------------------------------------------------------
+
+void BestVersionMemo::eraseEntry(const std::string& key)
+{
+	const auto entryIter = entries.find(key);
+	if(entryIter == entries.end())
+	{
+		return;
+	}
+
+	const Entry& entry = entryIter->second;
+
+	for(const metadb_handle* candidate : entry.candidates)
+	{
+		const auto trackIter = keysByTrack.find(candidate);
+		if(trackIter != keysByTrack.end())
+		{
+			eraseKey(trackIter->second, key);
+			if(trackIter->second.empty())
+			{
+				keysByTrack.erase(trackIter);
+			}
+		}
+	}
+
+	const auto artistIter = keysByArtist.find(entry.artist);
+	if(artistIter != keysByArtist.end())
+	{
+		eraseKey(artistIter->second, key);
+		if(artistIter->second.empty())
+		{
+			keysByArtist.erase(artistIter);
+		}
+	}
+
+	entries.erase(entryIter);
+}
+
+//------------------------------------------------------------------------------
+
+BestVersionMemo& getBestVersionMemo()
+{
+	static BestVersionMemo bestVersionMemo;
+	return bestVersionMemo;
+}
+
+//------------------------------------------------------------------------------
+
+void logBestVersionMemoStats()
+{
+	const BestVersionMemo::Stats stats = getBestVersionMemo().getStats();
+	const t_uint64 lookups = stats.hits + stats.misses;
+
+	if(lookups == 0)
+	{
+		return;
+	}
+
+	const double hitRate = 100.0 * static_cast<double>(stats.hits) / static_cast<double>(lookups);
+
+	log(
+		LogLevel::Info,
+		"Best version memo: " + to_string(stats.hits) + " hits, " + to_string(stats.misses) + " misses (" +
+		to_string(hitRate, 3) + "% hit rate), " + to_string(stats.numEntries) + " entries"
+	);
+}
+
+//------------------------------------------------------------------------------
+
+} // namespace bestversion
+
+namespace {
+
+//------------------------------------------------------------------------------
+
+class BestVersionMemoInitQuit : public initquit
+{
+public:
+	virtual void on_quit()
+	{
+		// Don't hang on to any tracks while the app is shutting down.
+		bestversion::getBestVersionMemo().clear();
+	}
+};
+
+//------------------------------------------------------------------------------
+
+static initquit_factory_t<BestVersionMemoInitQuit> bestVersionMemoInitQuitFactory;
+
+//------------------------------------------------------------------------------
+
+} // anonymous namespace
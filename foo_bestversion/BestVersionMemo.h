@@ -0,0 +1,79 @@
+#pragma once
+
+#include "FoobarSDKWrapper.h"
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace bestversion {
+
+// Remembers the best version picked for each artist and title, so the same track coming up again in another chart or similar tracks list
+// doesn't have to be rated all over again. Safe to use from any thread.
+// An entry is forgotten as soon as any track it was picked from changes, or a track by the same artist turns up or is retagged with
+// a different artist or title, as that track might now be a version of it, however close its title is. A track that's only been
+// played, say, can't be a version of anything new. The library index tells the memo about every change.
+class BestVersionMemo
+{
+public:
+	struct Result
+	{
+		metadb_handle_ptr track;	// Null if there was no version of it at all.
+		float rating;
+	};
+
+	struct Stats
+	{
+		t_uint64 hits;
+		t_uint64 misses;
+		t_size numEntries;
+	};
+
+	BestVersionMemo();
+
+	// Goes up with every change to the library; see invalidateTracks.
+	t_uint64 getGeneration() const;
+
+	bool find(const std::string& artist, const std::string& title, Result& out);
+
+	// candidates are the tracks the result was picked from, after filtering. generation is the memo generation of the snapshot
+	// they came from (see LibrarySnapshot::getMemoGeneration); if the library has changed since, the result isn't kept.
+	void add(const std::string& artist, const std::string& title, const Result& result, metadb_handle_list_cref candidates, t_uint64 generation);
+
+	// Forgets every entry picked from any of the tracks, and returns the new generation. newTracks are those that could be versions
+	// of titles they weren't picked from before, having just turned up or had their artist or title changed; every entry by any of
+	// their artists goes too.
+	t_uint64 invalidateTracks(metadb_handle_list_cref tracks, metadb_handle_list_cref newTracks);
+
+	void clear();
+
+	Stats getStats() const;
+
+private:
+	struct Entry
+	{
+		Result result;
+		std::string artist;
+		std::vector<const metadb_handle*> candidates;
+	};
+
+	void eraseEntry(const std::string& key);
+
+	mutable std::mutex mutex;
+	t_uint64 generation;
+	std::unordered_map<std::string, Entry> entries;						// By normalised artist and case-folded title.
+	std::unordered_map<const metadb_handle*, std::vector<std::string>> keysByTrack;
+	std::unordered_map<std::string, std::vector<std::string>> keysByArtist;	// By normalised artist, as the library index files tracks.
+
+	std::atomic<t_uint64> hits;
+	std::atomic<t_uint64> misses;
+};
+
+BestVersionMemo& getBestVersionMemo();
+
+// Writes the memo's hit rate to the console; one line per job.
+void logBestVersionMemoStats();
+
+} // namespace bestversion
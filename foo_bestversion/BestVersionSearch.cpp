@@ -0,0 +1,367 @@
+#include "BestVersionSearch.h"
+
+#include "BestVersion.h"
+#include "BestVersionMemo.h"
+#include "Log.h"
+#include "Normalise.h"
+#include "ParallelFor.h"
+#include "Trace.h"
+
+#include <atomic>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+using namespace bestversion;
+
+//------------------------------------------------------------------------------
+
+// Rates the candidates and picks the best of them; rating is the pick's, or -1 if there's no pick.
+metadb_handle_ptr rateAndPickBestVersion(const LibrarySnapshot& library, const std::string& title, const pfc::list_base_t<metadb_handle_ptr>& candidates, float& rating)
+{
+	const TraceScope scope("Rate candidates");
+
+	std::vector<float> ratings;
+	library.calculateRatings(title, candidates, ratings);
+
+	const metadb_handle_ptr bestTrack = pickBestTrack(title, candidates, ratings);
+
+	const t_size bestIndex = bestTrack != nullptr ? candidates.find_item(bestTrack) : pfc_infinite;
+	rating = bestIndex != pfc_infinite ? ratings[bestIndex] : -1.0f;
+
+	return bestTrack;
+}
+
+//------------------------------------------------------------------------------
+
+// As rateAndPickBestVersion, and remembers the pick in the memo.
+metadb_handle_ptr pickAndRememberBestVersion(const LibrarySnapshot& library, const std::string& artist, const std::string& title, const pfc::list_base_t<metadb_handle_ptr>& candidates)
+{
+	BestVersionMemo::Result memoResult = { metadb_handle_ptr(), -1.0f };
+	memoResult.track = rateAndPickBestVersion(library, title, candidates, memoResult.rating);
+
+	library.getMemo().add(artist, title, memoResult, candidates, library.getMemoGeneration());
+
+	return memoResult.track;
+}
+
+//------------------------------------------------------------------------------
+
+// Finds the best version of the recording with the track's MusicBrainz ID, if any track in the library has it. The versions are
+// found by ID and rated as they are, without going through names; the pick is remembered under the library's artist and title of it.
+bool findBestVersionByMBID(const LibrarySnapshot& library, const TrackName& track, metadb_handle_ptr& bestVersion)
+{
+	if(track.trackMBID.empty())
+	{
+		return false;
+	}
+
+	pfc::list_t<metadb_handle_ptr> candidates;
+	std::string title;
+	if(!library.getVersionsOfRecording(track.trackMBID, candidates, title))
+	{
+		return false;
+	}
+
+	countTrace(TraceCounter::MBIDMatches);
+
+	const std::string artist = getArtist(candidates[0]);
+
+	BestVersionMemo::Result memoResult;
+	if(library.getMemo().find(artist, title, memoResult))
+	{
+		bestVersion = memoResult.track;
+		return true;
+	}
+
+	bestVersion = pickAndRememberBestVersion(library, artist, title, candidates);
+	return true;
+}
+
+//------------------------------------------------------------------------------
+
+} // anonymous namespace
+
+namespace bestversion {
+
+//------------------------------------------------------------------------------
+
+metadb_handle_ptr findBestVersion(const LibrarySnapshot& library, const std::string& artist, const std::string& title)
+{
+	BestVersionMemo::Result memoResult;
+	if(library.getMemo().find(artist, title, memoResult))
+	{
+		return memoResult.track;
+	}
+
+	pfc::list_t<metadb_handle_ptr> subsetOfLibrary;
+	findCandidates(library, artist, title, subsetOfLibrary);
+
+	return pickAndRememberBestVersion(library, artist, title, subsetOfLibrary);
+}
+
+//------------------------------------------------------------------------------
+
+void findCandidates(const LibrarySnapshot& library, const std::string& artist, const std::string& title, pfc::list_base_t<metadb_handle_ptr>& candidates)
+{
+	const TraceScope scope("Filter candidates");
+
+	// Only look at the tracks the index thinks are close, rather than the whole library.
+	library.getCandidates(artist, title, candidates);
+	library.filterTracksByArtist(artist, candidates);
+	library.filterTracksByCloseTitle(title, candidates);
+}
+
+//------------------------------------------------------------------------------
+
+metadb_handle_ptr pickBestVersion(const LibrarySnapshot& library, const std::string& title, const pfc::list_base_t<metadb_handle_ptr>& candidates)
+{
+	float rating = 0.0f;
+	return rateAndPickBestVersion(library, title, candidates, rating);
+}
+
+//------------------------------------------------------------------------------
+
+metadb_handle_ptr findBestVersion(const LibrarySnapshot& library, const BestVersionLookup& lookup, const std::string& artist)
+{
+	// It may have gone from the library since it was picked.
+	if(lookup.rememberedPick != nullptr && library.hasTrack(lookup.rememberedPick))
+	{
+		BESTVERSION_LOG_TRACE("Best version of " + lookup.title + " already known: " + lookup.rememberedPick->get_path());
+		return lookup.rememberedPick;
+	}
+
+	return findBestVersion(library, artist, lookup.title);
+}
+
+//------------------------------------------------------------------------------
+
+void findBestVersions(
+	const LibrarySnapshot& library,
+	const std::vector<TrackName>& tracks,
+	std::vector<metadb_handle_ptr>& bestVersions,
+	const std::function<void (t_size numDone, t_size total)>& onProgress,
+	abort_callback& abort
+)
+{
+	static const size_t noKey = ~static_cast<size_t>(0);
+
+	const TraceScope scope("Find best versions");
+
+	// The distinct titles of one artist, to be joined to the artist's tracks in one pass.
+	struct ArtistGroup
+	{
+		std::string artist;					// The first spelling we came across, or the library's if it knows any of the tracks' artist IDs.
+		bool isArtistFromMBID;
+		std::vector<std::string> titles;
+		std::vector<metadb_handle_ptr> bestVersions;
+	};
+
+	// Join the tracks to the library on their keys: one lookup for each distinct key, then hand the results back out to every track with it.
+	// The key is the memo's, so two tracks only share a lookup if they'd share a memo entry anyway. The keys are grouped by artist,
+	// so each artist's tracks are gone through once for all their titles, rather than once per title.
+	std::unordered_map<std::string, size_t> keys;
+	std::unordered_map<std::string, size_t> groupsByArtist;
+	std::vector<ArtistGroup> groups;
+	std::vector<std::pair<size_t, size_t>> keyTitles;	// The group and the index of the title in it, by key.
+	std::vector<size_t> trackKeys(tracks.size(), noKey);
+
+	bestVersions.assign(tracks.size(), metadb_handle_ptr());
+
+	for(size_t index = 0; index < tracks.size(); ++index)
+	{
+		if(tracks[index].artist.empty() || tracks[index].title.empty())
+		{
+			continue;
+		}
+
+		if(findBestVersionByMBID(library, tracks[index], bestVersions[index]))
+		{
+			continue;
+		}
+
+		const TrackName& track = tracks[index];
+		const std::string normalisedArtist = normaliseArtist(track.artist);
+
+		const auto group = groupsByArtist.emplace(normalisedArtist, groups.size());
+		if(group.second)
+		{
+			groups.push_back(ArtistGroup());
+			groups.back().artist = track.artist;
+			groups.back().isArtistFromMBID = false;
+		}
+
+		ArtistGroup& artistGroup = groups[group.first->second];
+
+		// Go by the library's own spelling of the artist if it knows the ID of any of the tracks' artist.
+		if(!artistGroup.isArtistFromMBID && !track.artistMBID.empty())
+		{
+			const std::string artistByMBID = library.getArtistByMBID(track.artistMBID);
+			if(!artistByMBID.empty())
+			{
+				artistGroup.artist = artistByMBID;
+				artistGroup.isArtistFromMBID = true;
+			}
+		}
+
+		const auto key = keys.emplace(normalisedArtist + '\n' + foldCase(track.title.c_str()), keyTitles.size());
+		if(key.second)
+		{
+			keyTitles.push_back(std::make_pair(group.first->second, artistGroup.titles.size()));
+			artistGroup.titles.push_back(track.title);
+		}
+
+		trackKeys[index] = key.first->second;
+	}
+
+	std::atomic<t_size> numDone(0);
+
+	parallelFor(
+		groups.size(),
+		getDefaultThreadCount(),
+		[&](t_size group)
+		{
+			ArtistGroup& artistGroup = groups[group];
+			findBestVersionsByArtist(library, artistGroup.artist, artistGroup.titles, artistGroup.bestVersions);
+			numDone += artistGroup.titles.size();
+		},
+		[&]()
+		{
+			onProgress(numDone, keyTitles.size());
+		},
+		abort
+	);
+
+	abort.check();
+
+	for(size_t index = 0; index < tracks.size(); ++index)
+	{
+		if(trackKeys[index] != noKey)
+		{
+			const auto& keyTitle = keyTitles[trackKeys[index]];
+			bestVersions[index] = groups[keyTitle.first].bestVersions[keyTitle.second];
+		}
+	}
+}
+
+//------------------------------------------------------------------------------
+
+void findBestVersionsByArtist(
+	const LibrarySnapshot& library,
+	const std::string& artist,
+	const std::vector<std::string>& titles,
+	std::vector<metadb_handle_ptr>& bestVersions
+)
+{
+	const TraceScope scope("Find best versions by artist");
+
+	BestVersionMemo& memo = library.getMemo();
+
+	bestVersions.assign(titles.size(), metadb_handle_ptr());
+
+	// The titles that each normalised title the library files tracks under could be a version of. A similar track is always
+	// filed under the normalised or simplified form of the title it's similar to, so those are the only two keys needed.
+	std::unordered_map<std::string, std::vector<size_t>> titlesByKey;
+	std::vector<bool> needsLookup(titles.size(), false);
+	std::vector<pfc::list_t<metadb_handle_ptr>> candidates(titles.size());
+
+	{
+		const TraceScope gatherScope("Gather candidates");
+
+		for(size_t index = 0; index < titles.size(); ++index)
+		{
+			BestVersionMemo::Result memoResult;
+			if(memo.find(artist, titles[index], memoResult))
+			{
+				bestVersions[index] = memoResult.track;
+				continue;
+			}
+
+			needsLookup[index] = true;
+
+			const std::string normalisedTitle = normaliseTitle(titles[index]);
+			const std::string simplifiedTitle = simplifyTitle(titles[index]);
+
+			titlesByKey[normalisedTitle].push_back(index);
+			if(simplifiedTitle != normalisedTitle)
+			{
+				titlesByKey[simplifiedTitle].push_back(index);
+			}
+		}
+
+		library.forEachTitleByArtist(
+			artist,
+			[&](const std::string& normalisedTitle, const std::vector<metadb_handle_ptr>& tracks)
+			{
+				const auto keyIter = titlesByKey.find(normalisedTitle);
+				if(keyIter == titlesByKey.end())
+				{
+					return;
+				}
+
+				for(const size_t index : keyIter->second)
+				{
+					for(const auto& track : tracks)
+					{
+						candidates[index].add_item(track);
+					}
+				}
+			}
+		);
+	}
+
+	for(size_t index = 0; index < titles.size(); ++index)
+	{
+		if(!needsLookup[index])
+		{
+			continue;
+		}
+
+		pfc::list_t<metadb_handle_ptr>& titleCandidates = candidates[index];
+
+		{
+			const TraceScope filterScope("Filter candidates");
+			library.filterTracksByArtist(artist, titleCandidates);
+			library.filterTracksBySimilarTitle(titles[index], titleCandidates);
+		}
+
+		if(titleCandidates.get_count() > 0)
+		{
+			bestVersions[index] = pickAndRememberBestVersion(library, artist, titles[index], titleCandidates);
+		}
+		else
+		{
+			bestVersions[index] = findBestVersion(library, artist, titles[index]);
+		}
+	}
+}
+
+//------------------------------------------------------------------------------
+
+metadb_handle_ptr bestVersionOf(const LibrarySnapshot& library, const metadb_handle_ptr& track, BestVersionLookup& lookup)
+{
+	const auto artist = getArtist(track);
+	const auto trackTitle = getTitle(track);
+
+	if(artist.empty() || trackTitle.empty())
+	{
+		log(LogLevel::Warning, std::string("File has empty artist or track tag: ") + track->get_path());
+		return metadb_handle_ptr();
+	}
+
+	lookup = lookUpBestVersion(artist, trackTitle);
+
+	const auto& bestVersionOfTrack = findBestVersion(library, lookup, artist);
+
+	if(bestVersionOfTrack == nullptr)
+	{
+		BESTVERSION_LOG_TRACE("Couldn't find a better version of " + trackTitle);
+	}
+
+	return bestVersionOfTrack;
+}
+
+//------------------------------------------------------------------------------
+
+} // namespace bestversion
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "FoobarSDKWrapper.h"
+
+#include "BestVersionIndex.h"
+#include "LibraryIndex.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace bestversion {
+
+// A track to look for, e.g. from a chart or a playlist file.
+struct TrackName
+{
+	std::string artist;
+	std::string title;
+	std::string trackMBID;	// MusicBrainz IDs, if whoever listed the track knows them; empty otherwise.
+	std::string artistMBID;
+};
+
+// The best version in the library of the given track, or null if there isn't one. Any thread.
+metadb_handle_ptr findBestVersion(const LibrarySnapshot& library, const std::string& artist, const std::string& title);
+
+// As above, but starting from what the metadb index knows about the track; see lookUpBestVersion.
+metadb_handle_ptr findBestVersion(const LibrarySnapshot& library, const BestVersionLookup& lookup, const std::string& artist);
+
+// The tracks findBestVersion rates for the given track: the library's tracks by the artist with a close title.
+void findCandidates(const LibrarySnapshot& library, const std::string& artist, const std::string& title, pfc::list_base_t<metadb_handle_ptr>& candidates);
+
+// The best of the candidates for the title, or null if there are none. Unlike findBestVersion, the pick isn't remembered in the memo,
+// so the candidates can have been narrowed down in a way the memo doesn't know about, e.g. with the tracks whose files are gone taken out.
+metadb_handle_ptr pickBestVersion(const LibrarySnapshot& library, const std::string& title, const pfc::list_base_t<metadb_handle_ptr>& candidates);
+
+// The best version of each of the tracks; bestVersions[i] is null if tracks[i] hasn't got one, or is missing its artist or title.
+// A track with a MusicBrainz recording ID that's in the library is matched by ID, so it's found however last.fm spells it: the
+// tracks tagged with it, and the untagged ones filed under the same artist and title, are rated straight away, without any names.
+// Only the tracks whose ID isn't in the library are looked up by name.
+// It's a join rather than a lookup per track: every distinct artist and title is looked up once, however many times it comes up,
+// each artist's titles are found together with findBestVersionsByArtist, and the artists are spread over all cores.
+// An artist's MusicBrainz ID finds them in the library even if the tags spell their name differently.
+// onProgress is called every so often with the number of distinct tracks looked up so far.
+void findBestVersions(
+	const LibrarySnapshot& library,
+	const std::vector<TrackName>& tracks,
+	std::vector<metadb_handle_ptr>& bestVersions,
+	const std::function<void (t_size numDone, t_size total)>& onProgress,
+	abort_callback& abort
+);
+
+// The best versions of many titles by one artist, e.g. their chart; bestVersions[i] is the best version of titles[i], or null.
+// Rather than a lookup per title, this goes through the artist's tracks in the library once, a title bucket at a time, and hands
+// each bucket to every title it could hold versions of, then rates what each title got. Any title with nothing similar is
+// looked up on its own with findBestVersion, which also allows for typos.
+void findBestVersionsByArtist(
+	const LibrarySnapshot& library,
+	const std::string& artist,
+	const std::vector<std::string>& titles,
+	std::vector<metadb_handle_ptr>& bestVersions
+);
+
+// The best version of a track that's already in a playlist, going by its own artist and title tags.
+// lookup is filled in with what the metadb index knows about it, for rememberBestVersion.
+metadb_handle_ptr bestVersionOf(const LibrarySnapshot& library, const metadb_handle_ptr& track, BestVersionLookup& lookup);
+
+} // namespace bestversion
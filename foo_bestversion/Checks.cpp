@@ -0,0 +1,692 @@
+#include "Checks.h"
+
+#ifdef BESTVERSION_BENCHMARKS
+
+#include "ArtistCharts.h"
+#include "BestVersion.h"
+#include "BestVersionMemo.h"
+#include "FuzzyMatch.h"
+#include "LastFmCache.h"
+#include "LibraryIndex.h"
+#include "Normalise.h"
+#include "ScoringKernels.h"
+#include "SyntheticLibrary.h"
+#include "ToString.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace {
+
+using namespace bestversion;
+
+//------------------------------------------------------------------------------
+
+// Counts the checks in one group and reports any that fail.
+class Checker
+{
+public:
+	explicit Checker(const std::function<void (const std::string&)>& report_)
+		: report(report_)
+		, numChecks(0)
+		, numFailed(0)
+	{
+	}
+
+	void expect(const bool condition, const std::string& what)
+	{
+		++numChecks;
+
+		if(!condition)
+		{
+			++numFailed;
+			report("FAILED: " + what);
+		}
+	}
+
+	// Reports how the group went, and returns the number of checks that failed.
+	t_size finish(const std::string& name) const
+	{
+		report(name + ": " + (numFailed == 0 ? "all " + to_string(numChecks) + " checks passed" : to_string(numFailed) + " of " + to_string(numChecks) + " checks FAILED"));
+		return numFailed;
+	}
+
+private:
+	const std::function<void (const std::string&)>& report;
+	t_size numChecks;
+	t_size numFailed;
+};
+
+//------------------------------------------------------------------------------
+
+// A directory in the profile that's emptied before and deleted after use.
+class ScratchDirectory
+{
+public:
+	ScratchDirectory(const char* name, abort_callback& abort_)
+		: path(core_api::pathInProfile((std::string("foo_bestversion-checks-") + name).c_str()).get_ptr())
+		, abort(abort_)
+	{
+		remove();
+	}
+
+	~ScratchDirectory()
+	{
+		try
+		{
+			remove();
+		}
+		catch(const std::exception&)
+		{
+		}
+	}
+
+	const std::string path;
+
+private:
+	void remove()
+	{
+		if(filesystem::g_exists(path.c_str(), abort))
+		{
+			filesystem::g_remove_object_recur(path.c_str(), abort);
+		}
+	}
+
+	abort_callback& abort;
+};
+
+//------------------------------------------------------------------------------
+
+// Stands in for last.fm: serves whatever body each URL has been given, with an ETag that changes whenever the body does,
+// and answers 304 to a request that sends the current one.
+class FakeLastFm
+{
+public:
+	FakeLastFm()
+		: numRequests(0)
+		, numNotModified(0)
+	{
+	}
+
+	void setBody(const std::string& url, const std::string& body)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		Resource& resource = resources[url];
+		resource.body = body;
+		++resource.version;
+	}
+
+	HttpGet getHttpGet()
+	{
+		return [this](const std::string& url, const std::string& etag, const std::string& /*lastModified*/, abort_callback& /*abort*/)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			++numRequests;
+
+			const Resource& resource = resources[url];
+			const std::string currentEtag = "\"" + to_string(resource.version) + "\"";
+
+			if(etag == currentEtag)
+			{
+				++numNotModified;
+				return HttpResponse{ 304, std::string(), currentEtag, std::string() };
+			}
+
+			return HttpResponse{ 200, resource.body, currentEtag, std::string() };
+		};
+	}
+
+	t_size getNumRequests()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return numRequests;
+	}
+
+	t_size getNumNotModified()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return numNotModified;
+	}
+
+private:
+	struct Resource
+	{
+		Resource()
+			: version(0)
+		{
+		}
+
+		std::string body;
+		t_size version;
+	};
+
+	std::mutex mutex;
+	std::unordered_map<std::string, Resource> resources;
+	t_size numRequests;
+	t_size numNotModified;
+};
+
+//------------------------------------------------------------------------------
+
+t_size checkLastFmCache(const std::function<void (const std::string&)>& report, abort_callback& abort)
+{
+	Checker checker(report);
+
+	const char* const method = "artist.getTopTracks";
+	const LastFmParameters parameters = { { "artist", "Artist 1" } };
+	const LastFmParameters otherParameters = { { "artist", "Artist 2" } };
+	const std::string url = "https://fake.last.fm/?method=artist.gettoptracks&artist=Artist+1";
+	const std::string otherUrl = "https://fake.last.fm/?method=artist.gettoptracks&artist=Artist+2";
+
+	const LastFmCacheSettings fresh = { true, 60 * 60, 1024 * 1024, false };
+	const LastFmCacheSettings expired = { true, 0, 1024 * 1024, false };
+	const LastFmCacheSettings staleWhileRevalidate = { true, 0, 1024 * 1024, true };
+
+	// The fakes are declared before the caches, so they outlive any background refresh.
+	{
+		ScratchDirectory directory("fresh", abort);
+		FakeLastFm lastFm;
+		LastFmCache cache(directory.path, lastFm.getHttpGet());
+
+		lastFm.setBody(url, "one");
+		checker.expect(cache.get(url, method, parameters, fresh, abort) == "one", "a miss is fetched from last.fm");
+
+		lastFm.setBody(url, "two");
+		checker.expect(cache.get(url, method, parameters, fresh, abort) == "one", "a fresh hit comes from the cache");
+		checker.expect(lastFm.getNumRequests() == 1, "a fresh hit doesn't ask last.fm");
+	}
+
+	{
+		ScratchDirectory directory("revalidate", abort);
+		FakeLastFm lastFm;
+		LastFmCache cache(directory.path, lastFm.getHttpGet());
+
+		lastFm.setBody(url, "one");
+		cache.get(url, method, parameters, expired, abort);
+
+		checker.expect(cache.get(url, method, parameters, expired, abort) == "one", "a 304 keeps the cached body");
+		checker.expect(lastFm.getNumRequests() == 2 && lastFm.getNumNotModified() == 1, "an expired response is revalidated with its ETag");
+
+		lastFm.setBody(url, "two");
+		checker.expect(cache.get(url, method, parameters, expired, abort) == "two", "a changed response replaces the cached one");
+	}
+
+	{
+		ScratchDirectory directory("stale", abort);
+		FakeLastFm lastFm;
+		LastFmCache cache(directory.path, lastFm.getHttpGet());
+
+		lastFm.setBody(url, "one");
+		cache.get(url, method, parameters, staleWhileRevalidate, abort);
+
+		lastFm.setBody(url, "two");
+		checker.expect(cache.get(url, method, parameters, staleWhileRevalidate, abort) == "one", "a stale response is returned straight away");
+
+		// The refresh happens in the background; wait for it to be written, without asking last.fm again.
+		std::string body;
+		for(t_size attempt = 0; attempt < 100 && body != "two"; ++attempt)
+		{
+			abort.sleep(0.05);
+			body = cache.get(url, method, parameters, fresh, abort);
+		}
+
+		checker.expect(body == "two", "a stale response is refreshed in the background");
+	}
+
+	{
+		ScratchDirectory directory("evict", abort);
+		FakeLastFm lastFm;
+		LastFmCache cache(directory.path, lastFm.getHttpGet());
+
+		// Room for one response but not two.
+		const LastFmCacheSettings small = { true, 60 * 60, 1500, false };
+
+		lastFm.setBody(url, std::string(1000, 'a'));
+		lastFm.setBody(otherUrl, std::string(1000, 'b'));
+
+		cache.get(url, method, parameters, small, abort);
+		cache.get(otherUrl, method, otherParameters, small, abort);
+
+		checker.expect(cache.get(otherUrl, method, otherParameters, small, abort) == std::string(1000, 'b') && lastFm.getNumRequests() == 2, "the most recent response is kept");
+		checker.expect(cache.get(url, method, parameters, small, abort) == std::string(1000, 'a') && lastFm.getNumRequests() == 3, "the least recently used response is thrown away to make room");
+	}
+
+	return checker.finish("LastFmCache (fake last.fm)");
+}
+
+//------------------------------------------------------------------------------
+
+// The ratings from the library index's feature table against calculateTrackRating, which reads the tags every time, for every
+// version of every title in the synthetic library; and the picks made from them against the way getBestTrackByTitle used to pick.
+t_size checkRatingTable(const SyntheticLibrarySettings& settings, const std::function<void (const std::string&)>& report, abort_callback& abort)
+{
+	Checker checker(report);
+
+	const metadb_handle_list library = generateSyntheticLibrary(settings);
+
+	BestVersionMemo memo;
+	const std::shared_ptr<const LibrarySnapshot> snapshot = LibrarySnapshot::build(library, memo);
+
+	t_size numRatings = 0;
+	t_size numDifferentRatings = 0;
+	t_size numPicks = 0;
+	t_size numDifferentPicks = 0;
+
+	// The versions of each title are next to each other; see generateSyntheticLibrary.
+	for(t_size first = 0; first < library.get_count(); first += settings.numVersionsPerTitle)
+	{
+		abort.check();
+
+		metadb_handle_list versions;
+		for(t_size index = first; index < first + settings.numVersionsPerTitle && index < library.get_count(); ++index)
+		{
+			versions.add_item(library[index]);
+		}
+
+		// Each version's own title, and the next title along, which none of them should match.
+		std::vector<std::string> titles;
+		for(t_size index = 0; index < versions.get_count(); ++index)
+		{
+			titles.push_back(getTitle(versions[index]));
+		}
+
+		if(first + versions.get_count() < library.get_count())
+		{
+			titles.push_back(getTitle(library[first + versions.get_count()]));
+		}
+
+		for(const auto& title : titles)
+		{
+			std::vector<float> tableRatings;
+			snapshot->calculateRatings(title, versions, tableRatings);
+
+			t_size oldPick = pfc_infinite;
+			float oldPickRating = std::numeric_limits<float>::min();
+
+			for(t_size index = 0; index < versions.get_count(); ++index)
+			{
+				const float rating = calculateTrackRating(title, versions[index]);
+
+				++numRatings;
+				numDifferentRatings += rating != tableRatings[index] ? 1 : 0;
+
+				if(rating >= 0.0f && rating > oldPickRating)
+				{
+					oldPickRating = rating;
+					oldPick = index;
+				}
+			}
+
+			++numPicks;
+			numDifferentPicks += pickBestCandidate(tableRatings.data(), versions.get_count()) != oldPick ? 1 : 0;
+		}
+	}
+
+	checker.expect(numDifferentRatings == 0, to_string(numDifferentRatings) + " of " + to_string(numRatings) + " feature table ratings aren't exactly calculateTrackRating's");
+	checker.expect(numDifferentPicks == 0, to_string(numDifferentPicks) + " of " + to_string(numPicks) + " picks aren't the ones getBestTrackByTitle used to make");
+
+	return checker.finish("Feature table ratings and picks (synthetic library, " + to_string(numRatings) + " ratings)");
+}
+
+//------------------------------------------------------------------------------
+
+// Every kernel this CPU can run against the scalar one, bit for bit, for every count up to a few vectors' worth so that
+// each way of handling the leftovers at the end is covered, and for a big batch.
+t_size checkScoringKernels(const std::function<void (const std::string&)>& report)
+{
+	static const ScoringKernel kernels[] = { ScoringKernel::SSE2, ScoringKernel::AVX2 };
+	static const t_size maxCount = 1000;
+
+	Checker checker(report);
+
+	const SyntheticCandidates candidates = generateSyntheticCandidates(1, maxCount);
+	const CandidateColumns columns = candidates.getColumns();
+
+	std::vector<t_size> counts;
+	for(t_size count = 0; count <= 40; ++count)
+	{
+		counts.push_back(count);
+	}
+	counts.push_back(maxCount);
+
+	std::vector<float> scalarRatings(maxCount);
+	std::vector<float> kernelRatings(maxCount);
+
+	for(const ScoringKernel kernel : kernels)
+	{
+		if(kernel > getBestScoringKernel())
+		{
+			report(std::string("Not checking the ") + getScoringKernelName(kernel) + " scoring kernel; this CPU can't run it");
+			continue;
+		}
+
+		t_size numDifferentCounts = 0;
+
+		for(const t_size count : counts)
+		{
+			scoreCandidates(ScoringKernel::Scalar, columns, count, scalarRatings.data());
+			scoreCandidates(kernel, columns, count, kernelRatings.data());
+
+			if(memcmp(scalarRatings.data(), kernelRatings.data(), count * sizeof(float)) != 0)
+			{
+				++numDifferentCounts;
+			}
+		}
+
+		checker.expect(numDifferentCounts == 0, std::string("the ") + getScoringKernelName(kernel) + " scoring kernel's ratings differ from the scalar one's for " + to_string(numDifferentCounts) + " counts");
+	}
+
+	return checker.finish("Scoring kernels against the scalar kernel");
+}
+
+//------------------------------------------------------------------------------
+
+// getArtistCharts against a fake source that takes longer the earlier the artist is in the list, so the charts come back in the
+// opposite order to the one they have to end up in; and that fails for one artist, and aborts partway through for another.
+t_size checkArtistCharts(const std::function<void (const std::string&)>& report, abort_callback& abort)
+{
+	static const t_size numArtists = 24;
+	static const t_size maxRequestsInFlight = 4;
+	static const t_size failingArtist = 5;
+
+	Checker checker(report);
+
+	std::vector<std::string> artists;
+	for(t_size index = 0; index < numArtists; ++index)
+	{
+		artists.push_back("Artist " + to_string(index + 1));
+	}
+
+	std::atomic<t_size> numRequests(0);
+	std::atomic<t_size> numInFlight(0);
+	std::atomic<t_size> maxInFlight(0);
+
+	// If abortAfter isn't null, the fake aborts it on the given artist's request.
+	const auto makeSource = [&](abort_callback_impl* abortAfter, const t_size abortingArtist)
+	{
+		return [&, abortAfter, abortingArtist](const std::string& artist, abort_callback& requestAbort)
+		{
+			const t_size index = static_cast<t_size>(std::find(artists.begin(), artists.end(), artist) - artists.begin());
+
+			++numRequests;
+			const t_size inFlight = ++numInFlight;
+
+			t_size max = maxInFlight;
+			while(inFlight > max && !maxInFlight.compare_exchange_weak(max, inFlight))
+			{
+			}
+
+			if(abortAfter != nullptr && index == abortingArtist)
+			{
+				abortAfter->abort();
+			}
+
+			try
+			{
+				requestAbort.sleep(0.002 * static_cast<double>(numArtists - index));
+			}
+			catch(...)
+			{
+				--numInFlight;
+				throw;
+			}
+
+			--numInFlight;
+
+			if(index == failingArtist)
+			{
+				throw pfc::exception("No such artist");
+			}
+
+			const ArtistChartEntry entry = { 1000, artist + " top track", std::string(), std::string() };
+			return ArtistChart(1, entry);
+		};
+	};
+
+	{
+		t_size numLogged = 0;
+		const std::vector<ArtistChart> charts = getArtistCharts(
+			artists,
+			maxRequestsInFlight,
+			makeSource(nullptr, 0),
+			[&](const std::string&) { ++numLogged; },
+			[](t_size) {},
+			abort
+		);
+
+		bool isInOrder = charts.size() == numArtists;
+		for(t_size index = 0; isInOrder && index < numArtists; ++index)
+		{
+			isInOrder = index == failingArtist ? charts[index].empty() : charts[index].size() == 1 && charts[index][0].track == artists[index] + " top track";
+		}
+
+		checker.expect(isInOrder, "each artist's chart is where the artist is in the list, however late it arrives");
+		checker.expect(numLogged == 1, "an artist that can't be fetched is logged and left empty, without spoiling the rest");
+		checker.expect(maxInFlight > 1 && maxInFlight <= maxRequestsInFlight, to_string(maxInFlight.load()) + " requests were in flight at once, rather than more than one and no more than " + to_string(maxRequestsInFlight));
+	}
+
+	{
+		abort_callback_impl jobAbort;
+		numRequests = 0;
+
+		bool aborted = false;
+
+		try
+		{
+			getArtistCharts(artists, maxRequestsInFlight, makeSource(&jobAbort, 2), [](const std::string&) {}, [](t_size) {}, jobAbort);
+		}
+		catch(const exception_aborted&)
+		{
+			aborted = true;
+		}
+
+		checker.expect(aborted, "aborting partway through is passed on to the caller");
+		checker.expect(numRequests < numArtists, "no more requests are started once it's been aborted; " + to_string(numRequests.load()) + " were");
+		checker.expect(numInFlight == 0, "every request has finished by the time it returns");
+	}
+
+	return checker.finish("getArtistCharts (fake last.fm with delays)");
+}
+
+//------------------------------------------------------------------------------
+
+// areTitlesSimilar against a set of pairs of titles labelled by hand as the same track or not, with the precision and recall that
+// come out of it, and the index against areTitlesSimilar. The different tracks are the hard cases: a letter or two apart, as typos are.
+t_size checkFuzzyMatching(const std::function<void (const std::string&)>& report)
+{
+	struct LabelledPair
+	{
+		const char* title;
+		const char* otherTitle;
+		bool sameTrack;
+	};
+
+	static const LabelledPair pairs[] =
+	{
+		// Typos, missing letters and spellings of the same title.
+		{ "Bohemian Rhapsody", "Bohemian Rapsody", true },
+		{ "Smells Like Teen Spirit", "Smells Like Teen Sprit", true },
+		{ "Stairway to Heaven", "Stairway To Heavan", true },
+		{ "Hotel California", "Hotel Califronia", true },
+		{ "Sweet Child o' Mine", "Sweet Child of Mine", true },
+		{ "Don't Stop Believin'", "Don't Stop Believing", true },
+		{ "Paint It Black", "Paint It Blak", true },
+		{ "Wish You Were Here", "Wish You Where Here", true },
+		{ "Comfortably Numb", "Comfortably Num", true },
+		{ "Gimme Shelter", "Gimmie Shelter", true },
+		{ "Yesterday", "Yesteday", true },
+		{ "Wonderwall", "Wonderwal", true },
+		{ "Livin' on a Prayer", "Living on a Prayer", true },
+		{ "Rockin' in the Free World", "Rocking in the Free World", true },
+		{ "Colour My World", "Color My World", true },
+		{ "Grey Day", "Gray Day", true },
+		{ "Everybody Wants to Rule the World", "Everybody Want to Rule the World", true },
+		{ "Under Pressure", "Under Presure", true },
+		{ "Another Brick in the Wall", "Another Brick In The Wal", true },
+		{ "November Rain", "Novemeber Rain", true },
+		{ "Nothing Else Matters", "Nothing Else Maters", true },
+		{ "Enter Sandman", "Enter Sandmann", true },
+		{ "Californication", "Californiacation", true },
+		{ "Losing My Religion", "Loosing My Religion", true },
+		{ "With or Without You", "With Or With Out You", true },
+		{ "Highway to Hell", "Highway To Hel", true },
+		{ "Purple Haze", "Purple Hase", true },
+		{ "Seven Nation Army", "Seven Nations Army", true },
+		{ "Thunderstruck", "Thunder Struck", true },
+		{ "Knockin' on Heaven's Door", "Knocking on Heavens Door", true },
+		{ "The Sound of Silence", "The Sounds of Silence", true },
+		{ "Born to Run", "Born To Runn", true },
+		{ "Tears in Heaven", "Tears In Heven", true },
+		{ "California Dreamin'", "California Dreaming", true },
+		{ "Psycho Killer", "Pyscho Killer", true },
+		{ "Rock 'n' Roll Star", "Rock and Roll Star", true },
+		{ "Mr. Brightside", "Mister Brightside", true },
+		{ "Hey Jude", "Hey Jud", true },
+		{ "Imagine", "Imagin", true },
+		{ "Respect", "Respekt", true },
+		{ "Layla", "Leyla", true },
+		{ "Africa", "Afrika", true },
+		{ "Jolene", "Jolen", true },
+
+		// Different tracks with titles a letter or two apart.
+		{ "Another Brick in the Wall, Part 1", "Another Brick in the Wall, Part 2", false },
+		{ "Symphony No. 5", "Symphony No. 6", false },
+		{ "1999", "1979", false },
+		{ "Track 10", "Track 11", false },
+		{ "Love Song", "Love Songs", false },
+		{ "Paranoid", "Paranoia", false },
+		{ "Yesterday", "Yesterdays", false },
+		{ "Girlfriend", "Girlfriends", false },
+		{ "Wild Horses", "Wild Horse", false },
+		{ "Photograph", "Photographs", false },
+		{ "Daydream", "Daydreams", false },
+		{ "Live Forever", "Love Forever", false },
+		{ "Heartbreaker", "Heartbreakers", false },
+		{ "Brown Eyed Girl", "Brown Eyed Girls", false },
+		{ "Hello", "Hallo", false },
+		{ "Help", "Hell", false },
+		{ "Angel", "Angels", false },
+		{ "Heroes", "Hero", false },
+		{ "Dreams", "Dream", false },
+		{ "Faith", "Fate", false },
+		{ "Roxanne", "Roxanna", false },
+		{ "Believe", "Relieve", false },
+		{ "Sunday", "Monday", false },
+		{ "Closer", "Closet", false },
+		{ "Breathe", "Breath", false },
+		{ "Starman", "Starmen", false },
+		{ "Money", "Honey", false },
+		{ "Wonderful", "Wonderwall", false },
+		{ "Space Oddity", "Space Odyssey", false },
+		{ "Let It Be", "Let It Bleed", false },
+		{ "Let It Go", "Let It Be", false },
+		{ "I Want You", "I Want It", false },
+		{ "Don't Look Back", "Don't Look Down", false },
+		{ "Stand By Me", "Stand By You", false },
+		{ "Come As You Are", "Come As You Were", false },
+		{ "Boys Don't Cry", "Big Boys Don't Cry", false },
+		{ "Mother", "Brother", false },
+		{ "Rain", "Pain", false },
+		{ "Hurt", "Hurts", false },
+		{ "Crazy", "Crazed", false },
+		{ "Highway Star", "Highway Stars", false },
+	};
+
+	Checker checker(report);
+
+	checker.expect(getAllowedEditDistance(7) == 0, "titles under 8 characters have to match exactly");
+	checker.expect(getAllowedEditDistance(8) == 1, "titles of 8 characters can be an edit apart");
+	checker.expect(getAllowedEditDistance(15) == 1, "titles under 16 characters can be no more than an edit apart");
+	checker.expect(getAllowedEditDistance(16) == 2, "titles of 16 characters can be two edits apart");
+
+	FuzzyTitleIndex index;
+	for(const auto& pair : pairs)
+	{
+		index.add(simplifyTitle(pair.title));
+		index.add(simplifyTitle(pair.otherTitle));
+	}
+
+	t_size numTruePositives = 0;
+	t_size numFalsePositives = 0;
+	t_size numFalseNegatives = 0;
+
+	for(const auto& pair : pairs)
+	{
+		const std::string title = simplifyTitle(pair.title);
+		const std::string otherTitle = simplifyTitle(pair.otherTitle);
+		const bool similar = areTitlesSimilar(title, otherTitle);
+
+		if(similar && pair.sameTrack)
+		{
+			++numTruePositives;
+		}
+		else if(similar)
+		{
+			++numFalsePositives;
+			report(std::string("Matched, but different tracks: \"") + pair.title + "\" and \"" + pair.otherTitle + "\"");
+		}
+		else if(pair.sameTrack)
+		{
+			++numFalseNegatives;
+			report(std::string("Not matched, but the same track: \"") + pair.title + "\" and \"" + pair.otherTitle + "\"");
+		}
+
+		std::vector<const std::string*> found;
+		index.findSimilar(title, found);
+		const bool indexFound = std::any_of(found.begin(), found.end(), [&](const std::string* foundTitle) { return *foundTitle == otherTitle; });
+
+		checker.expect(indexFound == similar, std::string("the index agrees with areTitlesSimilar on \"") + pair.title + "\" and \"" + pair.otherTitle + "\"");
+	}
+
+	const double precision = numTruePositives + numFalsePositives > 0 ? static_cast<double>(numTruePositives) / (numTruePositives + numFalsePositives) : 1.0;
+	const double recall = numTruePositives + numFalseNegatives > 0 ? static_cast<double>(numTruePositives) / (numTruePositives + numFalseNegatives) : 1.0;
+
+	report(
+		"Fuzzy title matching on " + to_string(sizeof(pairs) / sizeof(pairs[0])) + " labelled pairs: precision " + to_string(precision, 3) + ", recall " + to_string(recall, 3) +
+		" (" + to_string(numTruePositives) + " matched, " + to_string(numFalsePositives) + " matched wrongly, " + to_string(numFalseNegatives) + " missed)"
+	);
+
+	// Matching a different track picks the wrong version, which is worse than finding nothing, so precision matters more.
+	checker.expect(precision >= 0.9, "at least 90% of the pairs matched are the same track");
+	checker.expect(recall >= 0.75, "at least 75% of the pairs that are the same track are matched");
+
+	return checker.finish("Fuzzy title matching (labelled pairs)");
+}
+
+//------------------------------------------------------------------------------
+
+} // anonymous namespace
+
+namespace bestversion {
+
+//------------------------------------------------------------------------------
+
+t_size runChecks(
+	const SyntheticLibrarySettings& settings,
+	const std::function<void (const std::string&)>& report,
+	abort_callback& abort
+)
+{
+	t_size numFailed = 0;
+
+	numFailed += checkLastFmCache(report, abort);
+	numFailed += checkRatingTable(settings, report, abort);
+	numFailed += checkScoringKernels(report);
+	numFailed += checkArtistCharts(report, abort);
+	numFailed += checkFuzzyMatching(report);
+
+	return numFailed;
+}
+
+//------------------------------------------------------------------------------
+
+} // namespace bestversion
+
+#endif
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "FoobarSDKWrapper.h"
+
+#include "SyntheticLibrary.h"
+
+#include <functional>
+#include <string>
+
+#ifdef BESTVERSION_BENCHMARKS
+
+namespace bestversion {
+
+// Checks what can be checked without a real library or last.fm: against fakes, and against the synthetic library.
+// Reports a line for each group of checks and one for each check that fails, and returns the number that failed.
+// Only built when BESTVERSION_BENCHMARKS is defined; "Run Best Version benchmarks" runs them before the benchmarks.
+t_size runChecks(
+	const SyntheticLibrarySettings& settings,
+	const std::function<void (const std::string&)>& report,
+	abort_callback& abort
+);
+
+} // namespace bestversion
+
+#endif
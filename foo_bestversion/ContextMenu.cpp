@@ -2,11 +2,24 @@
 
 #include "FoobarSDKWrapper.h"
 
+#include "ArtistCharts.h"
 #include "BestVersion.h"
+#include "BestVersionIndex.h"
+#include "BestVersionMemo.h"
+#include "BestVersionSearch.h"
 #include "LastFm.h"
+#include "LibraryIndex.h"
+#include "Log.h"
+#include "ParallelFor.h"
 #include "PlaylistGenerator.h"
+#include "ToString.h"
+#include "Trace.h"
 
+#include <atomic>
+#include <chrono>
 #include <map>
+#include <memory>
+#include <vector>
 
 using namespace bestversion;
 
@@ -23,8 +36,8 @@ const contextmenu_group_popup_factory bestVersionContextMenuGroupFactory(bestVer
 //------------------------------------------------------------------------------
 
 void generateArtistPlaylist(const pfc::list_base_const_t<metadb_handle_ptr>& tracks);
+void generateEachArtistPlaylist(const pfc::list_base_const_t<metadb_handle_ptr>& tracks);
 void generateSimilarTracksPlaylist(const metadb_handle_ptr& track);
-metadb_handle_ptr bestVersionOf(const metadb_handle_ptr& track, const pfc::list_t<metadb_handle_ptr>& library);
 void replaceWithBestVersion(const pfc::list_base_const_t<metadb_handle_ptr>& tracks);
 
 //------------------------------------------------------------------------------
@@ -42,6 +55,7 @@ public:
 		{
 			GetArtistTopTracks = 0,
 			GetSimilarTracks = 1,
+			GetEachArtistTopTracks = 2,
 			MAX
 		};
 	};
@@ -78,6 +92,12 @@ public:
 				break;
 			}
 
+			case Items::GetEachArtistTopTracks:
+			{
+				out = "Get top tracks of each artist";
+				break;
+			}
+
 			default:
 			{
 				uBugCheck();
@@ -109,6 +129,12 @@ public:
 				break;
 			}
 
+			case Items::GetEachArtistTopTracks:
+			{
+				generateEachArtistPlaylist(tracks);
+				break;
+			}
+
 			default:
 			{
 				uBugCheck();
@@ -194,6 +220,9 @@ public:
 		// {B15EE137-81D2-4CAD-9411-5E9C6373A1DD}
 		static const GUID GetSimilarTracksGUID = { 0xb15ee137, 0x81d2, 0x4cad, { 0x94, 0x11, 0x5e, 0x9c, 0x63, 0x73, 0xa1, 0xdd } };
 
+		// {553EB3BD-A648-4304-80F4-59BBA3A818C2}
+		static const GUID GetEachArtistTopTracksGUID = { 0x553eb3bd, 0xa648, 0x4304, { 0x80, 0xf4, 0x59, 0xbb, 0xa3, 0xa8, 0x18, 0xc2 } };
+
 		switch(index)
 		{
 			case Items::GetArtistTopTracks:
@@ -206,6 +235,11 @@ public:
 				return GetSimilarTracksGUID;
 			}
 
+			case Items::GetEachArtistTopTracks:
+			{
+				return GetEachArtistTopTracksGUID;
+			}
+
 			default:
 			{
 				uBugCheck();
@@ -233,6 +267,12 @@ public:
 				return true;
 			}
 
+			case Items::GetEachArtistTopTracks:
+			{
+				out = "Generate a playlist containing last.fm's top tracks for every artist in the selection, mixed together.";
+				return true;
+			}
+
 			default:
 			{
 				uBugCheck();
@@ -408,64 +448,202 @@ class ArtistPlaylistGenerator : public threaded_process_callback
 {
 private:
 	std::string artist;
-	pfc::list_t<metadb_handle_ptr> library;
 	pfc::list_t<metadb_handle_ptr> tracks;
 	bool success;
+	JobTrace trace;
 
 public:
 	ArtistPlaylistGenerator(const std::string& artist_)
 		: artist(artist_)
 		, success(false)
+		, trace("Top tracks of " + artist_)
 	{
 	}
 
 	virtual void on_init(HWND /*p_wnd*/)
 	{
-		static_api_ptr_t<library_manager> lm;
-		lm->get_all_items(library);
+		trace.begin();
 	}
 
 	virtual void run(threaded_process_status& p_status, abort_callback& p_abort)
 	{
 		try
 		{
-			console::printf("Downloading chart listing from Last.Fm... for %s", artist.c_str());
+			std::shared_ptr<const LibrarySnapshot> library;
+
+			{
+				const TraceScope scope("Update library index");
+				library = getLibraryIndex().getBuiltSnapshot(p_abort);
+			}
 
 			p_status.set_item("Downloading chart listing from Last.Fm...");
 			p_status.set_progress_float(0.0f);
 
-			const bestversion::ArtistChart artistChart = bestversion::getArtistChart(
-				artist,
-				[](const std::string& message){ console::print(message.c_str()); },
-				p_abort
-			);
+			const bestversion::ArtistChart artistChart = bestversion::getArtistChart(artist, p_abort);
 
 			p_abort.check();
 			p_status.set_item("Searching library for best versions of tracks...");
 			p_status.set_progress_float(0.5f);
 
-			// Just look at one artist.
-			filterTracksByArtist(artist, library);
+			std::vector<TrackName> names;
+			for(const auto& artistChartEntry : artistChart)
+			{
+				const TrackName name = { artist, artistChartEntry.track, artistChartEntry.trackMBID, artistChartEntry.artistMBID };
+				names.push_back(name);
+			}
+
+			// Pick the best version of each track by this artist in one go, and add the ones found to the list in chart order.
+			// Tracks the library has MusicBrainz IDs for are found by ID; the rest are all by the same artist, so they're found in one pass.
+			std::vector<metadb_handle_ptr> bestVersions;
+			findBestVersions(
+				*library,
+				names,
+				bestVersions,
+				[&](t_size numDone, t_size total)
+				{
+					p_status.set_progress_secondary(numDone, total);
+				},
+				p_abort
+			);
 
-			for(size_t artistChartEntryIndex = 0; artistChartEntryIndex < artistChart.size(); ++artistChartEntryIndex)
+			for(const auto& track : bestVersions)
 			{
-				const auto& artistChartEntry = artistChart[artistChartEntryIndex];
+				if(track != nullptr)
+				{
+					tracks.add_item(track);
+				}
+			}
 
-				p_status.set_progress_secondary(artistChartEntryIndex, artistChart.size());
+			log(LogLevel::Info, "Found " + to_string(tracks.get_count()) + " of " + to_string(names.size()) + " of " + artist + "'s top tracks in the library");
 
-				// Copy the library then filter it to tracks with this title.
-				auto subsetOfLibrary = library;
-				filterTracksByCloseTitle(artistChartEntry.second, subsetOfLibrary);
+			if(tracks.get_count() == 0)
+			{
+				throw pfc::exception("Did not find enough tracks to make a playlist");
+			}
 
-				// Pick the best version of all these tracks and add it to the list if found.
-				metadb_handle_ptr track = getBestTrackByTitle(artistChartEntry.second, subsetOfLibrary);
+			success = true;
+			p_abort.check();
+		}
+		catch(exception_aborted&)
+		{
+			success = false;
+		}
+	}
 
-				if(track != nullptr)
+	virtual void on_done(HWND /*p_wnd*/, bool /*p_was_aborted*/)
+	{
+		flushLog();
+		logBestVersionMemoStats();
+
+		if (!success)
+		{
+			trace.end();
+			return;
+		}
+
+		{
+			const TraceScope scope("Make playlist");
+			generatePlaylistFromTracks(tracks, artist + "'s top tracks");
+		}
+
+		trace.end();
+	}
+};
+
+//------------------------------------------------------------------------------
+
+class EachArtistPlaylistGenerator : public threaded_process_callback
+{
+private:
+	// Enough to hide the latency of each request without hammering last.fm.
+	static const t_size maxRequestsInFlight = 4;
+
+	std::vector<std::string> artists;
+	pfc::list_t<metadb_handle_ptr> tracks;
+	bool success;
+	JobTrace trace;
+
+public:
+	EachArtistPlaylistGenerator(const std::vector<std::string>& artists_)
+		: artists(artists_)
+		, success(false)
+		, trace("Top tracks of " + to_string(artists_.size()) + " artists")
+	{
+	}
+
+	virtual void on_init(HWND /*p_wnd*/)
+	{
+		trace.begin();
+	}
+
+	virtual void run(threaded_process_status& p_status, abort_callback& p_abort)
+	{
+		try
+		{
+			std::shared_ptr<const LibrarySnapshot> library;
+
+			{
+				const TraceScope scope("Update library index");
+				library = getLibraryIndex().getBuiltSnapshot(p_abort);
+			}
+
+			p_status.set_item("Downloading chart listings from Last.Fm...");
+			p_status.set_progress_float(0.0f);
+
+			const auto charts = getArtistCharts(
+				artists,
+				maxRequestsInFlight,
+				[](const std::string& artist, abort_callback& abort)
+				{
+					return getArtistChart(artist, abort);
+				},
+				[](const std::string& message)
+				{
+					log(LogLevel::Warning, message);
+				},
+				[&](t_size numFetched)
+				{
+					p_status.set_progress_secondary(numFetched, artists.size());
+				},
+				p_abort
+			);
+
+			p_abort.check();
+			p_status.set_item("Searching library for best versions of tracks...");
+			p_status.set_progress_float(0.5f);
+
+			const MergedChart mergedChart = mergeArtistCharts(artists, charts);
+
+			std::vector<TrackName> names;
+			for(const auto& mergedChartEntry : mergedChart)
+			{
+				const TrackName name = { mergedChartEntry.artist, mergedChartEntry.title, mergedChartEntry.trackMBID, mergedChartEntry.artistMBID };
+				names.push_back(name);
+			}
+
+			std::vector<metadb_handle_ptr> bestVersions;
+			findBestVersions(
+				*library,
+				names,
+				bestVersions,
+				[&](t_size numDone, t_size total)
+				{
+					p_status.set_progress_secondary(numDone, total);
+				},
+				p_abort
+			);
+
+			for(const auto& track : bestVersions)
+			{
+				// A track by several of the artists could turn up more than once.
+				if(track != nullptr && tracks.find_item(track) == pfc_infinite)
 				{
 					tracks.add_item(track);
 				}
 			}
 
+			log(LogLevel::Info, "Found " + to_string(tracks.get_count()) + " of " + to_string(names.size()) + " top tracks of " + to_string(artists.size()) + " artists in the library");
+
 			if(tracks.get_count() == 0)
 			{
 				throw pfc::exception("Did not find enough tracks to make a playlist");
@@ -482,12 +660,21 @@ public:
 
 	virtual void on_done(HWND /*p_wnd*/, bool /*p_was_aborted*/)
 	{
+		flushLog();
+		logBestVersionMemoStats();
+
 		if (!success)
 		{
+			trace.end();
 			return;
 		}
 
-		generatePlaylistFromTracks(tracks, artist + "'s top tracks");
+		{
+			const TraceScope scope("Make playlist");
+			generatePlaylistFromTracks(tracks, "Top tracks of " + to_string(artists.size()) + " artists");
+		}
+
+		trace.end();
 	}
 };
 
@@ -498,65 +685,74 @@ class SimilarTracksPlaylistGenerator : public threaded_process_callback
 private:
 	std::string artist;
 	std::string track;
-	pfc::list_t<metadb_handle_ptr> library;
 	pfc::list_t<metadb_handle_ptr> tracks;
 	bool success;
+	JobTrace trace;
 
 public:
 	SimilarTracksPlaylistGenerator(const std::string& artist_, const std::string& track_)
 		: artist(artist_)
 		, track(track_)
 		, success(false)
+		, trace("Tracks similar to " + track_ + " by " + artist_)
 	{
 	}
 
 	virtual void on_init(HWND /*p_wnd*/)
 	{
-		static_api_ptr_t<library_manager> lm;
-		lm->get_all_items(library);
+		trace.begin();
 	}
 
 	virtual void run(threaded_process_status& p_status, abort_callback& p_abort)
 	{
 		try
 		{
-			console::printf("Downloading similar tracks feed from Last.Fm... for %s by %s", track.c_str(), artist.c_str());
+			std::shared_ptr<const LibrarySnapshot> library;
+
+			{
+				const TraceScope scope("Update library index");
+				library = getLibraryIndex().getBuiltSnapshot(p_abort);
+			}
 
 			p_status.set_item("Downloading feed from Last.Fm...");
 			p_status.set_progress_float(0.0f);
 
-			const auto similarTracks = bestversion::getTrackSimilarTracks(
-				artist,
-				track,
-				[](const std::string& message){ console::print(message.c_str()); },
-				p_abort
-			);
+			const auto similarTracks = bestversion::getTrackSimilarTracks(artist, track, p_abort);
 
 			p_abort.check();
 			p_status.set_item("Searching library for best versions of tracks...");
 			p_status.set_progress_float(0.5f);
 
-			for(size_t similarTrackIndex = 0; similarTrackIndex < similarTracks.size(); ++similarTrackIndex)
+			std::vector<TrackName> names;
+			for(const auto& similarTrack : similarTracks)
 			{
-				const auto& similarTrack = similarTracks[similarTrackIndex];
-
-				p_abort.check();
-				p_status.set_progress_secondary(similarTrackIndex, similarTracks.size());
-
-				// Copy the library then filter it to tracks with this title and artist.
-				auto subsetOfLibrary = library;
-				filterTracksByArtist(similarTrack.artist, subsetOfLibrary);
-				filterTracksByCloseTitle(similarTrack.track, subsetOfLibrary);
+				const TrackName name = { similarTrack.artist, similarTrack.track, similarTrack.trackMBID, similarTrack.artistMBID };
+				names.push_back(name);
+			}
 
-				// Pick the best version of all these tracks and add it to the list if found.
-				metadb_handle_ptr similarTrackInLibrary = getBestTrackByTitle(similarTrack.track, subsetOfLibrary);
+			// Pick the best version of each track, an artist at a time, and add the ones found to the list in the feed's order.
+			std::vector<metadb_handle_ptr> bestVersions;
+			findBestVersions(
+				*library,
+				names,
+				bestVersions,
+				[&](t_size numDone, t_size total)
+				{
+					p_status.set_progress_secondary(numDone, total);
+				},
+				p_abort
+			);
 
+			for(const auto& similarTrackInLibrary : bestVersions)
+			{
 				if(similarTrackInLibrary != nullptr)
 				{
 					tracks.add_item(similarTrackInLibrary);
 				}
 			}
 
+			log(LogLevel::Info, "Found " + to_string(tracks.get_count()) + " of " + to_string(names.size()) + " tracks similar to " + track + " in the library");
+
 			if(tracks.get_count() == 0)
 			{
 				throw pfc::exception("Did not find enough tracks to make a playlist");
@@ -573,12 +769,21 @@ public:
 
 	virtual void on_done(HWND /*p_wnd*/, bool /*p_was_aborted*/)
 	{
+		flushLog();
+		logBestVersionMemoStats();
+
 		if (!success)
 		{
+			trace.end();
 			return;
 		}
 
-		generatePlaylistFromTracks(tracks, "Tracks similar to " + track);
+		{
+			const TraceScope scope("Make playlist");
+			generatePlaylistFromTracks(tracks, "Tracks similar to " + track);
+		}
+
+		trace.end();
 	}
 };
 
@@ -587,41 +792,70 @@ public:
 class ReplaceWithBestVersionProcess : public threaded_process_callback
 {
 private:
-	pfc::list_t<metadb_handle_ptr> library;
 	pfc::list_t<metadb_handle_ptr> tracks;
 	pfc::list_t<metadb_handle_ptr> replacements;
+	std::vector<BestVersionLookup> lookups;
 	bool success;
+	JobTrace trace;
 
 public:
 	ReplaceWithBestVersionProcess(const pfc::list_base_const_t<metadb_handle_ptr>& tracks_)
 		: success(false)
+		, trace("Replace with best version of " + to_string(tracks_.get_count()) + " tracks")
 	{
 		// Take a copy of the input tracks list as it may be destroyed in another thread.
 		tracks = tracks_;
-		replacements.prealloc(tracks.get_size());
+		replacements.set_count(tracks.get_count());
+		lookups.resize(tracks.get_count());
 	}
 
 	virtual void on_init(HWND /*p_wnd*/)
 	{
-		static_api_ptr_t<library_manager> lm;
-		lm->get_all_items(library);
+		trace.begin();
 	}
 
 	virtual void run(threaded_process_status& p_status, abort_callback& p_abort)
 	{
 		try
 		{
-			for(t_size index = 0; index < tracks.get_count(); ++index)
+			std::shared_ptr<const LibrarySnapshot> library;
+
 			{
-				const auto& track = tracks[index];
-				p_abort.check();
-				p_status.set_item(getTitle(track).c_str());
-				p_status.set_progress(index, tracks.get_count());
+				const TraceScope scope("Update library index");
+				library = getLibraryIndex().getBuiltSnapshot(p_abort);
+			}
 
-				const auto& replacement = bestVersionOf(track, library);
+			p_status.set_item("Searching library for best versions of tracks...");
 
-				replacements.add_item(replacement);
-			}
+			// Each track is resolved independently, so spread them over all cores.
+			// Results go straight into their own slot so the order matches the input.
+			std::atomic<t_size> numResolved(0);
+
+			const TraceScope scope("Find best versions");
+
+			// A pick from a snapshot that's behind the library may not be the best any more, so only remember picks from an up to date one.
+			const bool isLibraryCurrent = library->getMemoGeneration() == getBestVersionMemo().getGeneration();
+
+			parallelFor(
+				tracks.get_count(),
+				getDefaultThreadCount(),
+				[&](t_size index)
+				{
+					replacements[index] = bestVersionOf(*library, tracks[index], lookups[index]);
+
+					if(isLibraryCurrent)
+					{
+						rememberBestVersion(lookups[index], replacements[index]);
+					}
+
+					++numResolved;
+				},
+				[&]()
+				{
+					p_status.set_progress(numResolved, tracks.get_count());
+				},
+				p_abort
+			);
 
 			success = true;
 			p_abort.check();
@@ -634,21 +868,40 @@ public:
 
 	virtual void on_done(HWND /*p_wnd*/, bool /*p_was_aborted*/)
 	{
+		flushLog();
+		logBestVersionMemoStats();
+
 		if (!success)
 		{
+			trace.end();
 			return;
 		}
 
-		static_api_ptr_t<playlist_manager> pm;
-		pm->activeplaylist_undo_backup();
+		const auto start = std::chrono::steady_clock::now();
+
+		t_size numReplaced = 0;
 
-		for(t_size index = 0; index < tracks.get_count(); ++index)
 		{
-			if(replacements[index] != nullptr)
+			const TraceScope scope("Replace playlist items");
+
+			// The snapshot may be a little behind the library; don't put in a track that's been taken out of it since.
+			static_api_ptr_t<library_manager> lm;
+
+			for(t_size index = 0; index < tracks.get_count(); ++index)
 			{
-				replaceTrackInActivePlaylist(tracks[index], replacements[index]);
+				if(replacements[index] != nullptr && !lm->is_item_in_library(replacements[index]))
+				{
+					replacements[index].release();
+				}
 			}
+
+			numReplaced = replaceTracksInActivePlaylist(tracks, replacements);
 		}
+
+		const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+		BESTVERSION_LOG(LogLevel::Debug, "Replaced " + to_string(numReplaced) + " playlist items in " + to_string(elapsed.count() / 1000.0, 3) + "ms");
+
+		trace.end();
 	}
 };
 
@@ -686,23 +939,29 @@ void generateArtistPlaylist(const pfc::list_base_const_t<metadb_handle_ptr>& tra
 
 //------------------------------------------------------------------------------
 
-void generateSimilarTracksPlaylist(const metadb_handle_ptr& track)
+void generateEachArtistPlaylist(const pfc::list_base_const_t<metadb_handle_ptr>& tracks)
 {
-	const auto artist = getArtist(track);
-	const auto trackTitle = getTitle(track);
+	const std::vector<std::string> artists = getArtists(tracks);
 
-	if(artist.empty() || trackTitle.empty())
+	if(artists.size() == 1)
 	{
-		console::printf("File has empty artist or track tag: %s", track->get_path());
+		// Nothing to merge; do it the usual way.
+		generateArtistPlaylist(tracks);
 		return;
 	}
 
-	const auto title = std::string("Generating similar tracks playlist for ") + trackTitle + " by " + artist;
+	if(artists.empty())
+	{
+		console::error("no Artist Information found");
+		return;
+	}
+
+	const auto title = "Generating top tracks playlist for " + to_string(artists.size()) + " artists";
 
 	console::print(title.c_str());
 
 	// New this up since it's going to live on another thread, which will delete it when it's ready.
-	auto generator = new service_impl_t<SimilarTracksPlaylistGenerator>(artist, trackTitle);
+	auto generator = new service_impl_t<EachArtistPlaylistGenerator>(artists);
 
 	static_api_ptr_t<threaded_process> tp;
 
@@ -717,7 +976,7 @@ void generateSimilarTracksPlaylist(const metadb_handle_ptr& track)
 
 //------------------------------------------------------------------------------
 
-metadb_handle_ptr bestVersionOf(const metadb_handle_ptr& track, const pfc::list_t<metadb_handle_ptr>& library)
+void generateSimilarTracksPlaylist(const metadb_handle_ptr& track)
 {
 	const auto artist = getArtist(track);
 	const auto trackTitle = getTitle(track);
@@ -725,21 +984,25 @@ metadb_handle_ptr bestVersionOf(const metadb_handle_ptr& track, const pfc::list_
 	if(artist.empty() || trackTitle.empty())
 	{
 		console::printf("File has empty artist or track tag: %s", track->get_path());
-		return metadb_handle_ptr();
+		return;
 	}
 
-	auto subsetOfLibrary = library;
-	filterTracksByArtist(artist, subsetOfLibrary);
-	filterTracksByCloseTitle(trackTitle, subsetOfLibrary);
+	const auto title = std::string("Generating similar tracks playlist for ") + trackTitle + " by " + artist;
 
-	const auto& bestVersionOfTrack = getBestTrackByTitle(trackTitle, subsetOfLibrary);
+	console::print(title.c_str());
 
-	if(bestVersionOfTrack == nullptr)
-	{
-		console::printf("Couldn't find a better version of %s", trackTitle.c_str());
-	}
+	// New this up since it's going to live on another thread, which will delete it when it's ready.
+	auto generator = new service_impl_t<SimilarTracksPlaylistGenerator>(artist, trackTitle);
+
+	static_api_ptr_t<threaded_process> tp;
 
-	return bestVersionOfTrack;
+	tp->run_modeless(
+		generator,
+		tp->flag_show_abort | tp->flag_show_item | tp->flag_show_progress_dual,
+		core_api::get_main_window(),
+		title.c_str(),
+		pfc_infinite
+	);
 }
 
 //------------------------------------------------------------------------------
@@ -0,0 +1,410 @@
+#include "DeadItemReviver.h"
+
+#include "BestVersion.h"
+#include "BestVersionMemo.h"
+#include "BestVersionSearch.h"
+#include "LibraryIndex.h"
+#include "Log.h"
+#include "ParallelFor.h"
+#include "PlaylistGenerator.h"
+#include "ToString.h"
+
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+namespace {
+
+using namespace bestversion;
+
+//------------------------------------------------------------------------------
+
+// Checking whether a file is there is mostly waiting on the disk or the network, so it's worth more threads than there are cores.
+const t_size numExistenceCheckThreads = 16;
+
+//------------------------------------------------------------------------------
+
+bool isLocalFile(const char* path)
+{
+	return strncmp(path, "file://", 7) == 0;
+}
+
+//------------------------------------------------------------------------------
+
+bool doesPathExist(const char* path, abort_callback& abort)
+{
+	try
+	{
+		return filesystem::g_exists(path, abort);
+	}
+	catch(exception_aborted&)
+	{
+		throw;
+	}
+	catch(std::exception&)
+	{
+		// An unreachable share is as good as missing.
+		return false;
+	}
+}
+
+//------------------------------------------------------------------------------
+
+class ReviveDeadItemsProcess : public threaded_process_callback
+{
+private:
+	std::vector<metadb_handle_list> playlists;	// What was in each playlist when the job started.
+	metadb_handle_list tracks;					// Every distinct track in them.
+	std::unordered_map<const metadb_handle*, t_size> trackIndices;
+	pfc::list_t<metadb_handle_ptr> replacements;	// By track index; null for tracks that aren't dead or couldn't be revived.
+	t_size numDeadTracks;
+	bool success;
+
+public:
+	ReviveDeadItemsProcess()
+		: numDeadTracks(0)
+		, success(false)
+	{
+	}
+
+	virtual void on_init(HWND /*p_wnd*/)
+	{
+		static_api_ptr_t<playlist_manager> pm;
+		playlists.resize(pm->get_playlist_count());
+
+		for(t_size playlist = 0; playlist < playlists.size(); ++playlist)
+		{
+			pm->playlist_get_all_items(playlist, playlists[playlist]);
+
+			for(t_size index = 0; index < playlists[playlist].get_count(); ++index)
+			{
+				const metadb_handle_ptr& track = playlists[playlist][index];
+
+				if(trackIndices.emplace(track.get_ptr(), tracks.get_count()).second)
+				{
+					tracks.add_item(track);
+				}
+			}
+		}
+
+		replacements.set_count(tracks.get_count());
+	}
+
+	virtual void run(threaded_process_status& p_status, abort_callback& p_abort)
+	{
+		try
+		{
+			const std::shared_ptr<const LibrarySnapshot> library = getLibraryIndex().getBuiltSnapshot(p_abort);
+
+			p_status.set_item("Looking for dead items...");
+			p_status.set_progress_float(0.0f);
+
+			std::vector<bool> isDead;
+			findDeadTracks(tracks, isDead, p_abort);
+
+			std::vector<t_size> deadTracks;
+			for(t_size index = 0; index < tracks.get_count(); ++index)
+			{
+				if(isDead[index])
+				{
+					deadTracks.push_back(index);
+				}
+			}
+
+			numDeadTracks = deadTracks.size();
+
+			p_abort.check();
+			p_status.set_item("Searching library for best versions of dead items...");
+			p_status.set_progress_float(0.25f);
+
+			std::vector<std::string> titles(deadTracks.size());
+			std::vector<pfc::list_t<metadb_handle_ptr>> candidates(deadTracks.size());
+			std::atomic<t_size> numSearched(0);
+
+			parallelFor(
+				deadTracks.size(),
+				getDefaultThreadCount(),
+				[&](t_size deadIndex)
+				{
+					const metadb_handle_ptr& track = tracks[deadTracks[deadIndex]];
+
+					const auto artist = getArtist(track);
+					titles[deadIndex] = getTitle(track);
+
+					if(!artist.empty() && !titles[deadIndex].empty())
+					{
+						findCandidates(*library, artist, titles[deadIndex], candidates[deadIndex]);
+					}
+
+					++numSearched;
+				},
+				[&]()
+				{
+					p_status.set_progress_secondary(numSearched, deadTracks.size());
+				},
+				p_abort
+			);
+
+			// The library still has the files that have gone, until it notices, and after a share's moved that's all of them.
+			// So check every candidate is there before rating them, rather than rating them first and finding the best one's gone too.
+			p_abort.check();
+			p_status.set_item("Checking the library's versions of dead items are there...");
+			p_status.set_progress_float(0.5f);
+
+			metadb_handle_list candidatesToCheck;
+			std::unordered_map<const metadb_handle*, t_size> candidateIndices;
+
+			for(const auto& trackCandidates : candidates)
+			{
+				for(t_size index = 0; index < trackCandidates.get_count(); ++index)
+				{
+					if(candidateIndices.emplace(trackCandidates[index].get_ptr(), candidatesToCheck.get_count()).second)
+					{
+						candidatesToCheck.add_item(trackCandidates[index]);
+					}
+				}
+			}
+
+			std::vector<bool> isCandidateDead;
+			findDeadTracks(candidatesToCheck, isCandidateDead, p_abort);
+
+			p_status.set_item("Rating the library's versions of dead items...");
+			p_status.set_progress_float(0.75f);
+
+			std::atomic<t_size> numRated(0);
+
+			// Not through findBestVersion and the memo: it would hand back what it picked before from every version, dead or not.
+			parallelFor(
+				deadTracks.size(),
+				getDefaultThreadCount(),
+				[&](t_size deadIndex)
+				{
+					pfc::list_t<metadb_handle_ptr>& trackCandidates = candidates[deadIndex];
+
+					for(t_size index = trackCandidates.get_count(); index-- > 0; )
+					{
+						if(isCandidateDead[candidateIndices.at(trackCandidates[index].get_ptr())])
+						{
+							trackCandidates.remove_by_idx(index);
+						}
+					}
+
+					if(trackCandidates.get_count() > 0)
+					{
+						replacements[deadTracks[deadIndex]] = pickBestVersion(*library, titles[deadIndex], trackCandidates);
+					}
+
+					++numRated;
+				},
+				[&]()
+				{
+					p_status.set_progress_secondary(numRated, deadTracks.size());
+				},
+				p_abort
+			);
+
+			success = true;
+			p_abort.check();
+		}
+		catch(exception_aborted&)
+		{
+			success = false;
+		}
+	}
+
+	virtual void on_done(HWND /*p_wnd*/, bool /*p_was_aborted*/)
+	{
+		flushLog();
+		logBestVersionMemoStats();
+
+		if(!success)
+		{
+			return;
+		}
+
+		static_api_ptr_t<playlist_manager> pm;
+
+		t_size numRevived = 0;
+		t_size numPlaylistsChanged = 0;
+
+		// Playlists may have been added, removed or reordered while the job ran; replacePlaylistItems leaves anything that's not where it was alone.
+		for(t_size playlist = 0; playlist < playlists.size() && playlist < pm->get_playlist_count(); ++playlist)
+		{
+			const metadb_handle_list& items = playlists[playlist];
+
+			metadb_handle_list itemReplacements;
+			itemReplacements.set_count(items.get_count());
+
+			bool hasReplacements = false;
+
+			for(t_size index = 0; index < items.get_count(); ++index)
+			{
+				itemReplacements[index] = replacements[trackIndices[items[index].get_ptr()]];
+				hasReplacements = hasReplacements || itemReplacements[index] != nullptr;
+			}
+
+			if(!hasReplacements)
+			{
+				continue;
+			}
+
+			const t_size numReplaced = replacePlaylistItems(playlist, items, itemReplacements);
+
+			numRevived += numReplaced;
+			numPlaylistsChanged += numReplaced > 0 ? 1 : 0;
+		}
+
+		console::print((
+			"Found " + to_string(numDeadTracks) + " dead tracks; revived " + to_string(numRevived) + " playlist items in " +
+			to_string(numPlaylistsChanged) + " playlists"
+		).c_str());
+	}
+};
+
+//------------------------------------------------------------------------------
+
+class ReviveDeadItemsMenuCommands : public mainmenu_commands
+{
+public:
+	virtual t_uint32 get_command_count()
+	{
+		return 1;
+	}
+
+	virtual GUID get_command(t_uint32 /*p_index*/)
+	{
+		// {A49E328C-CF6B-4C3B-89BA-F5043341DF39}
+		static const GUID reviveDeadItemsGUID = { 0xa49e328c, 0xcf6b, 0x4c3b, { 0x89, 0xba, 0xf5, 0x04, 0x33, 0x41, 0xdf, 0x39 } };
+		return reviveDeadItemsGUID;
+	}
+
+	virtual void get_name(t_uint32 /*p_index*/, pfc::string_base& p_out)
+	{
+		p_out = "Revive dead items in all playlists";
+	}
+
+	virtual bool get_description(t_uint32 /*p_index*/, pfc::string_base& p_out)
+	{
+		p_out = "Replaces every playlist item whose file is missing with the best version of the track from the library.";
+		return true;
+	}
+
+	virtual GUID get_parent()
+	{
+		return mainmenu_groups::library;
+	}
+
+	virtual void execute(t_uint32 /*p_index*/, service_ptr_t<service_base> /*p_callback*/)
+	{
+		reviveDeadItemsInAllPlaylists();
+	}
+};
+
+static mainmenu_commands_factory_t<ReviveDeadItemsMenuCommands> reviveDeadItemsMenuCommandsFactory;
+
+//------------------------------------------------------------------------------
+
+} // anonymous namespace
+
+namespace bestversion {
+
+//------------------------------------------------------------------------------
+
+void findDeadTracks(metadb_handle_list_cref tracks, std::vector<bool>& isDead, abort_callback& abort)
+{
+	static const t_size notChecked = pfc_infinite;
+
+	std::unordered_map<std::string, t_size> directoryIndices;
+	std::vector<std::string> directories;
+	std::vector<t_size> trackDirectories(tracks.get_count(), notChecked);
+
+	for(t_size index = 0; index < tracks.get_count(); ++index)
+	{
+		const char* path = tracks[index]->get_path();
+		if(!isLocalFile(path))
+		{
+			continue;
+		}
+
+		const std::string directory = pfc::string_directory(path).get_ptr();
+
+		const auto directoryIndex = directoryIndices.emplace(directory, directories.size());
+		if(directoryIndex.second)
+		{
+			directories.push_back(directory);
+		}
+
+		trackDirectories[index] = directoryIndex.first->second;
+	}
+
+	// Not vector<bool>, as its elements can't be written from different threads.
+	std::vector<char> directoryExists(directories.size(), 0);
+
+	parallelFor(
+		directories.size(),
+		numExistenceCheckThreads,
+		[&](t_size index)
+		{
+			directoryExists[index] = doesPathExist(directories[index].c_str(), abort);
+		},
+		[]()
+		{
+		},
+		abort
+	);
+
+	abort.check();
+
+	std::vector<char> trackIsDead(tracks.get_count(), 0);
+
+	parallelFor(
+		tracks.get_count(),
+		numExistenceCheckThreads,
+		[&](t_size index)
+		{
+			const t_size directory = trackDirectories[index];
+			if(directory == notChecked)
+			{
+				return;
+			}
+
+			trackIsDead[index] = !directoryExists[directory] || !doesPathExist(tracks[index]->get_path(), abort);
+		},
+		[]()
+		{
+		},
+		abort
+	);
+
+	abort.check();
+
+	isDead.assign(trackIsDead.begin(), trackIsDead.end());
+}
+
+//------------------------------------------------------------------------------
+
+void reviveDeadItemsInAllPlaylists()
+{
+	const auto title = std::string("Reviving dead items in all playlists");
+
+	console::print(title.c_str());
+
+	// New this up since it's going to live on another thread, which will delete it when it's ready.
+	auto process = new service_impl_t<ReviveDeadItemsProcess>();
+
+	static_api_ptr_t<threaded_process> tp;
+
+	tp->run_modeless(
+		process,
+		tp->flag_show_abort | tp->flag_show_item | tp->flag_show_progress_dual,
+		core_api::get_main_window(),
+		title.c_str(),
+		pfc_infinite
+	);
+}
+
+//------------------------------------------------------------------------------
+
+} // namespace bestversion
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "FoobarSDKWrapper.h"
+
+#include <vector>
+
+namespace bestversion {
+
+// Works out which of the tracks' files are missing; isDead[i] is true if tracks[i]'s is.
+// Only local files are checked. Each directory is checked once, and the files in it only if it's there,
+// so a whole folder that's been moved costs one check rather than one per track.
+void findDeadTracks(metadb_handle_list_cref tracks, std::vector<bool>& isDead, abort_callback& abort);
+
+// Replaces every item in every playlist whose file is missing with the best version of it in the library, like foo_playlist_revive.
+// Runs as a background job; each playlist gets one undo point and one bulk replace.
+void reviveDeadItemsInAllPlaylists();
+
+} // namespace bestversion
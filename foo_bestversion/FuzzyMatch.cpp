@@ -0,0 +1,452 @@
+#include "FuzzyMatch.h"
+
+#include <algorithm>
+
+namespace {
+
+//------------------------------------------------------------------------------
+
+std::vector<unsigned> decodeUtf8(const std::string& str)
+{
+	std::vector<unsigned> codePoints;
+	codePoints.reserve(str.size());
+
+	const char* ptr = str.c_str();
+	for(;;)
+	{
+		unsigned c = 0;
+		const t_size length = pfc::utf8_decode_char(ptr, c);
+		if(length == 0)
+		{
+			break;
+		}
+
+		codePoints.push_back(c);
+		ptr += length;
+	}
+
+	return codePoints;
+}
+
+//------------------------------------------------------------------------------
+
+// The distinct trigrams of a string, three 21-bit code points to a key, sorted.
+std::vector<t_uint64> getTrigrams(const std::vector<unsigned>& codePoints)
+{
+	std::vector<t_uint64> trigrams;
+
+	if(codePoints.size() < 3)
+	{
+		return trigrams;
+	}
+
+	trigrams.reserve(codePoints.size() - 2);
+
+	for(size_t index = 0; index + 2 < codePoints.size(); ++index)
+	{
+		const t_uint64 trigram =
+			(static_cast<t_uint64>(codePoints[index] & 0x1FFFFF) << 42) |
+			(static_cast<t_uint64>(codePoints[index + 1] & 0x1FFFFF) << 21) |
+			static_cast<t_uint64>(codePoints[index + 2] & 0x1FFFFF);
+
+		trigrams.push_back(trigram);
+	}
+
+	std::sort(trigrams.begin(), trigrams.end());
+	trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+
+	return trigrams;
+}
+
+//------------------------------------------------------------------------------
+
+std::string getDigits(const std::string& str)
+{
+	std::string digits;
+
+	for(const char c : str)
+	{
+		if(c >= '0' && c <= '9')
+		{
+			digits += c;
+		}
+	}
+
+	return digits;
+}
+
+//------------------------------------------------------------------------------
+
+// Whether one string is the other with an "s" on the end.
+bool differOnlyByFinalS(const std::string& lhs, const std::string& rhs)
+{
+	const std::string& shorter = lhs.size() < rhs.size() ? lhs : rhs;
+	const std::string& longer = lhs.size() < rhs.size() ? rhs : lhs;
+
+	return longer.size() == shorter.size() + 1 && longer.back() == 's' && longer.compare(0, shorter.size(), shorter) == 0;
+}
+
+//------------------------------------------------------------------------------
+
+// Myers' bit-vector algorithm, as set out by Hyyrö for the distance between whole strings.
+// The pattern has to fit in one 64-bit word; each column of the DP matrix is worked out in a handful of word operations.
+t_size getEditDistanceMyers(const std::vector<unsigned>& pattern, const std::vector<unsigned>& text, const t_size maxDistance)
+{
+	const t_size patternLength = pattern.size();
+	const t_size textLength = text.size();
+
+	// Positions in the pattern where each character appears, as bits.
+	t_uint64 asciiMatches[128] = {};
+	std::vector<std::pair<unsigned, t_uint64>> otherMatches;
+
+	for(t_size index = 0; index < patternLength; ++index)
+	{
+		const unsigned c = pattern[index];
+		const t_uint64 bit = 1ull << index;
+
+		if(c < 128)
+		{
+			asciiMatches[c] |= bit;
+			continue;
+		}
+
+		auto matchIter = std::find_if(otherMatches.begin(), otherMatches.end(), [c](const std::pair<unsigned, t_uint64>& match) { return match.first == c; });
+		if(matchIter != otherMatches.end())
+		{
+			matchIter->second |= bit;
+		}
+		else
+		{
+			otherMatches.push_back(std::make_pair(c, bit));
+		}
+	}
+
+	const t_uint64 lastBit = 1ull << (patternLength - 1);
+
+	t_uint64 verticalPositive = patternLength == 64 ? ~0ull : (1ull << patternLength) - 1;
+	t_uint64 verticalNegative = 0;
+	t_size distance = patternLength;
+
+	for(t_size column = 0; column < textLength; ++column)
+	{
+		const unsigned c = text[column];
+
+		t_uint64 matches = 0;
+		if(c < 128)
+		{
+			matches = asciiMatches[c];
+		}
+		else
+		{
+			for(const auto& match : otherMatches)
+			{
+				if(match.first == c)
+				{
+					matches = match.second;
+					break;
+				}
+			}
+		}
+
+		const t_uint64 verticalChanges = matches | verticalNegative;
+		const t_uint64 horizontalChanges = (((matches & verticalPositive) + verticalPositive) ^ verticalPositive) | matches;
+		t_uint64 horizontalPositive = verticalNegative | ~(horizontalChanges | verticalPositive);
+		t_uint64 horizontalNegative = verticalPositive & horizontalChanges;
+
+		if(horizontalPositive & lastBit)
+		{
+			++distance;
+		}
+		else if(horizontalNegative & lastBit)
+		{
+			--distance;
+		}
+
+		// The top row of the matrix goes up by one every column, as the whole of the text so far has to be inserted.
+		horizontalPositive = (horizontalPositive << 1) | 1;
+		horizontalNegative <<= 1;
+
+		verticalPositive = horizontalNegative | ~(verticalChanges | horizontalPositive);
+		verticalNegative = horizontalPositive & verticalChanges;
+
+		// The distance can only come down by one per column from here on.
+		const t_size columnsLeft = textLength - column - 1;
+		if(distance > maxDistance + columnsLeft)
+		{
+			return maxDistance + 1;
+		}
+	}
+
+	return std::min(distance, maxDistance + 1);
+}
+
+//------------------------------------------------------------------------------
+
+// The plain dynamic programming version, for patterns too long for one word. Titles that long are rare.
+t_size getEditDistanceDP(const std::vector<unsigned>& pattern, const std::vector<unsigned>& text, const t_size maxDistance)
+{
+	std::vector<t_size> previousRow(text.size() + 1);
+	std::vector<t_size> row(text.size() + 1);
+
+	for(t_size column = 0; column <= text.size(); ++column)
+	{
+		previousRow[column] = column;
+	}
+
+	for(t_size patternIndex = 0; patternIndex < pattern.size(); ++patternIndex)
+	{
+		row[0] = patternIndex + 1;
+		t_size rowMinimum = row[0];
+
+		for(t_size column = 1; column <= text.size(); ++column)
+		{
+			const t_size substitution = previousRow[column - 1] + (pattern[patternIndex] == text[column - 1] ? 0 : 1);
+			row[column] = std::min(std::min(previousRow[column], row[column - 1]) + 1, substitution);
+			rowMinimum = std::min(rowMinimum, row[column]);
+		}
+
+		if(rowMinimum > maxDistance)
+		{
+			return maxDistance + 1;
+		}
+
+		std::swap(row, previousRow);
+	}
+
+	return std::min(previousRow[text.size()], maxDistance + 1);
+}
+
+//------------------------------------------------------------------------------
+
+t_size getEditDistance(const std::vector<unsigned>& lhs, const std::vector<unsigned>& rhs, const t_size maxDistance)
+{
+	// The shorter one is the pattern, so it's more likely to fit in a word.
+	const auto& pattern = lhs.size() <= rhs.size() ? lhs : rhs;
+	const auto& text = lhs.size() <= rhs.size() ? rhs : lhs;
+
+	if(text.size() - pattern.size() > maxDistance)
+	{
+		return maxDistance + 1;
+	}
+
+	if(pattern.empty())
+	{
+		return text.size();
+	}
+
+	if(pattern.size() <= 64)
+	{
+		return getEditDistanceMyers(pattern, text, maxDistance);
+	}
+
+	return getEditDistanceDP(pattern, text, maxDistance);
+}
+
+//------------------------------------------------------------------------------
+
+bool areTitlesSimilar(const std::string& lhs, const std::vector<unsigned>& lhsCodePoints, const std::string& rhs, const std::vector<unsigned>& rhsCodePoints)
+{
+	if(lhs == rhs)
+	{
+		return true;
+	}
+
+	const t_size allowedDistance = bestversion::getAllowedEditDistance(std::min(lhsCodePoints.size(), rhsCodePoints.size()));
+
+	// A title with an "s" on the end is far more often another track, like "Love Songs" or "Yesterdays", than a typo.
+	if(allowedDistance == 0 || getDigits(lhs) != getDigits(rhs) || differOnlyByFinalS(lhs, rhs))
+	{
+		return false;
+	}
+
+	return getEditDistance(lhsCodePoints, rhsCodePoints, allowedDistance) <= allowedDistance;
+}
+
+//------------------------------------------------------------------------------
+
+} // anonymous namespace
+
+namespace bestversion {
+
+//------------------------------------------------------------------------------
+
+t_size getEditDistance(const std::string& lhs, const std::string& rhs, const t_size maxDistance)
+{
+	return ::getEditDistance(decodeUtf8(lhs), decodeUtf8(rhs), maxDistance);
+}
+
+//------------------------------------------------------------------------------
+
+t_size getAllowedEditDistance(const t_size length)
+{
+	if(length < 8)
+	{
+		return 0;
+	}
+
+	if(length < 16)
+	{
+		return 1;
+	}
+
+	return 2;
+}
+
+//------------------------------------------------------------------------------
+
+bool areTitlesSimilar(const std::string& lhs, const std::string& rhs)
+{
+	if(lhs == rhs)
+	{
+		return true;
+	}
+
+	return ::areTitlesSimilar(lhs, decodeUtf8(lhs), rhs, decodeUtf8(rhs));
+}
+
+//------------------------------------------------------------------------------
+
+void FuzzyTitleIndex::add(const std::string& title)
+{
+	if(slotsByTitle.find(title) != slotsByTitle.end())
+	{
+		return;
+	}
+
+	t_uint32 slot = 0;
+
+	if(!freeSlots.empty())
+	{
+		slot = freeSlots.back();
+		freeSlots.pop_back();
+		titles[slot] = title;
+	}
+	else
+	{
+		slot = static_cast<t_uint32>(titles.size());
+		titles.push_back(title);
+	}
+
+	slotsByTitle[title] = slot;
+
+	for(const t_uint64 trigram : getTrigrams(decodeUtf8(title)))
+	{
+		slotsByTrigram[trigram].push_back(slot);
+	}
+}
+
+//------------------------------------------------------------------------------
+
+void FuzzyTitleIndex::remove(const std::string& title)
+{
+	const auto slotIter = slotsByTitle.find(title);
+	if(slotIter == slotsByTitle.end())
+	{
+		return;
+	}
+
+	const t_uint32 slot = slotIter->second;
+
+	for(const t_uint64 trigram : getTrigrams(decodeUtf8(title)))
+	{
+		const auto trigramIter = slotsByTrigram.find(trigram);
+		if(trigramIter == slotsByTrigram.end())
+		{
+			continue;
+		}
+
+		auto& slots = trigramIter->second;
+		slots.erase(std::remove(slots.begin(), slots.end(), slot), slots.end());
+
+		if(slots.empty())
+		{
+			slotsByTrigram.erase(trigramIter);
+		}
+	}
+
+	titles[slot].clear();
+	freeSlots.push_back(slot);
+	slotsByTitle.erase(slotIter);
+}
+
+//------------------------------------------------------------------------------
+
+void FuzzyTitleIndex::findSimilar(const std::string& title, std::vector<const std::string*>& out) const
+{
+	const auto codePoints = decodeUtf8(title);
+
+	// No other title can be further away than this, whatever its length.
+	const t_size maxAllowedDistance = getAllowedEditDistance(codePoints.size());
+
+	if(maxAllowedDistance == 0)
+	{
+		const auto slotIter = slotsByTitle.find(title);
+		if(slotIter != slotsByTitle.end())
+		{
+			out.push_back(&titles[slotIter->second]);
+		}
+		return;
+	}
+
+	std::vector<t_uint32> similarSlots;
+
+	const auto compare = [&](const t_uint32 slot)
+	{
+		const std::string& candidate = titles[slot];
+		if(!candidate.empty() && ::areTitlesSimilar(title, codePoints, candidate, decodeUtf8(candidate)))
+		{
+			similarSlots.push_back(slot);
+		}
+	};
+
+	// Each edit can only spoil three trigrams, so anything close enough has to share at least this many with the title.
+	const auto trigrams = getTrigrams(codePoints);
+	const t_size numTrigramsSpoilt = maxAllowedDistance * 3;
+
+	if(trigrams.size() <= numTrigramsSpoilt)
+	{
+		// Too short for the trigrams to rule anything out.
+		for(t_uint32 slot = 0; slot < titles.size(); ++slot)
+		{
+			compare(slot);
+		}
+	}
+	else
+	{
+		const t_size minSharedTrigrams = trigrams.size() - numTrigramsSpoilt;
+
+		std::unordered_map<t_uint32, t_size> sharedTrigramsBySlot;
+
+		for(const t_uint64 trigram : trigrams)
+		{
+			const auto trigramIter = slotsByTrigram.find(trigram);
+			if(trigramIter != slotsByTrigram.end())
+			{
+				for(const t_uint32 slot : trigramIter->second)
+				{
+					++sharedTrigramsBySlot[slot];
+				}
+			}
+		}
+
+		for(const auto& sharedTrigrams : sharedTrigramsBySlot)
+		{
+			if(sharedTrigrams.second >= minSharedTrigrams)
+			{
+				compare(sharedTrigrams.first);
+			}
+		}
+
+		// Hash map order isn't stable; keep the results the same from one run to the next.
+		std::sort(similarSlots.begin(), similarSlots.end());
+	}
+
+	for(const t_uint32 slot : similarSlots)
+	{
+		out.push_back(&titles[slot]);
+	}
+}
+
+//------------------------------------------------------------------------------
+
+} // namespace bestversion
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "FoobarSDKWrapper.h"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace bestversion {
+
+// The Levenshtein distance between two UTF-8 strings, counted in characters, if it's no more than maxDistance; maxDistance + 1 if it's more.
+// Bit-parallel (Myers' algorithm), and gives up as soon as the distance can't come back under the limit.
+t_size getEditDistance(const std::string& lhs, const std::string& rhs, t_size maxDistance);
+
+// How many edits two titles of the given length (in characters) can be apart and still count as the same.
+// Short titles have to match exactly; one letter is all the difference between plenty of short titles.
+t_size getAllowedEditDistance(t_size length);
+
+// Whether two titles, already normalised with simplifyTitle, are close enough to be versions of the same track,
+// e.g. with a typo or a missing letter. The numbers in them have to be exactly the same, so "Part 1" is never "Part 2",
+// and a title with an "s" on the end is never the same as it without, so "Love Songs" is never "Love Song".
+bool areTitlesSimilar(const std::string& lhs, const std::string& rhs);
+
+// A set of normalised titles that can be searched for the ones similar to a title, as areTitlesSimilar would say.
+// Titles are indexed by their trigrams so that only titles sharing enough of them with the one searched for have to be compared.
+class FuzzyTitleIndex
+{
+public:
+	void add(const std::string& title);
+	void remove(const std::string& title);
+
+	// Appends every title in the set that's similar to the given one, including the title itself if it's there.
+	void findSimilar(const std::string& title, std::vector<const std::string*>& out) const;
+
+private:
+	std::vector<std::string> titles;	// By slot; empty slots are free.
+	std::vector<t_uint32> freeSlots;
+	std::unordered_map<std::string, t_uint32> slotsByTitle;
+	std::unordered_map<t_uint64, std::vector<t_uint32>> slotsByTrigram;
+};
+
+} // namespace bestversion
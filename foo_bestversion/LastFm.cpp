@@ -2,16 +2,22 @@
 
 #include "RapidJsonWrapper.h"
 
-#include "Component.h"
 #include "FoobarSDKWrapper.h"
+#include "LastFmCache.h"
+#include "Log.h"
 #include "ToString.h"
+#include "Trace.h"
 
+#include <functional>
 #include <string>
 
 namespace {
 
 const std::string apiKey = "6fcd59047568e89b1615975081258990";
 
+// How many tracks to ask for in each list.
+const size_t trackListLimit = 100;
+
 char to_hex(const char c)
 {
 	return c < 0xa ? '0' + c : 'a' - 0xa + c;
@@ -43,220 +49,474 @@ std::string url_encode(const std::string& in)
 	return out;
 }
 
-}
-
-namespace bestversion {
-
-ArtistChart getArtistChart(const std::string& artist, const std::function<void (const std::string&)>& log, foobar2000_io::abort_callback& callback)
+// Returns the body of the response to the given API call, from the cache if possible.
+std::string callLastFm(const std::string& method, const bestversion::LastFmParameters& parameters, foobar2000_io::abort_callback& callback)
 {
-	ArtistChart artistChart;
-
-	const size_t limit = 100;
-
-	const std::string uri = std::string("http://ws.audioscrobbler.com/2.0?format=json")
+	std::string uri = std::string("http://ws.audioscrobbler.com/2.0?format=json")
 		+ "&api_key=" + apiKey
-		+ "&method=artist.getTopTracks"
-		+ "&limit=" + to_string(limit)
-		+ "&artist=" + url_encode(artist);
+		+ "&method=" + method;
 
-	log("Creating client");
-
-	static_api_ptr_t<http_client> http;
+	for(const auto& parameter : parameters)
+	{
+		uri += "&" + parameter.first + "=" + url_encode(parameter.second);
+	}
 
-	auto request = http->create_request("GET");
-	request->add_header("User-Agent", COMPONENT_NAME "/" COMPONENT_VERSION);
+	BESTVERSION_LOG_DEBUG("Fetching " + method);
 
-	auto response = request->run_ex(uri.c_str(), callback);
+	const bestversion::TraceScope scope("Fetch from last.fm");
 
-	pfc::string8 buffer;
-	response->read_string_raw(buffer, callback);
+	const std::string body = bestversion::getLastFmCache().get(uri, method, parameters, bestversion::getLastFmCacheSettings(), callback);
 
-	if(buffer.is_empty())
+	if(body.empty())
 	{
 		throw std::exception("No content returned from last.fm. Perhaps last.fm is currently down?");
 	}
 
-	// Take a copy of the string as a vector of chars
-	std::vector<char> json(buffer.get_ptr(), buffer.get_ptr() + buffer.get_length());
-	json.push_back('\0');
+	return body;
+}
 
-	rapidjson::Document document;
-	if (document.Parse<0>(&json[0]).HasParseError())
+// The parts of a track in a last.fm track list that we care about. Optional strings are left empty if they're missing.
+struct LastFmTrack
+{
+	bool hasName;
+	std::string name;
+	bool hasPlayCount;
+	unsigned long playCount;
+	std::string mbid;
+	bool hasArtist;
+	bool hasArtistName;
+	std::string artistName;
+	std::string artistMBID;
+};
+
+// Returns an error message if the track isn't usable, or null if it's fine.
+typedef std::function<const char* (const LastFmTrack&)> OnTrack;
+
+// Handles the SAX events for a response of the form { "<root>": { "track": [ { ... }, ... ] } }, calling onTrack as each track is finished,
+// so nothing but the track being parsed is ever held in memory.
+// rapidjson's reader can't be stopped by a handler, so the first error is remembered and everything after it ignored.
+class TrackListHandler
+{
+public:
+	typedef char Ch;
+
+	TrackListHandler(const char* rootName_, const OnTrack& onTrack_)
+		: rootName(rootName_)
+		, onTrack(onTrack_)
+		, foundTrackList(false)
+		, foundTracks(false)
+		, numTracks(0)
 	{
-		throw std::exception("Parse error in json");
+		frames.push_back(Frame{ Role::Document, false, false, std::string() });
 	}
 
-	if(!document.IsObject())
+	// Throws if the response wasn't what was expected.
+	void finish() const
 	{
-		throw std::exception("json document must be an object");
-	}
+		if(!error.empty())
+		{
+			throw std::exception(error.c_str());
+		}
 
-	const auto& topTracks = document["toptracks"];
+		if(!foundTrackList)
+		{
+			throw std::exception((std::string(rootName) + " json value is not an object; last.fm data format not as expected!").c_str());
+		}
 
-	if(!topTracks.IsObject())
-	{
-		throw std::exception("toptracks json value is not an object; last.fm data format not as expected!");
+		if(!foundTracks)
+		{
+			throw std::exception("tracks json value is not an array; last.fm data format not as expected!");
+		}
 	}
 
-	const auto& tracks = topTracks["track"];
-
-	if(!tracks.IsArray())
+	size_t getNumTracks() const
 	{
-		throw std::exception("tracks json value is not an array; last.fm data format not as expected!");
+		return numTracks;
 	}
 
-	log("Found " + to_string(tracks.Size()) + " tracks");
+	void Null() { onScalar(); }
+	void Bool(bool) { onScalar(); }
+	void Int(int value) { onNumber(value < 0 ? 0 : static_cast<unsigned long>(value)); }
+	void Uint(unsigned value) { onNumber(value); }
+	void Int64(int64_t value) { onNumber(value < 0 ? 0 : static_cast<unsigned long>(value)); }
+	void Uint64(uint64_t value) { onNumber(static_cast<unsigned long>(value)); }
+	void Double(double) { onScalar(); }
 
-	// Iterate over all tracks.
-	for(rapidjson::SizeType i = 0; i < tracks.Size(); ++i)
+	void String(const Ch* str, rapidjson::SizeType length, bool /*copy*/)
 	{
-		const auto& track = tracks[i];
+		Frame& parent = frames.back();
 
-		if(!track.IsObject())
+		// Keys come through as strings too.
+		if(parent.isObject && parent.expectingKey)
 		{
-			throw std::exception("tracks json array element is not an object; last.fm data format not as expected!");
+			parent.key.assign(str, length);
+			parent.expectingKey = false;
+			return;
 		}
 
-		// Extract name and playcount and bail out if they're not present or are not strings.
-		const auto& nameValue = track["name"];
-		const auto& playCountValue = track["playcount"];
+		checkScalarAllowed();
 
-		if(!nameValue.IsString() || !playCountValue.IsString())
+		if(parent.role == Role::Track)
 		{
-			throw std::exception("name, mbid or playcount values on a track are not strings; last.fm data format not as expected!");
+			if(parent.key == "name")
+			{
+				track.hasName = true;
+				track.name.assign(str, length);
+			}
+			else if(parent.key == "playcount")
+			{
+				track.hasPlayCount = true;
+				track.playCount = from_string<unsigned long>(std::string(str, length));
+			}
+			else if(parent.key == "mbid")
+			{
+				track.mbid.assign(str, length);
+			}
+		}
+		else if(parent.role == Role::TrackArtist)
+		{
+			if(parent.key == "name")
+			{
+				track.hasArtistName = true;
+				track.artistName.assign(str, length);
+			}
+			else if(parent.key == "mbid")
+			{
+				track.artistMBID.assign(str, length);
+			}
 		}
 
-		// MBID is optional.
-		const auto& mbidValue = track["mbid"];
-
-		// Extract a string name, mbid and playCount from the track.
-		const std::string name = nameValue.GetString();
-		const std::string mbid = mbidValue.IsString() ? mbidValue.GetString() : "No MBID";
-		const std::string playCountAsString = playCountValue.GetString();
+		endValue();
+	}
 
-		// Parse the reach string as an integer.
-		const unsigned long playCount = from_string<unsigned long>(playCountAsString);
+	void StartObject()
+	{
+		const Role role = getChildRole(true);
 
-		log("track: " + name + ", " + mbid + ", " + to_string(playCount));
+		if(role == Role::Track)
+		{
+			// Reuse the strings' buffers from the last track.
+			track.hasName = false;
+			track.name.clear();
+			track.hasPlayCount = false;
+			track.playCount = 0;
+			track.mbid.clear();
+			track.hasArtist = false;
+			track.hasArtistName = false;
+			track.artistName.clear();
+			track.artistMBID.clear();
+		}
+		else if(role == Role::TrackArtist)
+		{
+			track.hasArtist = true;
+		}
 
-		// Add the result to our map.
-		artistChart.push_back(std::make_pair(playCount, name));
+		frames.push_back(Frame{ role, true, true, std::string() });
 	}
 
-	return artistChart;
-}
-
-SimilarTracks getTrackSimilarTracks(const std::string& artist, const std::string& track, const std::function<void (const std::string&)>& log, foobar2000_io::abort_callback& callback)
-{
-	const size_t limit = 100;
+	void EndObject(rapidjson::SizeType)
+	{
+		const Role role = frames.back().role;
+		frames.pop_back();
 
-	const std::string uri = std::string("http://ws.audioscrobbler.com/2.0?format=json")
-		+ "&api_key=" + apiKey
-		+ "&method=track.getSimilar"
-		+ "&limit=" + to_string(limit)
-		+ "&track=" + url_encode(track)
-		+ "&artist=" + url_encode(artist);
+		if(role == Role::Track && error.empty())
+		{
+			++numTracks;
 
-	log("Creating client");
+			const char* trackError = onTrack(track);
+			if(trackError != nullptr)
+			{
+				error = trackError;
+			}
+		}
 
-	static_api_ptr_t<http_client> http;
+		endValue();
+	}
 
-	auto request = http->create_request("GET");
-	request->add_header("User-Agent", COMPONENT_NAME "/" COMPONENT_VERSION);
+	void StartArray()
+	{
+		frames.push_back(Frame{ getChildRole(false), false, false, std::string() });
+	}
 
-	auto response = request->run_ex(uri.c_str(), callback);
+	void EndArray(rapidjson::SizeType)
+	{
+		frames.pop_back();
+		endValue();
+	}
 
-	pfc::string8 buffer;
-	response->read_string_raw(buffer, callback);
+private:
+	enum class Role
+	{
+		Document,
+		Root,			// { "<root>": ... }
+		TrackList,		// { "track": ... }
+		Tracks,			// [ ... ]
+		Track,
+		TrackArtist,
+		Other,
+	};
+
+	struct Frame
+	{
+		Role role;
+		bool isObject;
+		bool expectingKey;
+		std::string key;
+	};
 
-	if(buffer.is_empty())
+	void setError(const std::string& message)
 	{
-		throw std::exception("No content returned from last.fm. Perhaps last.fm is currently down?");
+		if(error.empty())
+		{
+			error = message;
+		}
 	}
 
-	// Take a copy of the string as a vector of chars
-	std::vector<char> json(buffer.get_ptr(), buffer.get_ptr() + buffer.get_length());
-	json.push_back('\0');
+	// Works out what the object or array that's just starting is, from where it is.
+	Role getChildRole(const bool isObject)
+	{
+		const Frame& parent = frames.back();
+
+		switch(parent.role)
+		{
+			case Role::Document:
+			{
+				if(!isObject)
+				{
+					setError("json document must be an object");
+					return Role::Other;
+				}
+
+				return Role::Root;
+			}
+
+			case Role::Root:
+			{
+				if(parent.key != rootName)
+				{
+					return Role::Other;
+				}
+
+				if(!isObject)
+				{
+					setError(std::string(rootName) + " json value is not an object; last.fm data format not as expected!");
+					return Role::Other;
+				}
+
+				foundTrackList = true;
+				return Role::TrackList;
+			}
+
+			case Role::TrackList:
+			{
+				if(parent.key != "track")
+				{
+					return Role::Other;
+				}
+
+				if(isObject)
+				{
+					setError("tracks json value is not an array; last.fm data format not as expected!");
+					return Role::Other;
+				}
+
+				foundTracks = true;
+				return Role::Tracks;
+			}
+
+			case Role::Tracks:
+			{
+				if(!isObject)
+				{
+					setError("tracks json array element is not an object; last.fm data format not as expected!");
+					return Role::Other;
+				}
+
+				return Role::Track;
+			}
+
+			case Role::Track:
+			{
+				return (isObject && parent.key == "artist") ? Role::TrackArtist : Role::Other;
+			}
+
+			default:
+			{
+				return Role::Other;
+			}
+		}
+	}
 
-	rapidjson::Document document;
-	if (document.Parse<0>(&json[0]).HasParseError())
+	// Complains about values that should have been objects or arrays.
+	void checkScalarAllowed()
 	{
-		throw std::exception("Parse error in json");
+		const Frame& parent = frames.back();
+
+		if(parent.role == Role::Root && parent.key == rootName)
+		{
+			setError(std::string(rootName) + " json value is not an object; last.fm data format not as expected!");
+		}
+		else if(parent.role == Role::TrackList && parent.key == "track")
+		{
+			setError("tracks json value is not an array; last.fm data format not as expected!");
+		}
+		else if(parent.role == Role::Tracks)
+		{
+			setError("tracks json array element is not an object; last.fm data format not as expected!");
+		}
 	}
 
-	if(!document.IsObject())
+	void onScalar()
 	{
-		throw std::exception("json document must be an object");
+		checkScalarAllowed();
+		endValue();
 	}
 
-	const auto& topTracks = document["similartracks"];
+	void onNumber(const unsigned long value)
+	{
+		checkScalarAllowed();
+
+		// track.getSimilar gives play counts as numbers rather than strings.
+		const Frame& parent = frames.back();
+		if(parent.role == Role::Track && parent.key == "playcount")
+		{
+			track.hasPlayCount = true;
+			track.playCount = value;
+		}
 
-	if(!topTracks.IsObject())
+		endValue();
+	}
+
+	void endValue()
 	{
-		throw std::exception("similartracks json value is not an object; last.fm data format not as expected!");
+		Frame& parent = frames.back();
+
+		if(parent.isObject)
+		{
+			parent.expectingKey = true;
+		}
 	}
 
-	const auto& tracks = topTracks["track"];
+	const char* const rootName;
+	const OnTrack& onTrack;
+	std::vector<Frame> frames;
+	LastFmTrack track;
+	std::string error;
+	bool foundTrackList;
+	bool foundTracks;
+	size_t numTracks;
+};
+
+// Parses a track list response straight out of the string, without building a document, and returns the number of tracks in it.
+size_t parseTrackList(const std::string& json, const char* rootName, const OnTrack& onTrack)
+{
+	TrackListHandler handler(rootName, onTrack);
+	rapidjson::StringStream stream(json.c_str());
+	rapidjson::Reader reader;
 
-	if(!tracks.IsArray())
+	if(!reader.Parse<rapidjson::kParseDefaultFlags>(stream, handler))
 	{
-		throw std::exception("tracks json value is not an array; last.fm data format not as expected!");
+		throw std::exception("Parse error in json");
 	}
 
-	log("Found " + to_string(tracks.Size()) + " tracks");
+	handler.finish();
 
-	SimilarTracks similarTracks;
-	similarTracks.reserve(tracks.Size());
+	return handler.getNumTracks();
+}
+
+}
+
+namespace bestversion {
 
-	// Iterate over all tracks.
-	for(rapidjson::SizeType i = 0; i < tracks.Size(); ++i)
+ArtistChart getArtistChart(const std::string& artist, foobar2000_io::abort_callback& callback)
+{
+	const LastFmParameters parameters =
 	{
-		const auto& trackValue = tracks[i];
+		{ "limit", to_string(trackListLimit) },
+		{ "artist", artist },
+	};
 
-		if(!trackValue.IsObject())
-		{
-			throw std::exception("tracks json array element is not an object; last.fm data format not as expected!");
-		}
+	const std::string json = callLastFm("artist.getTopTracks", parameters, callback);
 
-		// Extract name and playcount and bail out if they're not present or are not strings.
-		const auto& trackNameValue = trackValue["name"];
+	return parseArtistChart(json);
+}
 
-		if(!trackNameValue.IsString())
+ArtistChart parseArtistChart(const std::string& json)
+{
+	const TraceScope scope("Parse last.fm response");
+
+	ArtistChart artistChart;
+
+	const size_t numTracks = parseTrackList(json, "toptracks", [&](const LastFmTrack& track) -> const char*
+	{
+		// Bail out if name and playcount are not present.
+		if(!track.hasName || !track.hasPlayCount)
 		{
-			throw std::exception("name value on a track is not a string; last.fm data format not as expected!");
+			return "name, mbid or playcount values on a track are not strings; last.fm data format not as expected!";
 		}
 
 		// MBID is optional.
-		const auto& trackMBIDValue = trackValue["mbid"];
+		BESTVERSION_LOG_TRACE("track: " + track.name + ", " + (track.mbid.empty() ? "No MBID" : track.mbid) + ", " + to_string(track.playCount));
+
+		// Add the result to our map.
+		artistChart.push_back(ArtistChartEntry{ track.playCount, track.name, track.mbid, track.artistMBID });
+
+		return nullptr;
+	});
+
+	BESTVERSION_LOG_TRACE("Found " + to_string(numTracks) + " tracks");
+
+	return artistChart;
+}
+
+SimilarTracks getTrackSimilarTracks(const std::string& artist, const std::string& track, foobar2000_io::abort_callback& callback)
+{
+	const LastFmParameters parameters =
+	{
+		{ "limit", to_string(trackListLimit) },
+		{ "track", track },
+		{ "artist", artist },
+	};
+
+	const std::string json = callLastFm("track.getSimilar", parameters, callback);
+
+	return parseSimilarTracks(json);
+}
 
-		// Extract a string name, mbid and playCount from the track.
-		const std::string trackName = trackNameValue.GetString();
-		const std::string trackMBID = trackMBIDValue.IsString() ? trackMBIDValue.GetString() : "";
-		const auto& artistValue = trackValue["artist"];
+SimilarTracks parseSimilarTracks(const std::string& json)
+{
+	const TraceScope scope("Parse last.fm response");
+
+	SimilarTracks similarTracks;
+	similarTracks.reserve(trackListLimit);
 
-		if(!artistValue.IsObject())
+	const size_t numTracks = parseTrackList(json, "similartracks", [&](const LastFmTrack& similarTrack) -> const char*
+	{
+		if(!similarTrack.hasName)
 		{
-			throw std::exception("artist value on a track is not an object; last.fm data format not as expected!");
+			return "name value on a track is not a string; last.fm data format not as expected!";
 		}
 
-		const auto& artistNameValue = artistValue["name"];
+		if(!similarTrack.hasArtist)
+		{
+			return "artist value on a track is not an object; last.fm data format not as expected!";
+		}
 
-		if(!artistNameValue.IsString())
+		if(!similarTrack.hasArtistName)
 		{
-			throw std::exception("Artist name value on a track is not a string; last.fm data format not as expected!");
+			return "Artist name value on a track is not a string; last.fm data format not as expected!";
 		}
 
-		// MBID is optional.
-		const auto& artistMBIDValue = artistValue["mbid"];
+		// MBIDs are optional.
+		BESTVERSION_LOG_TRACE("track: " + similarTrack.name + ", " + similarTrack.mbid + ", " + similarTrack.artistName + ", " + similarTrack.artistMBID);
 
-		const std::string artistName = artistNameValue.GetString();
-		const std::string artistMBID = artistMBIDValue.IsString() ? artistMBIDValue.GetString() : "";
+		// Add the result to our map.
+		similarTracks.push_back(ArtistAndTrack{ similarTrack.artistName, similarTrack.artistMBID, similarTrack.name, similarTrack.mbid });
 
-		log("track: " + trackName + ", " + trackMBID + ", " + artistName + ", " + artistMBID);
+		return nullptr;
+	});
 
-		// Add the result to our map.
-		similarTracks.push_back(ArtistAndTrack{ artistName, artistMBID, trackName, trackMBID });
-	}
+	BESTVERSION_LOG_TRACE("Found " + to_string(numTracks) + " tracks");
 
 	return similarTracks;
 }
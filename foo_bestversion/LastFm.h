@@ -1,17 +1,26 @@
 #pragma once
 
-#include <functional>
 #include <string>
-#include <utility>
 #include <vector>
 
 #include "FoobarSDKWrapper.h"
 
 namespace bestversion {
 
-typedef std::vector<std::pair<unsigned long, std::string>> ArtistChart;
+struct ArtistChartEntry
+{
+	unsigned long playCount;
+	std::string track;
+	std::string trackMBID;	// MusicBrainz IDs are empty if last.fm doesn't know them.
+	std::string artistMBID;
+};
 
-ArtistChart getArtistChart(const std::string& artist, const std::function<void (const std::string&)>& log, foobar2000_io::abort_callback& callback);
+typedef std::vector<ArtistChartEntry> ArtistChart;
+
+ArtistChart getArtistChart(const std::string& artist, foobar2000_io::abort_callback& callback);
+
+// Reads an artist.getTopTracks response; getArtistChart without the request.
+ArtistChart parseArtistChart(const std::string& json);
 
 struct ArtistAndTrack
 {
@@ -23,6 +32,9 @@ struct ArtistAndTrack
 
 typedef std::vector<ArtistAndTrack> SimilarTracks;
 
-SimilarTracks getTrackSimilarTracks(const std::string& artist, const std::string& track, const std::function<void (const std::string&)>& log, foobar2000_io::abort_callback& callback);
+SimilarTracks getTrackSimilarTracks(const std::string& artist, const std::string& track, foobar2000_io::abort_callback& callback);
+
+// Reads a track.getSimilar response; getTrackSimilarTracks without the request.
+SimilarTracks parseSimilarTracks(const std::string& json);
 
 } // namespace bestversion
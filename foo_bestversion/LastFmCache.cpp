@@ -0,0 +1,645 @@
+#include "LastFmCache.h"
+
+#include "Component.h"
+#include "Normalise.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace {
+
+//------------------------------------------------------------------------------
+
+static const GUID lastFmCacheBranchGUID = { 0x3f431959, 0x77a2, 0x4237, { 0xbc, 0xb5, 0x31, 0x8d, 0x82, 0xff, 0x7b, 0x1d } };
+static const GUID lastFmCacheEnabledGUID = { 0xb04c4e2b, 0xd032, 0x48f9, { 0x93, 0xb1, 0xda, 0x85, 0xc5, 0x05, 0x6d, 0x51 } };
+static const GUID lastFmCacheTimeToLiveGUID = { 0x2b399e23, 0x12fd, 0x4f7d, { 0xaf, 0x54, 0x1d, 0xfb, 0x39, 0x8b, 0x00, 0xb0 } };
+static const GUID lastFmCacheMaxSizeGUID = { 0xbc4ad423, 0x5682, 0x4d98, { 0xa2, 0x05, 0x92, 0x85, 0x45, 0xa1, 0xd2, 0x2f } };
+static const GUID lastFmCacheStaleWhileRevalidateGUID = { 0x07c3a621, 0xf8e7, 0x4eb9, { 0x8d, 0x78, 0xcf, 0x86, 0x0b, 0x97, 0x81, 0x02 } };
+
+static advconfig_branch_factory lastFmCacheBranch(COMPONENT_NAME ": last.fm cache", lastFmCacheBranchGUID, advconfig_entry::guid_branch_tools, 0);
+static advconfig_checkbox_factory lastFmCacheEnabled("Cache last.fm responses", lastFmCacheEnabledGUID, lastFmCacheBranchGUID, 0, true);
+static advconfig_integer_factory lastFmCacheTimeToLiveHours("Keep responses for (hours)", lastFmCacheTimeToLiveGUID, lastFmCacheBranchGUID, 1, 24, 0, 24 * 365);
+static advconfig_integer_factory lastFmCacheMaxSizeMegabytes("Maximum cache size (MB)", lastFmCacheMaxSizeGUID, lastFmCacheBranchGUID, 2, 50, 1, 10000);
+static advconfig_checkbox_factory lastFmCacheStaleWhileRevalidate("Use expired responses straight away and refresh them in the background", lastFmCacheStaleWhileRevalidateGUID, lastFmCacheBranchGUID, 3, true);
+
+//------------------------------------------------------------------------------
+
+// Bump this whenever the layout of the cache files changes; files with a different version are ignored.
+static const t_uint32 cacheFileVersion = 1;
+static const char* const cacheFileExtension = ".lastfm";
+
+//------------------------------------------------------------------------------
+
+std::string trim(const std::string& str)
+{
+	const auto begin = str.find_first_not_of(" \t\r\n");
+	if(begin == std::string::npos)
+	{
+		return std::string();
+	}
+
+	const auto end = str.find_last_not_of(" \t\r\n");
+	return str.substr(begin, end - begin + 1);
+}
+
+//------------------------------------------------------------------------------
+
+// last.fm doesn't care about case or the order of parameters, so neither does the key.
+std::string makeKey(const std::string& method, const bestversion::LastFmParameters& parameters)
+{
+	using namespace bestversion;
+
+	LastFmParameters normalisedParameters;
+	normalisedParameters.reserve(parameters.size());
+
+	for(const auto& parameter : parameters)
+	{
+		normalisedParameters.push_back(std::make_pair(foldCase(trim(parameter.first).c_str()), foldCase(trim(parameter.second).c_str())));
+	}
+
+	std::sort(normalisedParameters.begin(), normalisedParameters.end());
+
+	std::string key = foldCase(method.c_str());
+
+	for(const auto& parameter : normalisedParameters)
+	{
+		key += '&';
+		key += parameter.first;
+		key += '=';
+		key += parameter.second;
+	}
+
+	return key;
+}
+
+//------------------------------------------------------------------------------
+
+// The key itself is stored in the file too, so a clash between hashes just means a miss.
+std::string makeFileName(const std::string& key)
+{
+	// FNV-1a.
+	t_uint64 hash = 14695981039346656037ull;
+
+	for(const char c : key)
+	{
+		hash ^= static_cast<unsigned char>(c);
+		hash *= 1099511628211ull;
+	}
+
+	char fileName[17];
+	sprintf_s(fileName, "%016llx", static_cast<unsigned long long>(hash));
+
+	return std::string(fileName) + cacheFileExtension;
+}
+
+//------------------------------------------------------------------------------
+
+bool hasCacheFileExtension(const std::string& fileName)
+{
+	const size_t extensionLength = strlen(cacheFileExtension);
+
+	return fileName.size() > extensionLength && fileName.compare(fileName.size() - extensionLength, extensionLength, cacheFileExtension) == 0;
+}
+
+//------------------------------------------------------------------------------
+
+// Parses the code out of a status line, which may or may not start with the protocol, e.g. "HTTP/1.1 304 Not Modified" or "200 OK".
+unsigned int parseStatusCode(const char* statusLine)
+{
+	if(strncmp(statusLine, "HTTP/", 5) == 0)
+	{
+		statusLine = strchr(statusLine, ' ');
+		if(statusLine == nullptr)
+		{
+			return 0;
+		}
+	}
+
+	return static_cast<unsigned int>(atoi(statusLine));
+}
+
+//------------------------------------------------------------------------------
+
+std::string readString(file::ptr& file, abort_callback& abort)
+{
+	pfc::string8 str;
+	file->read_string(str, abort);
+	return std::string(str.get_ptr(), str.get_length());
+}
+
+//------------------------------------------------------------------------------
+
+} // anonymous namespace
+
+namespace bestversion {
+
+//------------------------------------------------------------------------------
+
+HttpResponse httpGet(const std::string& url, const std::string& etag, const std::string& lastModified, abort_callback& abort)
+{
+	static_api_ptr_t<http_client> http;
+
+	auto request = http->create_request("GET");
+	request->add_header("User-Agent", COMPONENT_NAME "/" COMPONENT_VERSION);
+
+	if(!etag.empty())
+	{
+		request->add_header("If-None-Match", etag.c_str());
+	}
+
+	if(!lastModified.empty())
+	{
+		request->add_header("If-Modified-Since", lastModified.c_str());
+	}
+
+	auto responseFile = request->run_ex(url.c_str(), abort);
+
+	HttpResponse response;
+	response.status = 200;	// If the client can't tell us otherwise.
+
+	http_reply::ptr reply;
+	if(responseFile->service_query_t(reply))
+	{
+		pfc::string8 value;
+
+		reply->get_status(value);
+		response.status = parseStatusCode(value);
+
+		if(reply->get_http_header("etag", value))
+		{
+			response.etag = value.get_ptr();
+		}
+
+		if(reply->get_http_header("last-modified", value))
+		{
+			response.lastModified = value.get_ptr();
+		}
+	}
+
+	if(response.status != 304)
+	{
+		pfc::string8 buffer;
+		responseFile->read_string_raw(buffer, abort);
+		response.body.assign(buffer.get_ptr(), buffer.get_length());
+	}
+
+	return response;
+}
+
+//------------------------------------------------------------------------------
+
+LastFmCacheSettings getLastFmCacheSettings()
+{
+	const LastFmCacheSettings settings =
+	{
+		lastFmCacheEnabled.get(),
+		lastFmCacheTimeToLiveHours.get() * 60 * 60,
+		lastFmCacheMaxSizeMegabytes.get() * 1024 * 1024,
+		lastFmCacheStaleWhileRevalidate.get(),
+	};
+
+	return settings;
+}
+
+//------------------------------------------------------------------------------
+
+LastFmCache::LastFmCache(const std::string& directory, const HttpGet& get)
+	: directory(directory)
+	, fetch(get)
+	, loaded(false)
+	, totalSize(0)
+	, useCounter(0)
+	, stopping(false)
+{
+}
+
+//------------------------------------------------------------------------------
+
+LastFmCache::~LastFmCache()
+{
+	shutdown();
+}
+
+//------------------------------------------------------------------------------
+
+std::string LastFmCache::get(const std::string& url, const std::string& method, const LastFmParameters& parameters, const LastFmCacheSettings& settings, abort_callback& abort)
+{
+	if(!settings.enabled)
+	{
+		return fetch(url, std::string(), std::string(), abort).body;
+	}
+
+	const std::string key = makeKey(method, parameters);
+	const std::string fileName = makeFileName(key);
+
+	CachedResponse cached;
+	bool isCached = false;
+
+	ensureLoaded(abort);
+	isCached = readEntry(fileName, key, cached, abort);
+
+	if(isCached)
+	{
+		const t_filetimestamp now = filetimestamp_from_system_timer();
+		const t_filetimestamp timeToLive = settings.timeToLiveSeconds * filetimestamp_1second_increment;
+
+		if(now >= cached.fetchedAt && now - cached.fetchedAt < timeToLive)
+		{
+			return cached.body;
+		}
+
+		if(settings.staleWhileRevalidate)
+		{
+			const std::string body = cached.body;
+			queueRefresh(RefreshJob{ url, key, fileName, std::move(cached), settings });
+			return body;
+		}
+	}
+
+	try
+	{
+		return refresh(url, key, fileName, isCached ? &cached : nullptr, settings, abort);
+	}
+	catch(const exception_aborted&)
+	{
+		throw;
+	}
+	catch(const std::exception& e)
+	{
+		if(!isCached)
+		{
+			throw;
+		}
+
+		// Out of date is better than nothing.
+		console::printf(COMPONENT_NAME ": couldn't refresh last.fm response, using the cached one: %s", e.what());
+		return cached.body;
+	}
+}
+
+//------------------------------------------------------------------------------
+
+void LastFmCache::shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		stopping = true;
+		pendingRefreshes.clear();
+	}
+
+	refreshAbort.abort();
+	refreshWanted.notify_all();
+
+	if(refreshThread.joinable())
+	{
+		refreshThread.join();
+	}
+}
+
+//------------------------------------------------------------------------------
+
+std::string LastFmCache::getPath(const std::string& fileName) const
+{
+	pfc::string8 path(directory.c_str());
+	path.add_filename(fileName.c_str());
+	return path.get_ptr();
+}
+
+//------------------------------------------------------------------------------
+
+void LastFmCache::ensureLoaded(abort_callback& abort)
+{
+	if(loaded)
+	{
+		return;
+	}
+
+	// Only one thread lists the directory; any others wait for it, but nothing else does.
+	std::lock_guard<std::mutex> loadLock(loadMutex);
+
+	if(loaded)
+	{
+		return;
+	}
+
+	struct CacheFile
+	{
+		std::string fileName;
+		t_filetimestamp timestamp;
+		t_uint64 size;
+	};
+
+	std::vector<CacheFile> filesByAge;
+
+	try
+	{
+		if(!filesystem::g_exists(directory.c_str(), abort))
+		{
+			filesystem::g_create_directory(directory.c_str(), abort);
+		}
+		else
+		{
+			directory_callback_impl files(false);
+			filesystem::g_list_directory(directory.c_str(), files, abort);
+
+			for(t_size index = 0; index < files.get_count(); ++index)
+			{
+				const std::string fileName = pfc::string_filename_ext(files.get_item(index)).get_ptr();
+				if(hasCacheFileExtension(fileName))
+				{
+					const CacheFile file = { fileName, files.get_item_stats(index).m_timestamp, files.get_item_stats(index).m_size };
+					filesByAge.push_back(file);
+				}
+			}
+
+			// Nothing's been used yet this session, so treat the least recently fetched as the least recently used.
+			std::sort(filesByAge.begin(), filesByAge.end(), [](const CacheFile& lhs, const CacheFile& rhs) { return lhs.timestamp < rhs.timestamp; });
+		}
+	}
+	catch(const exception_aborted&)
+	{
+		throw;
+	}
+	catch(const std::exception& e)
+	{
+		// Carry on without whatever's on disk; responses will be fetched and cached again.
+		console::printf(COMPONENT_NAME ": couldn't read the last.fm cache: %s", e.what());
+		filesByAge.clear();
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		for(const auto& file : filesByAge)
+		{
+			const Entry entry = { file.size, ++useCounter };
+			entries[file.fileName] = entry;
+			totalSize += entry.size;
+		}
+	}
+
+	loaded = true;
+}
+
+//------------------------------------------------------------------------------
+
+bool LastFmCache::readEntry(const std::string& fileName, const std::string& key, CachedResponse& out, abort_callback& abort)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if(entries.find(fileName) == entries.end())
+		{
+			return false;
+		}
+	}
+
+	try
+	{
+		file::ptr cacheFile;
+		filesystem::g_open_read(cacheFile, getPath(fileName).c_str(), abort);
+
+		t_uint32 version = 0;
+		cacheFile->read_lendian_t(version, abort);
+
+		if(version != cacheFileVersion || readString(cacheFile, abort) != key)
+		{
+			return false;
+		}
+
+		cacheFile->read_lendian_t(out.fetchedAt, abort);
+		out.etag = readString(cacheFile, abort);
+		out.lastModified = readString(cacheFile, abort);
+		out.body = readString(cacheFile, abort);
+	}
+	catch(const exception_aborted&)
+	{
+		throw;
+	}
+	catch(const std::exception&)
+	{
+		// Probably deleted or only half written; it'll be replaced when the response is fetched again.
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	// It may have been thrown away while it was being read, in which case there's nothing to mark as used.
+	const auto entryIter = entries.find(fileName);
+	if(entryIter != entries.end())
+	{
+		entryIter->second.lastUsed = ++useCounter;
+	}
+
+	return true;
+}
+
+//------------------------------------------------------------------------------
+
+void LastFmCache::writeEntry(const std::string& fileName, const std::string& key, const CachedResponse& response, const t_uint64 maxSizeBytes, abort_callback& abort)
+{
+	t_uint64 size = 0;
+
+	{
+		file::ptr cacheFile;
+		filesystem::g_open_write_new(cacheFile, getPath(fileName).c_str(), abort);
+
+		cacheFile->write_lendian_t(cacheFileVersion, abort);
+		cacheFile->write_string(key.c_str(), key.size(), abort);
+		cacheFile->write_lendian_t(response.fetchedAt, abort);
+		cacheFile->write_string(response.etag.c_str(), response.etag.size(), abort);
+		cacheFile->write_string(response.lastModified.c_str(), response.lastModified.size(), abort);
+		cacheFile->write_string(response.body.c_str(), response.body.size(), abort);
+
+		size = cacheFile->get_size(abort);
+	}
+
+	std::vector<std::string> fileNamesToRemove;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		Entry& entry = entries[fileName];
+		totalSize -= entry.size;
+		entry.size = size;
+		entry.lastUsed = ++useCounter;
+		totalSize += entry.size;
+
+		takeLeastRecentlyUsed(maxSizeBytes, fileName, fileNamesToRemove);
+	}
+
+	for(const auto& fileNameToRemove : fileNamesToRemove)
+	{
+		try
+		{
+			filesystem::g_remove(getPath(fileNameToRemove).c_str(), abort);
+		}
+		catch(const exception_aborted&)
+		{
+			throw;
+		}
+		catch(const std::exception&)
+		{
+			// Already gone, or in use; either way it's no longer counted.
+		}
+	}
+}
+
+//------------------------------------------------------------------------------
+
+void LastFmCache::takeLeastRecentlyUsed(const t_uint64 maxSizeBytes, const std::string& fileNameToKeep, std::vector<std::string>& fileNamesToRemove)
+{
+	while(totalSize > maxSizeBytes && entries.size() > 1)
+	{
+		auto leastRecentlyUsed = entries.end();
+
+		for(auto entryIter = entries.begin(); entryIter != entries.end(); ++entryIter)
+		{
+			if(entryIter->first != fileNameToKeep && (leastRecentlyUsed == entries.end() || entryIter->second.lastUsed < leastRecentlyUsed->second.lastUsed))
+			{
+				leastRecentlyUsed = entryIter;
+			}
+		}
+
+		fileNamesToRemove.push_back(leastRecentlyUsed->first);
+		totalSize -= leastRecentlyUsed->second.size;
+		entries.erase(leastRecentlyUsed);
+	}
+}
+
+//------------------------------------------------------------------------------
+
+void LastFmCache::queueRefresh(RefreshJob&& job)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if(stopping || !refreshesInProgress.insert(job.fileName).second)
+	{
+		return;
+	}
+
+	pendingRefreshes.push_back(std::move(job));
+
+	if(!refreshThread.joinable())
+	{
+		refreshThread = std::thread(&LastFmCache::refreshInBackground, this);
+	}
+
+	refreshWanted.notify_one();
+}
+
+//------------------------------------------------------------------------------
+
+std::string LastFmCache::refresh(const std::string& url, const std::string& key, const std::string& fileName, const CachedResponse* cached, const LastFmCacheSettings& settings, abort_callback& abort)
+{
+	HttpResponse response = fetch(url, cached ? cached->etag : std::string(), cached ? cached->lastModified : std::string(), abort);
+
+	CachedResponse fresh;
+
+	if(response.status == 304 && cached)
+	{
+		fresh = *cached;
+	}
+	else
+	{
+		fresh.etag = std::move(response.etag);
+		fresh.lastModified = std::move(response.lastModified);
+		fresh.body = std::move(response.body);
+	}
+
+	fresh.fetchedAt = filetimestamp_from_system_timer();
+
+	// Don't hang on to errors; ask again next time.
+	const bool isSuccess = response.status == 304 || (response.status >= 200 && response.status < 300);
+
+	if(isSuccess && !fresh.body.empty())
+	{
+		try
+		{
+			writeEntry(fileName, key, fresh, settings.maxSizeBytes, abort);
+		}
+		catch(const exception_aborted&)
+		{
+			throw;
+		}
+		catch(const std::exception& e)
+		{
+			console::printf(COMPONENT_NAME ": couldn't write to the last.fm cache: %s", e.what());
+		}
+	}
+
+	return fresh.body;
+}
+
+//------------------------------------------------------------------------------
+
+void LastFmCache::refreshInBackground()
+{
+	for(;;)
+	{
+		RefreshJob job;
+
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			refreshWanted.wait(lock, [this]() { return stopping || !pendingRefreshes.empty(); });
+
+			if(stopping)
+			{
+				return;
+			}
+
+			job = std::move(pendingRefreshes.front());
+			pendingRefreshes.pop_front();
+		}
+
+		try
+		{
+			refresh(job.url, job.key, job.fileName, &job.cached, job.settings, refreshAbort);
+		}
+		catch(const std::exception& e)
+		{
+			if(!refreshAbort.is_aborting())
+			{
+				console::printf(COMPONENT_NAME ": couldn't refresh last.fm response in the background: %s", e.what());
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		refreshesInProgress.erase(job.fileName);
+	}
+}
+
+//------------------------------------------------------------------------------
+
+LastFmCache& getLastFmCache()
+{
+	static LastFmCache lastFmCache(core_api::pathInProfile("foo_bestversion-lastfm").get_ptr(), &httpGet);
+	return lastFmCache;
+}
+
+//------------------------------------------------------------------------------
+
+} // namespace bestversion
+
+namespace {
+
+//------------------------------------------------------------------------------
+
+class LastFmCacheInitQuit : public initquit
+{
+public:
+	virtual void on_quit()
+	{
+		// Don't let a background refresh hold up shutting down.
+		bestversion::getLastFmCache().shutdown();
+	}
+};
+
+//------------------------------------------------------------------------------
+
+static initquit_factory_t<LastFmCacheInitQuit> lastFmCacheInitQuitFactory;
+
+//------------------------------------------------------------------------------
+
+} // anonymous namespace
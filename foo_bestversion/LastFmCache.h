@@ -0,0 +1,121 @@
+#pragma once
+
+#include "FoobarSDKWrapper.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace bestversion {
+
+struct HttpResponse
+{
+	unsigned int status;		// e.g. 200, or 304 if the copy we already have is still current, in which case there's no body.
+	std::string body;
+	std::string etag;
+	std::string lastModified;
+};
+
+// Does a GET of the url. If etag or lastModified aren't empty they're sent as validators, so the server can reply 304.
+typedef std::function<HttpResponse (const std::string& url, const std::string& etag, const std::string& lastModified, abort_callback& abort)> HttpGet;
+
+// HttpGet using foobar2000's http_client.
+HttpResponse httpGet(const std::string& url, const std::string& etag, const std::string& lastModified, abort_callback& abort);
+
+typedef std::vector<std::pair<std::string, std::string>> LastFmParameters;
+
+struct LastFmCacheSettings
+{
+	bool enabled;
+	t_uint64 timeToLiveSeconds;
+	t_uint64 maxSizeBytes;
+	bool staleWhileRevalidate;	// Return expired responses straight away and refresh them in the background.
+};
+
+// The settings from Advanced Preferences.
+LastFmCacheSettings getLastFmCacheSettings();
+
+// Cache of last.fm API responses on disk, keyed by method and normalised parameters.
+// Expired responses are revalidated with the server rather than fetched again from scratch,
+// and the least recently used responses are thrown away to keep the cache under its maximum size.
+class LastFmCache
+{
+public:
+	LastFmCache(const std::string& directory, const HttpGet& get);
+	~LastFmCache();
+
+	// Returns the body of the response to url, which must be the API call described by method and parameters.
+	std::string get(const std::string& url, const std::string& method, const LastFmParameters& parameters, const LastFmCacheSettings& settings, abort_callback& abort);
+
+	// Abandons any background refreshes and waits for them to stop.
+	void shutdown();
+
+private:
+	struct CachedResponse
+	{
+		t_filetimestamp fetchedAt;
+		std::string etag;
+		std::string lastModified;
+		std::string body;
+	};
+
+	struct Entry
+	{
+		t_uint64 size;
+		t_uint64 lastUsed;
+	};
+
+	struct RefreshJob
+	{
+		std::string url;
+		std::string key;
+		std::string fileName;
+		CachedResponse cached;
+		LastFmCacheSettings settings;
+	};
+
+	std::string getPath(const std::string& fileName) const;
+
+	// These take the mutex themselves, and only while they change entries; the files are read and written without it.
+	void ensureLoaded(abort_callback& abort);
+	bool readEntry(const std::string& fileName, const std::string& key, CachedResponse& out, abort_callback& abort);
+	void writeEntry(const std::string& fileName, const std::string& key, const CachedResponse& response, t_uint64 maxSizeBytes, abort_callback& abort);
+	void queueRefresh(RefreshJob&& job);
+
+	// Takes entries out, least recently used first, until the rest fit in maxSizeBytes, and appends their file names so the
+	// caller can delete them once it's let go of the mutex. Needs the mutex to be held.
+	void takeLeastRecentlyUsed(t_uint64 maxSizeBytes, const std::string& fileNameToKeep, std::vector<std::string>& fileNamesToRemove);
+
+	std::string refresh(const std::string& url, const std::string& key, const std::string& fileName, const CachedResponse* cached, const LastFmCacheSettings& settings, abort_callback& abort);
+	void refreshInBackground();
+
+	const std::string directory;
+	const HttpGet fetch;
+
+	std::mutex loadMutex;
+	std::atomic<bool> loaded;
+
+	std::mutex mutex;
+	std::unordered_map<std::string, Entry> entries;	// By file name.
+	t_uint64 totalSize;
+	t_uint64 useCounter;
+
+	bool stopping;
+	std::deque<RefreshJob> pendingRefreshes;
+	std::unordered_set<std::string> refreshesInProgress;	// File names of pending or running refreshes, so each is only done once.
+	std::condition_variable refreshWanted;
+	std::thread refreshThread;
+	abort_callback_impl refreshAbort;
+};
+
+LastFmCache& getLastFmCache();
+
+} // namespace bestversion
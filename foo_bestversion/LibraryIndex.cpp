@@ -0,0 +1,1205 @@
+#include "LibraryIndex.h"
+
+#include "BestVersion.h"
+#include "BestVersionMemo.h"
+#include "Component.h"
+#include "Normalise.h"
+#include "TitleCanonicaliser.h"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <unordered_set>
+
+namespace {
+
+//------------------------------------------------------------------------------
+
+// Compacting the string pool goes through every track, so don't do it for the odd change.
+const t_size minRemovedTracksBeforeCompacting = 1000;
+
+//------------------------------------------------------------------------------
+
+} // anonymous namespace
+
+namespace bestversion {
+
+//------------------------------------------------------------------------------
+
+LibrarySnapshot::LibrarySnapshot()
+	: memo(&getBestVersionMemo())
+	, memoGeneration(0)
+	, numRemovedTracks(0)
+{
+}
+
+//------------------------------------------------------------------------------
+
+void LibrarySnapshot::getCandidates(const std::string& artist, const std::string& title, pfc::list_base_t<metadb_handle_ptr>& out) const
+{
+	const auto artistIter = tracksByArtist.find(normaliseArtist(artist));
+	if(artistIter == tracksByArtist.end())
+	{
+		return;
+	}
+
+	const ArtistEntry& artistEntry = artistIter->second;
+
+	// Tracks are filed without their qualifiers, but doesTrackHaveSimilarTitle only ignores those on the track's side,
+	// so look for titles close to the title both with and without its own.
+	std::vector<const std::string*> similarTitles;
+	const std::string normalisedTitle = normaliseTitle(title);
+	const std::string simplifiedTitle = simplifyTitle(title);
+
+	artistEntry.titles.findSimilar(normalisedTitle, similarTitles);
+	if(simplifiedTitle != normalisedTitle)
+	{
+		artistEntry.titles.findSimilar(simplifiedTitle, similarTitles);
+	}
+
+	for(size_t index = 0; index < similarTitles.size(); ++index)
+	{
+		const std::string* similarTitle = similarTitles[index];
+
+		// Both searches may have found it.
+		if(std::find(similarTitles.begin(), similarTitles.begin() + index, similarTitle) != similarTitles.begin() + index)
+		{
+			continue;
+		}
+
+		const auto titleIter = artistEntry.tracksByTitle.find(*similarTitle);
+		if(titleIter == artistEntry.tracksByTitle.end())
+		{
+			continue;
+		}
+
+		for(const auto& track : titleIter->second)
+		{
+			out.add_item(track);
+		}
+	}
+}
+
+//------------------------------------------------------------------------------
+
+void LibrarySnapshot::calculateRatings(const std::string& title, metadb_handle_list_cref tracks, std::vector<float>& ratings) const
+{
+	const TitleQuery query(title);
+
+	const t_size numTracks = tracks.get_count();
+	ratings.resize(numTracks);
+
+	std::vector<t_uint32> rows;
+	std::vector<t_size> rowTracks;
+	rows.reserve(numTracks);
+	rowTracks.reserve(numTracks);
+
+	for(t_size index = 0; index < numTracks; ++index)
+	{
+		const auto entryIter = entriesByTrack.find(tracks[index].get_ptr());
+		if(entryIter != entriesByTrack.end())
+		{
+			rows.push_back(entryIter->second.featureRow);
+			rowTracks.push_back(index);
+		}
+		else
+		{
+			// It wasn't in the library when the snapshot was taken; rate it the slow way.
+			ratings[index] = calculateTrackRating(query, tracks[index]);
+		}
+	}
+
+	std::vector<float> rowRatings(rows.size());
+	features.calculateRatings(strings.find(query.foldedTitle), query.titleQualifiers, rows.data(), rows.size(), rowRatings.data());
+
+	for(t_size row = 0; row < rows.size(); ++row)
+	{
+		ratings[rowTracks[row]] = rowRatings[row];
+	}
+}
+
+//------------------------------------------------------------------------------
+
+void LibrarySnapshot::filterTracksByArtist(const std::string& artist, pfc::list_base_t<metadb_handle_ptr>& tracks) const
+{
+	// If no track has it, nothing in the snapshot is by the artist.
+	const t_uint32 artistId = strings.find(foldCase(artist.c_str()));
+
+	const t_size n = tracks.get_count();
+	bit_array_bittable deleteMask(n);
+
+	for(t_size i = 0; i < n; i++)
+	{
+		const auto entryIter = entriesByTrack.find(tracks[i].get_ptr());
+
+		bool isByArtist = false;
+
+		if(entryIter != entriesByTrack.end())
+		{
+			const auto& foldedArtists = entryIter->second.foldedArtists;
+			isByArtist = artistId != StringPool::noId && std::find(foldedArtists.begin(), foldedArtists.end(), artistId) != foldedArtists.end();
+		}
+		else
+		{
+			// It wasn't in the library when the snapshot was taken; check it the slow way.
+			isByArtist = isTrackByArtist(artist, tracks[i]);
+		}
+
+		deleteMask.set(i, !isByArtist);
+	}
+
+	tracks.remove_mask(deleteMask);
+}
+
+//------------------------------------------------------------------------------
+
+void LibrarySnapshot::filterTracksByCloseTitle(const std::string& title, pfc::list_base_t<metadb_handle_ptr>& tracks) const
+{
+	filterTracksByTitle(title, true, tracks);
+}
+
+//------------------------------------------------------------------------------
+
+void LibrarySnapshot::filterTracksBySimilarTitle(const std::string& title, pfc::list_base_t<metadb_handle_ptr>& tracks) const
+{
+	filterTracksByTitle(title, false, tracks);
+}
+
+//------------------------------------------------------------------------------
+
+void LibrarySnapshot::forEachTitleByArtist(const std::string& artist, const std::function<void (const std::string& normalisedTitle, const std::vector<metadb_handle_ptr>& tracks)>& callback) const
+{
+	const auto artistIter = tracksByArtist.find(normaliseArtist(artist));
+	if(artistIter == tracksByArtist.end())
+	{
+		return;
+	}
+
+	for(const auto& titleBucket : artistIter->second.tracksByTitle)
+	{
+		callback(titleBucket.first, titleBucket.second);
+	}
+}
+
+//------------------------------------------------------------------------------
+
+void LibrarySnapshot::getTracksByRecordingMBID(const std::string& mbid, pfc::list_base_t<metadb_handle_ptr>& out) const
+{
+	const t_uint32 mbidId = strings.find(foldCase(mbid.c_str()));
+	if(mbidId == StringPool::noId)
+	{
+		return;
+	}
+
+	const auto tracksIter = tracksByRecordingMBID.find(mbidId);
+	if(tracksIter == tracksByRecordingMBID.end())
+	{
+		return;
+	}
+
+	for(const auto& track : tracksIter->second)
+	{
+		out.add_item(track);
+	}
+}
+
+//------------------------------------------------------------------------------
+
+bool LibrarySnapshot::getVersionsOfRecording(const std::string& mbid, pfc::list_base_t<metadb_handle_ptr>& out, std::string& title) const
+{
+	const t_uint32 mbidId = strings.find(foldCase(mbid.c_str()));
+	if(mbidId == StringPool::noId)
+	{
+		return false;
+	}
+
+	const auto tracksIter = tracksByRecordingMBID.find(mbidId);
+	if(tracksIter == tracksByRecordingMBID.end() || tracksIter->second.empty())
+	{
+		return false;
+	}
+
+	const auto& taggedTracks = tracksIter->second;
+	title = strings.get(entriesByTrack.at(taggedTracks[0].get_ptr()).foldedTitle);
+
+	// A track with several artists is filed under each of them, so may be in more than one bucket.
+	std::unordered_set<const metadb_handle*> added;
+
+	for(const auto& track : taggedTracks)
+	{
+		out.add_item(track);
+		added.insert(track.get_ptr());
+	}
+
+	// The artist and title buckets the tagged tracks are filed in; usually just the one.
+	std::vector<std::pair<t_uint32, t_uint32>> buckets;
+
+	for(const auto& track : taggedTracks)
+	{
+		const TrackEntry& entry = entriesByTrack.at(track.get_ptr());
+
+		for(const t_uint32 artist : entry.artists)
+		{
+			const auto bucket = std::make_pair(artist, entry.title);
+			if(std::find(buckets.begin(), buckets.end(), bucket) == buckets.end())
+			{
+				buckets.push_back(bucket);
+			}
+		}
+	}
+
+	for(const auto& bucket : buckets)
+	{
+		const auto artistIter = tracksByArtist.find(strings.get(bucket.first));
+		if(artistIter == tracksByArtist.end())
+		{
+			continue;
+		}
+
+		const auto titleIter = artistIter->second.tracksByTitle.find(strings.get(bucket.second));
+		if(titleIter == artistIter->second.tracksByTitle.end())
+		{
+			continue;
+		}
+
+		// Tracks tagged with another recording's ID are another recording, e.g. a live one; those with this ID are already in.
+		for(const auto& track : titleIter->second)
+		{
+			if(entriesByTrack.at(track.get_ptr()).recordingMBID == StringPool::noId && added.insert(track.get_ptr()).second)
+			{
+				out.add_item(track);
+			}
+		}
+	}
+
+	return true;
+}
+
+//------------------------------------------------------------------------------
+
+std::string LibrarySnapshot::getArtistByMBID(const std::string& mbid) const
+{
+	const auto artistIter = artistsByMBID.find(strings.find(foldCase(mbid.c_str())));
+	return artistIter != artistsByMBID.end() ? strings.get(artistIter->second) : std::string();
+}
+
+//------------------------------------------------------------------------------
+
+bool LibrarySnapshot::hasTrack(const metadb_handle_ptr& track) const
+{
+	return entriesByTrack.find(track.get_ptr()) != entriesByTrack.end();
+}
+
+//------------------------------------------------------------------------------
+
+bool LibrarySnapshot::isFiledUnderTags(const metadb_handle_ptr& track) const
+{
+	const auto entryIter = entriesByTrack.find(track.get_ptr());
+	if(entryIter == entriesByTrack.end())
+	{
+		return false;
+	}
+
+	service_ptr_t<metadb_info_container> outInfo;
+	if(!track->get_async_info_ref(outInfo))
+	{
+		return false;
+	}
+
+	const file_info& fileInfo = outInfo->info();
+	const TrackEntry& entry = entryIter->second;
+
+	// Every key it's filed under is worked out from these tags, so if they're the same, so are the keys.
+	if(!fileInfo.meta_exists("title") || strings.find(foldCase(fileInfo.meta_get("title", 0))) != entry.foldedTitle)
+	{
+		return false;
+	}
+
+	const t_uint32 recordingMBID = fileInfo.meta_exists("musicbrainz_trackid") ? strings.find(foldCase(fileInfo.meta_get("musicbrainz_trackid", 0))) : StringPool::noId;
+	if(recordingMBID != entry.recordingMBID || (recordingMBID == StringPool::noId && fileInfo.meta_exists("musicbrainz_trackid")))
+	{
+		return false;
+	}
+
+	std::vector<t_uint32> foldedArtists;
+
+	static const char* const artistFields[] = { "artist", "album artist" };
+
+	for(const char* field : artistFields)
+	{
+		for(t_size j = 0; j < fileInfo.meta_get_count_by_name(field); j++)
+		{
+			const t_uint32 foldedArtist = strings.find(foldCase(fileInfo.meta_get(field, j)));
+			if(foldedArtist == StringPool::noId)
+			{
+				return false;
+			}
+
+			if(std::find(foldedArtists.begin(), foldedArtists.end(), foldedArtist) == foldedArtists.end())
+			{
+				foldedArtists.push_back(foldedArtist);
+			}
+		}
+	}
+
+	// Both are in the order the tags are in.
+	return foldedArtists == entry.foldedArtists;
+}
+
+//------------------------------------------------------------------------------
+
+const StringPool& LibrarySnapshot::getStrings() const
+{
+	return strings;
+}
+
+//------------------------------------------------------------------------------
+
+t_uint64 LibrarySnapshot::getMemoGeneration() const
+{
+	return memoGeneration;
+}
+
+//------------------------------------------------------------------------------
+
+BestVersionMemo& LibrarySnapshot::getMemo() const
+{
+	return *memo;
+}
+
+//------------------------------------------------------------------------------
+
+void LibrarySnapshot::filterTracksByTitle(const std::string& title, const bool allowCloseTitles, pfc::list_base_t<metadb_handle_ptr>& tracks) const
+{
+	const TitleQuery query(title);
+
+	// The same tests as isTitleSimilar, each now a comparison of IDs. A title that isn't in the pool can't match any of them.
+	const t_uint32 foldedTitleId = strings.find(query.foldedTitle);
+	const t_uint32 simplifiedTitleId = strings.find(query.simplifiedTitle);
+	const t_uint32 normalisedTitleId = strings.find(query.normalisedTitle);
+
+	const t_size n = tracks.get_count();
+	std::vector<const TrackEntry*> entries(n);
+	bit_array_bittable deleteMask(n);
+	bool anySimilar = false;
+
+	for(t_size i = 0; i < n; i++)
+	{
+		const auto entryIter = entriesByTrack.find(tracks[i].get_ptr());
+
+		bool similar = false;
+
+		if(entryIter != entriesByTrack.end())
+		{
+			const TrackEntry& entry = entryIter->second;
+			entries[i] = &entry;
+
+			similar = (foldedTitleId != StringPool::noId && (entry.foldedTitle == foldedTitleId || entry.canonicalTitle == foldedTitleId))
+				|| (simplifiedTitleId != StringPool::noId && entry.title == simplifiedTitleId)
+				|| (normalisedTitleId != StringPool::noId && entry.title == normalisedTitleId && entry.simplifiedTitle == simplifiedTitleId);
+		}
+		else
+		{
+			// It wasn't in the library when the snapshot was taken; check it the slow way.
+			similar = doesTrackHaveSimilarTitle(query, tracks[i]);
+		}
+
+		deleteMask.set(i, !similar);
+		anySimilar = anySimilar || similar;
+	}
+
+	// Only settle for a title with a typo in it if there's nothing better; it could be a different song.
+	if(!anySimilar && allowCloseTitles)
+	{
+		for(t_size i = 0; i < n; i++)
+		{
+			const bool close = entries[i] != nullptr ? areTitlesSimilar(strings.get(entries[i]->title), query.simplifiedTitle) : doesTrackHaveCloseTitle(query, tracks[i]);
+			deleteMask.set(i, !close);
+		}
+	}
+
+	tracks.remove_mask(deleteMask);
+}
+
+//------------------------------------------------------------------------------
+
+bool LibrarySnapshot::readTrackKeys(const file_info& fileInfo, TrackEntry& entry)
+{
+	// Check it'll be indexed before adding anything to the pool; a track with no title or artist would leave its strings behind.
+	if(!fileInfo.meta_exists("title") || (!fileInfo.meta_exists("artist") && !fileInfo.meta_exists("album artist")))
+	{
+		return false;
+	}
+
+	const char* title = fileInfo.meta_get("title", 0);
+	const CanonicalTitle canonicalTitle = canonicaliseTitle(title);
+
+	// The same as normaliseTitle, without canonicalising the title twice.
+	entry.title = strings.intern(simplifyTitle(canonicalTitle.base));
+	entry.foldedTitle = strings.intern(foldCase(title));
+	entry.canonicalTitle = strings.intern(foldCase(canonicalTitle.base.c_str()));
+	entry.simplifiedTitle = strings.intern(simplifyTitle(title));
+	entry.titleQualifiers = canonicalTitle.qualifiers;
+
+	// A track is by every one of its artists and album artists, as far as isTrackByArtist is concerned.
+	static const char* const artistFields[] = { "artist", "album artist" };
+
+	for(const char* field : artistFields)
+	{
+		for(t_size j = 0; j < fileInfo.meta_get_count_by_name(field); j++)
+		{
+			const char* artist = fileInfo.meta_get(field, j);
+
+			const t_uint32 normalisedArtist = strings.intern(normaliseArtist(artist));
+			if(std::find(entry.artists.begin(), entry.artists.end(), normalisedArtist) == entry.artists.end())
+			{
+				entry.artists.push_back(normalisedArtist);
+			}
+
+			const t_uint32 foldedArtist = strings.intern(foldCase(artist));
+			if(std::find(entry.foldedArtists.begin(), entry.foldedArtists.end(), foldedArtist) == entry.foldedArtists.end())
+			{
+				entry.foldedArtists.push_back(foldedArtist);
+			}
+		}
+	}
+
+	entry.recordingMBID = fileInfo.meta_exists("musicbrainz_trackid") ? strings.intern(foldCase(fileInfo.meta_get("musicbrainz_trackid", 0))) : StringPool::noId;
+
+	// The artist IDs are in the same order as the artist tags, as long as there's one for each.
+	const t_size numArtists = fileInfo.meta_get_count_by_name("artist");
+	if(fileInfo.meta_get_count_by_name("musicbrainz_artistid") == numArtists)
+	{
+		for(t_size j = 0; j < numArtists; j++)
+		{
+			const t_uint32 mbid = strings.intern(foldCase(fileInfo.meta_get("musicbrainz_artistid", j)));
+			artistsByMBID.emplace(mbid, strings.intern(normaliseArtist(fileInfo.meta_get("artist", j))));
+		}
+	}
+
+	return true;
+}
+
+//------------------------------------------------------------------------------
+
+void LibrarySnapshot::addTrack(const metadb_handle_ptr& track)
+{
+	service_ptr_t<metadb_info_container> outInfo;
+	if(!track->get_async_info_ref(outInfo))
+	{
+		return;
+	}
+
+	const file_info& fileInfo = outInfo->info();
+
+	TrackEntry entry;
+	if(!readTrackKeys(fileInfo, entry))
+	{
+		return;
+	}
+
+	RatingFeatures trackFeatures = readRatingFeatures(fileInfo);
+	trackFeatures.titleId = entry.foldedTitle;
+	trackFeatures.titleQualifiers = entry.titleQualifiers;
+	entry.featureRow = features.add(trackFeatures);
+
+	const std::string title = strings.get(entry.title);
+
+	for(const auto artist : entry.artists)
+	{
+		ArtistEntry& artistEntry = tracksByArtist[strings.get(artist)];
+		auto& bucket = artistEntry.tracksByTitle[title];
+
+		if(bucket.empty())
+		{
+			artistEntry.titles.add(title);
+		}
+
+		bucket.push_back(track);
+	}
+
+	if(entry.recordingMBID != StringPool::noId)
+	{
+		tracksByRecordingMBID[entry.recordingMBID].push_back(track);
+	}
+
+	entriesByTrack[track.get_ptr()] = std::move(entry);
+}
+
+//------------------------------------------------------------------------------
+
+void LibrarySnapshot::removeTrack(const metadb_handle_ptr& track)
+{
+	const auto entryIter = entriesByTrack.find(track.get_ptr());
+	if(entryIter == entriesByTrack.end())
+	{
+		return;
+	}
+
+	const TrackEntry& entry = entryIter->second;
+	const std::string title = strings.get(entry.title);
+
+	for(const auto artist : entry.artists)
+	{
+		const auto artistIter = tracksByArtist.find(strings.get(artist));
+		if(artistIter == tracksByArtist.end())
+		{
+			continue;
+		}
+
+		ArtistEntry& artistEntry = artistIter->second;
+		auto& titles = artistEntry.tracksByTitle;
+		const auto titleIter = titles.find(title);
+		if(titleIter != titles.end())
+		{
+			auto& bucket = titleIter->second;
+			bucket.erase(std::remove(bucket.begin(), bucket.end(), track), bucket.end());
+
+			if(bucket.empty())
+			{
+				titles.erase(titleIter);
+				artistEntry.titles.remove(title);
+			}
+		}
+
+		if(titles.empty())
+		{
+			tracksByArtist.erase(artistIter);
+		}
+	}
+
+	const auto recordingIter = tracksByRecordingMBID.find(entry.recordingMBID);
+	if(recordingIter != tracksByRecordingMBID.end())
+	{
+		auto& recordingTracks = recordingIter->second;
+		recordingTracks.erase(std::remove(recordingTracks.begin(), recordingTracks.end(), track), recordingTracks.end());
+
+		if(recordingTracks.empty())
+		{
+			tracksByRecordingMBID.erase(recordingIter);
+		}
+	}
+
+	features.remove(entry.featureRow);
+	entriesByTrack.erase(entryIter);
+
+	++numRemovedTracks;
+}
+
+//------------------------------------------------------------------------------
+
+void LibrarySnapshot::compactStrings()
+{
+	std::vector<bool> keep(strings.getCount(), false);
+
+	const auto keepId = [&keep](const t_uint32 id)
+	{
+		if(id != StringPool::noId)
+		{
+			keep[id] = true;
+		}
+	};
+
+	for(const auto& trackEntry : entriesByTrack)
+	{
+		const TrackEntry& entry = trackEntry.second;
+
+		std::for_each(entry.artists.begin(), entry.artists.end(), keepId);
+		std::for_each(entry.foldedArtists.begin(), entry.foldedArtists.end(), keepId);
+		keepId(entry.title);
+		keepId(entry.foldedTitle);
+		keepId(entry.canonicalTitle);
+		keepId(entry.simplifiedTitle);
+		keepId(entry.recordingMBID);
+	}
+
+	// Only keep the artist IDs of artists that still have tracks; the rest wouldn't find anything anyway.
+	std::unordered_map<t_uint32, t_uint32> keptArtistsByMBID;
+	for(const auto& artistByMBID : artistsByMBID)
+	{
+		if(keep[artistByMBID.second])
+		{
+			keepId(artistByMBID.first);
+			keptArtistsByMBID.insert(artistByMBID);
+		}
+	}
+
+	std::vector<t_uint32> newIds;
+	strings = strings.compact(keep, newIds);
+
+	const auto remap = [&newIds](t_uint32& id)
+	{
+		if(id != StringPool::noId)
+		{
+			id = newIds[id];
+		}
+	};
+
+	for(auto& trackEntry : entriesByTrack)
+	{
+		TrackEntry& entry = trackEntry.second;
+
+		std::for_each(entry.artists.begin(), entry.artists.end(), remap);
+		std::for_each(entry.foldedArtists.begin(), entry.foldedArtists.end(), remap);
+		remap(entry.title);
+		remap(entry.foldedTitle);
+		remap(entry.canonicalTitle);
+		remap(entry.simplifiedTitle);
+		remap(entry.recordingMBID);
+	}
+
+	artistsByMBID.clear();
+	for(const auto& artistByMBID : keptArtistsByMBID)
+	{
+		artistsByMBID.emplace(newIds[artistByMBID.first], newIds[artistByMBID.second]);
+	}
+
+	std::unordered_map<t_uint32, std::vector<metadb_handle_ptr>> remappedTracksByRecordingMBID;
+	for(auto& recordingTracks : tracksByRecordingMBID)
+	{
+		remappedTracksByRecordingMBID.emplace(newIds[recordingTracks.first], std::move(recordingTracks.second));
+	}
+	tracksByRecordingMBID.swap(remappedTracksByRecordingMBID);
+
+	features.remapTitleIds(newIds);
+
+	numRemovedTracks = 0;
+}
+
+//------------------------------------------------------------------------------
+
+std::shared_ptr<LibrarySnapshot> LibrarySnapshot::build(metadb_handle_list_cref tracks)
+{
+	return build(tracks, getBestVersionMemo());
+}
+
+//------------------------------------------------------------------------------
+
+std::shared_ptr<LibrarySnapshot> LibrarySnapshot::build(metadb_handle_list_cref tracks, BestVersionMemo& memo)
+{
+	auto snapshot = std::make_shared<LibrarySnapshot>();
+	snapshot->memo = &memo;
+	snapshot->memoGeneration = memo.getGeneration();
+
+	for(t_size index = 0; index < tracks.get_count(); ++index)
+	{
+		snapshot->addTrack(tracks[index]);
+	}
+
+	return snapshot;
+}
+
+//------------------------------------------------------------------------------
+
+class LibraryIndex::ReadLibraryCallback : public main_thread_callback
+{
+public:
+	ReadLibraryCallback(LibraryIndex& index_, const std::shared_ptr<Build>& build_)
+		: index(index_)
+		, build(build_)
+	{
+	}
+
+	virtual void callback_run()
+	{
+		index.readLibrary(*build);
+	}
+
+private:
+	LibraryIndex& index;
+	std::shared_ptr<Build> build;
+};
+
+//------------------------------------------------------------------------------
+
+LibraryIndex::Build::Build()
+	: isLibraryRead(false)
+	, cancelled(false)
+	, memoGeneration(0)
+{
+}
+
+//------------------------------------------------------------------------------
+
+LibraryIndex::LibraryIndex()
+	: built(false)
+	, current(std::make_shared<LibrarySnapshot>())
+	, stopping(false)
+{
+}
+
+//------------------------------------------------------------------------------
+
+LibraryIndex::~LibraryIndex()
+{
+	shutdown();
+}
+
+//------------------------------------------------------------------------------
+
+std::shared_ptr<const LibrarySnapshot> LibraryIndex::getBuiltSnapshot(abort_callback& abort)
+{
+	if(core_api::is_main_thread())
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if(built)
+			{
+				return current;
+			}
+		}
+
+		// No library callbacks can come in while the main thread is busy building, so there's nothing to catch up on.
+		// Any build under way elsewhere will find this one has beaten it.
+		pfc::list_t<metadb_handle_ptr> library;
+		static_api_ptr_t<library_manager> lm;
+		lm->get_all_items(library);
+
+		const std::shared_ptr<LibrarySnapshot> snapshot = LibrarySnapshot::build(library);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		current = snapshot;
+		built = true;
+		buildFinished.notify_all();
+
+		return current;
+	}
+
+	std::shared_ptr<Build> build;
+
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+
+		// Wait for whoever's already building it rather than building it twice.
+		while(!built && building != nullptr)
+		{
+			abort.check();
+			buildFinished.wait_for(lock, std::chrono::milliseconds(100));
+		}
+
+		if(built)
+		{
+			return current;
+		}
+
+		build = std::make_shared<Build>();
+		building = build;
+	}
+
+	try
+	{
+		main_thread_callback_add(new service_impl_t<ReadLibraryCallback>(*this, build));
+
+		while(!abort.waitForEvent(build->libraryRead, 0.1))
+		{
+		}
+
+		return finishBuild(build);
+	}
+	catch(...)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		// Let the next job that wants the index have a go.
+		build->cancelled = true;
+		build->changes.clear();
+		if(building == build)
+		{
+			building.reset();
+		}
+
+		buildFinished.notify_all();
+		throw;
+	}
+}
+
+//------------------------------------------------------------------------------
+
+void LibraryIndex::clear()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	current = std::make_shared<LibrarySnapshot>();
+	built = false;
+
+	// A build that's under way is of the library as it was; don't let it become current.
+	if(building != nullptr)
+	{
+		building->cancelled = true;
+		building->changes.clear();
+		building.reset();
+	}
+
+	buildFinished.notify_all();
+}
+
+//------------------------------------------------------------------------------
+
+void LibraryIndex::addTracks(metadb_handle_list_cref tracks)
+{
+	Change change;
+	change.isRemoval = false;
+	change.isModification = false;
+	change.tracks = tracks;
+	change.memoGeneration = 0;
+
+	queueChange(std::move(change));
+}
+
+//------------------------------------------------------------------------------
+
+void LibraryIndex::removeTracks(metadb_handle_list_cref tracks)
+{
+	Change change;
+	change.isRemoval = true;
+	change.isModification = false;
+	change.tracks = tracks;
+	change.memoGeneration = 0;
+
+	queueChange(std::move(change));
+}
+
+//------------------------------------------------------------------------------
+
+void LibraryIndex::updateTracks(metadb_handle_list_cref tracks)
+{
+	// The tags may have changed, so the track may belong in different buckets now; it's taken out and added again like a new one.
+	Change change;
+	change.isRemoval = false;
+	change.isModification = true;
+	change.tracks = tracks;
+	change.memoGeneration = 0;
+
+	queueChange(std::move(change));
+}
+
+//------------------------------------------------------------------------------
+
+std::shared_ptr<const LibrarySnapshot> LibraryIndex::getSnapshot() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return current;
+}
+
+//------------------------------------------------------------------------------
+
+void LibraryIndex::shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(changesMutex);
+
+		stopping = true;
+		queuedChanges.clear();
+	}
+
+	changesQueued.notify_all();
+
+	if(changeThread.joinable())
+	{
+		changeThread.join();
+	}
+}
+
+//------------------------------------------------------------------------------
+
+void LibraryIndex::readLibrary(Build& build)
+{
+	pfc::list_t<metadb_handle_ptr> library;
+	static_api_ptr_t<library_manager> lm;
+	lm->get_all_items(library);
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		// Library callbacks come in on this thread too, so every change from now on is one the list doesn't have.
+		if(!build.cancelled)
+		{
+			build.library = library;
+			build.memoGeneration = getBestVersionMemo().getGeneration();
+			build.isLibraryRead = true;
+		}
+	}
+
+	// Whatever happened, the thread waiting on this mustn't be left hanging.
+	build.libraryRead.set_state(true);
+}
+
+//------------------------------------------------------------------------------
+
+std::shared_ptr<const LibrarySnapshot> LibraryIndex::finishBuild(const std::shared_ptr<Build>& build)
+{
+	const std::shared_ptr<LibrarySnapshot> snapshot = LibrarySnapshot::build(build->library);
+	snapshot->memoGeneration = build->memoGeneration;
+	build->library.remove_all();
+
+	// Catch up on the changes made while it was being built, a batch at a time, until there are none left to make.
+	for(;;)
+	{
+		std::vector<Change> changes;
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			if(build->cancelled)
+			{
+				return snapshot;
+			}
+
+			if(built)
+			{
+				// Built on the main thread in the meantime.
+				building.reset();
+				return current;
+			}
+
+			if(build->changes.empty())
+			{
+				current = snapshot;
+				built = true;
+				building.reset();
+				buildFinished.notify_all();
+
+				return current;
+			}
+
+			changes.swap(build->changes);
+		}
+
+		for(const auto& change : changes)
+		{
+			applyChange(change, *snapshot);
+		}
+	}
+}
+
+//------------------------------------------------------------------------------
+
+void LibraryIndex::queueChange(Change&& change)
+{
+	std::lock_guard<std::mutex> lock(changesMutex);
+
+	if(stopping)
+	{
+		return;
+	}
+
+	queuedChanges.push_back(std::move(change));
+
+	if(!changeThread.joinable())
+	{
+		changeThread = std::thread(&LibraryIndex::applyChangesInBackground, this);
+	}
+
+	changesQueued.notify_one();
+}
+
+//------------------------------------------------------------------------------
+
+void LibraryIndex::applyChangesInBackground()
+{
+	for(;;)
+	{
+		std::vector<Change> changes;
+
+		{
+			std::unique_lock<std::mutex> lock(changesMutex);
+			changesQueued.wait(lock, [this]() { return stopping || !queuedChanges.empty(); });
+
+			if(stopping)
+			{
+				return;
+			}
+
+			changes.swap(queuedChanges);
+		}
+
+		try
+		{
+			applyChanges(changes);
+		}
+		catch(const std::exception& e)
+		{
+			console::printf(COMPONENT_NAME ": couldn't update the library index: %s", e.what());
+		}
+	}
+}
+
+//------------------------------------------------------------------------------
+
+void LibraryIndex::applyChanges(std::vector<Change>& changes)
+{
+	// Tell the memo first. Until the snapshot with the changes in is current, anything picked from an older one
+	// has an older generation, so won't be kept.
+	{
+		std::shared_ptr<const LibrarySnapshot> snapshot;
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if(built)
+			{
+				snapshot = current;
+			}
+		}
+
+		for(auto& change : changes)
+		{
+			// Only a track that's new, or filed differently now, can be a version of titles it wasn't picked from before. One that's
+			// only had its play count or rating changed, say, just needs the picks it was a candidate for forgetting.
+			metadb_handle_list newTracks;
+
+			if(!change.isRemoval)
+			{
+				for(t_size index = 0; index < change.tracks.get_count(); ++index)
+				{
+					if(!change.isModification || snapshot == nullptr || !snapshot->isFiledUnderTags(change.tracks[index]))
+					{
+						newTracks.add_item(change.tracks[index]);
+					}
+				}
+			}
+
+			change.memoGeneration = getBestVersionMemo().invalidateTracks(change.tracks, newTracks);
+		}
+
+		// Let go of it, or it'd always look like a job has hold of it below.
+	}
+
+	// Every change leaves a track as its tags are now, or gone, so making one again that's already been made does no harm.
+	// That's why it doesn't matter if a change was queued just before the library was read for a build.
+	std::shared_ptr<LibrarySnapshot> unchanged;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if(building != nullptr && building->isLibraryRead)
+		{
+			building->changes.insert(building->changes.end(), changes.begin(), changes.end());
+		}
+
+		// Changes made before the index is built will be picked up when it is.
+		if(!built)
+		{
+			return;
+		}
+
+		// Snapshots are only handed out under the mutex, so if nobody else has this one now, nobody can get it while it's being changed.
+		if(current.use_count() == 1)
+		{
+			for(const auto& change : changes)
+			{
+				applyChange(change, *current);
+			}
+
+			return;
+		}
+
+		unchanged = current;
+	}
+
+	// A job still has hold of it. Only this thread changes the current snapshot once it's built, so copy it without the lock.
+	const auto changed = std::make_shared<LibrarySnapshot>(*unchanged);
+
+	for(const auto& change : changes)
+	{
+		applyChange(change, *changed);
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	// If the index has been cleared or built again in the meantime, these changes are either unwanted or already in it.
+	if(current == unchanged)
+	{
+		current = changed;
+	}
+}
+
+//------------------------------------------------------------------------------
+
+void LibraryIndex::applyChange(const Change& change, LibrarySnapshot& snapshot)
+{
+	for(t_size index = 0; index < change.tracks.get_count(); ++index)
+	{
+		snapshot.removeTrack(change.tracks[index]);
+
+		if(!change.isRemoval)
+		{
+			snapshot.addTrack(change.tracks[index]);
+		}
+	}
+
+	snapshot.memoGeneration = change.memoGeneration;
+
+	// Each track taken out, or changed, may have left strings in the pool that nothing uses any more.
+	// Once there have been as many as half the tracks there are, make a pool of just the ones still in use.
+	if(snapshot.numRemovedTracks >= std::max<t_size>(snapshot.entriesByTrack.size() / 2, minRemovedTracksBeforeCompacting))
+	{
+		snapshot.compactStrings();
+	}
+}
+
+//------------------------------------------------------------------------------
+
+LibraryIndex& getLibraryIndex()
+{
+	static LibraryIndex libraryIndex;
+	return libraryIndex;
+}
+
+//------------------------------------------------------------------------------
+
+} // namespace bestversion
+
+namespace {
+
+//------------------------------------------------------------------------------
+
+class LibraryIndexCallback : public library_callback_dynamic_impl_base
+{
+public:
+	virtual void on_items_added(metadb_handle_list_cref p_data)
+	{
+		bestversion::getLibraryIndex().addTracks(p_data);
+	}
+
+	virtual void on_items_removed(metadb_handle_list_cref p_data)
+	{
+		bestversion::getLibraryIndex().removeTracks(p_data);
+	}
+
+	virtual void on_items_modified(metadb_handle_list_cref p_data)
+	{
+		bestversion::getLibraryIndex().updateTracks(p_data);
+	}
+};
+
+//------------------------------------------------------------------------------
+
+class LibraryIndexInitQuit : public initquit
+{
+private:
+	std::unique_ptr<LibraryIndexCallback> callback;
+
+public:
+	virtual void on_init()
+	{
+		// The callback registers itself on construction, which can't be done until services are up.
+		callback.reset(new LibraryIndexCallback());
+	}
+
+	virtual void on_quit()
+	{
+		callback.reset();
+
+		// Don't hang on to any tracks while the app is shutting down.
+		bestversion::getLibraryIndex().shutdown();
+		bestversion::getLibraryIndex().clear();
+	}
+};
+
+//------------------------------------------------------------------------------
+
+static initquit_factory_t<LibraryIndexInitQuit> libraryIndexInitQuitFactory;
+
+//------------------------------------------------------------------------------
+
+} // anonymous namespace
@@ -0,0 +1,213 @@
+#pragma once
+
+#include "FoobarSDKWrapper.h"
+
+#include "FuzzyMatch.h"
+#include "RatingFeatures.h"
+#include "StringPool.h"
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace bestversion {
+
+class BestVersionMemo;
+
+// Index of the library by normalised artist and normalised title as it was at one moment, so that finding the versions of a track
+// only has to look at a handful of tracks rather than the whole library.
+// Snapshots never change once they've been handed out, so they can be used from any thread without locking.
+class LibrarySnapshot
+{
+public:
+	LibrarySnapshot();
+
+	// Appends all tracks which might be by the given artist and have a title close to the given one, allowing for slight differences.
+	// This is a superset of the real matches; filter the result with the usual functions to narrow it down.
+	void getCandidates(const std::string& artist, const std::string& title, pfc::list_base_t<metadb_handle_ptr>& out) const;
+
+	// Rates each of the given tracks against the title, as calculateTrackRating would, but using features worked out when the track was indexed.
+	void calculateRatings(const std::string& title, metadb_handle_list_cref tracks, std::vector<float>& ratings) const;
+
+	// As the free filterTracksByArtist, but comparing pooled IDs of the case-folded tags rather than the tags themselves.
+	void filterTracksByArtist(const std::string& artist, pfc::list_base_t<metadb_handle_ptr>& tracks) const;
+
+	// As the free filterTracksByCloseTitle, but comparing pooled IDs of the forms of each title worked out when it was indexed.
+	void filterTracksByCloseTitle(const std::string& title, pfc::list_base_t<metadb_handle_ptr>& tracks) const;
+
+	// The same, but never settling for a close title; the list is left empty if none of the titles are similar.
+	void filterTracksBySimilarTitle(const std::string& title, pfc::list_base_t<metadb_handle_ptr>& tracks) const;
+
+	// Calls back once for each normalised title filed under the artist, with the tracks filed under it.
+	// Every track with a title similar to one with the same normalised title is in its bucket; see filterTracksBySimilarTitle.
+	void forEachTitleByArtist(const std::string& artist, const std::function<void (const std::string& normalisedTitle, const std::vector<metadb_handle_ptr>& tracks)>& callback) const;
+
+	// Appends the tracks tagged with the given MusicBrainz recording ID (musicbrainz_trackid). They're all versions of the same
+	// recording however their tags are spelt, so there's nothing to filter.
+	void getTracksByRecordingMBID(const std::string& mbid, pfc::list_base_t<metadb_handle_ptr>& out) const;
+
+	// As above, plus the tracks with no recording ID filed under the same artist and title as the tagged ones, so untagged versions
+	// compete too; all found by ID, without matching any names. title is set to the library's title of the recording, case-folded, to
+	// rate them against. Returns false, and appends nothing, if no track has the ID.
+	bool getVersionsOfRecording(const std::string& mbid, pfc::list_base_t<metadb_handle_ptr>& out, std::string& title) const;
+
+	// The normalised artist the library files the tracks tagged with the given MusicBrainz artist ID (musicbrainz_artistid) under,
+	// or empty if no track has it; for when last.fm spells an artist differently from the tags.
+	std::string getArtistByMBID(const std::string& mbid) const;
+
+	// Whether the track was in the library when the snapshot was taken.
+	bool hasTrack(const metadb_handle_ptr& track) const;
+
+	// Whether the track is in the snapshot with the artist, title and recording ID tags it has now, so it's still filed as it was.
+	bool isFiledUnderTags(const metadb_handle_ptr& track) const;
+
+	// Every key and case-folded tag of the tracks in the snapshot.
+	const StringPool& getStrings() const;
+
+	// The best version memo's generation as of the last change to the library the snapshot has caught up with.
+	// Results picked from the snapshot are only worth keeping in the memo if it's still the current one; see BestVersionMemo::add.
+	t_uint64 getMemoGeneration() const;
+
+	// The memo that picks from the snapshot are remembered in: the shared one, unless it was built with its own.
+	BestVersionMemo& getMemo() const;
+
+	// A snapshot of just the given tracks, e.g. the whole library.
+	static std::shared_ptr<LibrarySnapshot> build(metadb_handle_list_cref tracks);
+
+	// As above, but remembering picks in the given memo rather than the shared one, e.g. for a made-up library.
+	static std::shared_ptr<LibrarySnapshot> build(metadb_handle_list_cref tracks, BestVersionMemo& memo);
+
+private:
+	friend class LibraryIndex;
+
+	// Everything here is an ID in strings.
+	struct TrackEntry
+	{
+		std::vector<t_uint32> artists;			// Normalised, as filed in tracksByArtist.
+		t_uint32 title;							// Normalised, as filed in tracksByTitle.
+		t_uint32 foldedTitle;					// The title tag, case-folded.
+		t_uint32 canonicalTitle;				// The title's canonical base, case-folded.
+		t_uint32 simplifiedTitle;				// The whole title, simplified.
+		t_uint16 titleQualifiers;				// TitleQualifier flags.
+		std::vector<t_uint32> foldedArtists;	// Every artist and album artist tag, case-folded.
+		t_uint32 recordingMBID;					// The musicbrainz_trackid tag, case-folded, or StringPool::noId.
+		t_uint32 featureRow;
+	};
+
+	typedef std::unordered_map<std::string, std::vector<metadb_handle_ptr>> TitleBuckets;
+
+	struct ArtistEntry
+	{
+		TitleBuckets tracksByTitle;
+		FuzzyTitleIndex titles;		// The keys of tracksByTitle.
+	};
+
+	bool readTrackKeys(const file_info& fileInfo, TrackEntry& entry);
+
+	void filterTracksByTitle(const std::string& title, bool allowCloseTitles, pfc::list_base_t<metadb_handle_ptr>& tracks) const;
+
+	void addTrack(const metadb_handle_ptr& track);
+	void removeTrack(const metadb_handle_ptr& track);
+
+	// Rebuilds the string pool with only the strings the tracks still use, and changes every ID to match.
+	void compactStrings();
+
+	std::unordered_map<std::string, ArtistEntry> tracksByArtist;
+	std::unordered_map<const metadb_handle*, TrackEntry> entriesByTrack;
+	std::unordered_map<t_uint32, std::vector<metadb_handle_ptr>> tracksByRecordingMBID;
+
+	// Normalised artists by MusicBrainz artist ID. Never removed; an artist whose tracks have all gone just has nothing filed under them.
+	std::unordered_map<t_uint32, t_uint32> artistsByMBID;
+	RatingFeatureTable features;
+	StringPool strings;
+	BestVersionMemo* memo;
+	t_uint64 memoGeneration;
+	t_size numRemovedTracks;		// Since the string pool was last compacted.
+};
+
+// Keeps the current snapshot of the library index. It's built the first time it's needed and kept up to date by library callbacks from then on.
+// The callbacks only queue the changes; a background thread makes them, so the main thread never reads tags or copies the index.
+// Changes are copy-on-write: the current snapshot is only copied if a job is still holding on to it, otherwise it's changed in place.
+class LibraryIndex
+{
+public:
+	LibraryIndex();
+	~LibraryIndex();
+
+	// The index as it is now, building it from the library first if it hasn't been built yet.
+	// Only the list of library tracks is read on the main thread; the index is built on the calling thread, so call this from a
+	// job's run rather than its on_init. On the main thread the whole build has to happen there and then.
+	// Let go of it as soon as you've finished reading it: every change to the library copies the index while anyone has hold of it.
+	std::shared_ptr<const LibrarySnapshot> getBuiltSnapshot(abort_callback& abort);
+
+	// Forgets everything; the index will be built again next time it's needed.
+	void clear();
+
+	// Queue changes to the library; cheap enough for the main thread.
+	void addTracks(metadb_handle_list_cref tracks);
+	void removeTracks(metadb_handle_list_cref tracks);
+	void updateTracks(metadb_handle_list_cref tracks);
+
+	// Abandons any changes still queued and waits for the background thread to stop.
+	void shutdown();
+
+	// The index as it is now; cheap, whatever the size of the library. Empty if the index hasn't been built.
+	std::shared_ptr<const LibrarySnapshot> getSnapshot() const;
+
+private:
+	struct Change
+	{
+		bool isRemoval;
+		bool isModification;		// Of tracks already in the library, rather than new ones.
+		metadb_handle_list tracks;
+		t_uint64 memoGeneration;	// Once the memo's been told about it.
+	};
+
+	// A build on a thread other than the main thread.
+	struct Build
+	{
+		Build();
+
+		pfc::event libraryRead;
+		bool isLibraryRead;				// From here on, changes to the library are kept in changes for the build to catch up on.
+		bool cancelled;
+		metadb_handle_list library;
+		t_uint64 memoGeneration;		// As of reading the library.
+		std::vector<Change> changes;
+	};
+
+	class ReadLibraryCallback;
+
+	// Main thread only.
+	void readLibrary(Build& build);
+
+	// Builds the index from the library that's been read, catches it up on the changes since, and makes it current.
+	std::shared_ptr<const LibrarySnapshot> finishBuild(const std::shared_ptr<Build>& build);
+
+	void queueChange(Change&& change);
+	void applyChangesInBackground();
+	void applyChanges(std::vector<Change>& changes);
+
+	static void applyChange(const Change& change, LibrarySnapshot& snapshot);
+
+	mutable std::mutex mutex;
+	bool built;
+	std::shared_ptr<LibrarySnapshot> current;
+	std::shared_ptr<Build> building;		// Null unless a build is under way.
+	std::condition_variable buildFinished;
+
+	std::mutex changesMutex;				// Separate, so queueing a change never waits for one to be made.
+	bool stopping;
+	std::vector<Change> queuedChanges;
+	std::condition_variable changesQueued;
+	std::thread changeThread;
+};
+
+LibraryIndex& getLibraryIndex();
+
+} // namespace bestversion
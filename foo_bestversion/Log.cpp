@@ -0,0 +1,223 @@
+#include "Log.h"
+
+#include "Component.h"
+#include "FoobarSDKWrapper.h"
+
+#include <atomic>
+#include <cstdint>
+
+namespace {
+
+using namespace bestversion;
+
+//------------------------------------------------------------------------------
+
+static const GUID loggingBranchGUID = { 0x14cb89f3, 0x76e3, 0x48da, { 0x83, 0x81, 0xdd, 0x45, 0x19, 0x57, 0xdf, 0x5f } };
+static const GUID logEveryCandidateGUID = { 0xbb3e752f, 0x56d2, 0x4e01, { 0x92, 0x1f, 0xa5, 0xcf, 0x33, 0xea, 0x69, 0x0c } };
+
+static advconfig_branch_factory loggingBranch(COMPONENT_NAME ": logging", loggingBranchGUID, advconfig_entry::guid_branch_tools, 0);
+static advconfig_checkbox_factory logEveryCandidate("Log every candidate rated and every track read from last.fm", logEveryCandidateGUID, loggingBranchGUID, 0, false);
+
+//------------------------------------------------------------------------------
+
+// A fixed ring of messages that any number of threads can add to without taking a lock, and the main thread empties.
+// Each slot's sequence number says whose turn it is: a writer can fill the slot at position pos when it's pos,
+// and the reader can empty it when it's pos + 1, after which it's pos + capacity, ready for the writer one lap later.
+class LogQueue
+{
+public:
+	struct Message
+	{
+		LogLevel level;
+		std::string text;
+	};
+
+	LogQueue()
+		: numDropped(0)
+		, flushScheduled(false)
+		, writePos(0)
+		, readPos(0)
+	{
+		for(size_t index = 0; index < capacity; ++index)
+		{
+			slots[index].sequence.store(index, std::memory_order_relaxed);
+		}
+	}
+
+	// False if the queue's full, in which case the message is left alone.
+	bool push(const LogLevel level, std::string& text)
+	{
+		size_t pos = writePos.load(std::memory_order_relaxed);
+
+		for(;;)
+		{
+			Slot& slot = slots[pos % capacity];
+			const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+			const auto lead = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(pos);
+
+			if(lead == 0)
+			{
+				// The slot's free; claim it, unless another thread got there first, in which case pos is updated to try the next one.
+				if(writePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				{
+					slot.message.level = level;
+					slot.message.text.swap(text);
+					slot.sequence.store(pos + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if(lead < 0)
+			{
+				// The reader hasn't emptied this slot since the last lap.
+				return false;
+			}
+			else
+			{
+				pos = writePos.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	// False if there's nothing to take. Only one thread may do this at a time.
+	bool pop(Message& message)
+	{
+		Slot& slot = slots[readPos % capacity];
+
+		if(slot.sequence.load(std::memory_order_acquire) != readPos + 1)
+		{
+			return false;
+		}
+
+		message.level = slot.message.level;
+		message.text.swap(slot.message.text);
+		slot.sequence.store(readPos + capacity, std::memory_order_release);
+		++readPos;
+
+		return true;
+	}
+
+	static const size_t capacity = 4096;
+
+	std::atomic<t_size> numDropped;
+
+	// Whether there's a main thread callback on its way to flush the queue.
+	std::atomic<bool> flushScheduled;
+
+private:
+	struct Slot
+	{
+		std::atomic<size_t> sequence;
+		Message message;
+	};
+
+	Slot slots[capacity];
+	std::atomic<size_t> writePos;
+	size_t readPos;
+};
+
+//------------------------------------------------------------------------------
+
+LogQueue& getLogQueue()
+{
+	static LogQueue queue;
+	return queue;
+}
+
+//------------------------------------------------------------------------------
+
+class FlushLogCallback : public main_thread_callback
+{
+public:
+	virtual void callback_run()
+	{
+		flushLog();
+	}
+};
+
+//------------------------------------------------------------------------------
+
+} // anonymous namespace
+
+namespace bestversion {
+
+//------------------------------------------------------------------------------
+
+bool isLogging(const LogLevel level)
+{
+	switch(level)
+	{
+		case LogLevel::Trace:
+		{
+			return logEveryCandidate.get();
+		}
+
+		case LogLevel::Debug:
+		{
+#if defined(_DEBUG) || defined(BESTVERSION_DEBUG_LOGGING)
+			return true;
+#else
+			return false;
+#endif
+		}
+
+		default:
+		{
+			return true;
+		}
+	}
+}
+
+//------------------------------------------------------------------------------
+
+void log(const LogLevel level, std::string message)
+{
+	LogQueue& queue = getLogQueue();
+
+	if(!queue.push(level, message))
+	{
+		if(level == LogLevel::Trace || level == LogLevel::Debug)
+		{
+			++queue.numDropped;
+		}
+		else
+		{
+			// Better out of order than lost.
+			console::print(message.c_str());
+		}
+
+		return;
+	}
+
+	// Only the first message since the last flush needs to ask for another.
+	if(!queue.flushScheduled.exchange(true, std::memory_order_acq_rel))
+	{
+		main_thread_callback_add(new service_impl_t<FlushLogCallback>());
+	}
+}
+
+//------------------------------------------------------------------------------
+
+void flushLog()
+{
+	LogQueue& queue = getLogQueue();
+
+	// Anything queued from here on asks for another flush, so nothing gets stranded.
+	queue.flushScheduled.exchange(false, std::memory_order_acq_rel);
+
+	LogQueue::Message message = { LogLevel::Info, std::string() };
+
+	while(queue.pop(message))
+	{
+		console::print(message.text.c_str());
+	}
+
+	const t_size numDropped = queue.numDropped.exchange(0);
+	if(numDropped > 0)
+	{
+		console::printf(COMPONENT_NAME ": %u trace messages were dropped; the console couldn't keep up", static_cast<unsigned int>(numDropped));
+	}
+}
+
+//------------------------------------------------------------------------------
+
+} // namespace bestversion
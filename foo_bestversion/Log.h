@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+
+namespace bestversion {
+
+enum class LogLevel
+{
+	Warning,	// Something the user should know about, like a track with no title.
+	Info,		// A line or two per job, e.g. how many tracks it found.
+	Trace,		// Every candidate rated and every track read from last.fm; only with tracing switched on in advanced preferences.
+	Debug,		// Only compiled into debug builds, or with BESTVERSION_DEBUG_LOGGING defined.
+};
+
+// Whether messages at the given level are being logged at the moment. Cheap; check it before building a message.
+bool isLogging(LogLevel level);
+
+// Queues the message for the console without blocking. Any thread.
+// The queue is emptied on the main thread, which keeps the console's lock off the worker threads; if tracing fills it up,
+// further trace messages are dropped and counted, and anything more important goes straight to the console instead.
+void log(LogLevel level, std::string message);
+
+// Writes out everything queued so far, e.g. before a job prints its summary. Main thread only.
+void flushLog();
+
+} // namespace bestversion
+
+// These only build the message if it's going to be logged.
+#define BESTVERSION_LOG(level, message)\
+	do\
+	{\
+		if(::bestversion::isLogging(level))\
+		{\
+			::bestversion::log((level), (message));\
+		}\
+	} while(false)
+
+#define BESTVERSION_LOG_TRACE(message) BESTVERSION_LOG(::bestversion::LogLevel::Trace, message)
+
+#if defined(_DEBUG) || defined(BESTVERSION_DEBUG_LOGGING)
+#define BESTVERSION_LOG_DEBUG(message) BESTVERSION_LOG(::bestversion::LogLevel::Debug, message)
+#else
+#define BESTVERSION_LOG_DEBUG(message) do {} while(false)
+#endif
@@ -0,0 +1,244 @@
+#include "Normalise.h"
+
+#include "FoobarSDKWrapper.h"
+#include "TitleCanonicaliser.h"
+
+#include <cstring>
+#include <vector>
+
+namespace {
+
+//------------------------------------------------------------------------------
+
+typedef int (WINAPI* NormalizeStringFunc)(int normForm, const wchar_t* src, int srcLength, wchar_t* dst, int dstLength);
+
+const int normalizationC = 1;
+
+//------------------------------------------------------------------------------
+
+// NormalizeString isn't there on XP without the IDN update, so look for it rather than link to it.
+NormalizeStringFunc getNormalizeString()
+{
+	static const NormalizeStringFunc normalizeString = []()
+	{
+		const HMODULE normaliz = LoadLibraryW(L"Normaliz.dll");
+		return normaliz != nullptr ? reinterpret_cast<NormalizeStringFunc>(GetProcAddress(normaliz, "NormalizeString")) : nullptr;
+	}();
+
+	return normalizeString;
+}
+
+//------------------------------------------------------------------------------
+
+bool isAscii(const char* str, const size_t length)
+{
+	for(size_t index = 0; index < length; ++index)
+	{
+		if(static_cast<unsigned char>(str[index]) >= 0x80)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+//------------------------------------------------------------------------------
+
+// Composes any accents written as separate combining characters onto their letters (NFC).
+// Leaves the string as it is if it can't, which only costs matches between the two ways of writing it.
+std::string composeAccents(const char* str)
+{
+	const NormalizeStringFunc normalizeString = getNormalizeString();
+	if(normalizeString == nullptr)
+	{
+		return str;
+	}
+
+	const pfc::stringcvt::string_wide_from_utf8 wide(str);
+	std::vector<wchar_t> composed(wide.length() + 1);
+
+	for(;;)
+	{
+		const int length = normalizeString(normalizationC, wide.get_ptr(), -1, composed.data(), static_cast<int>(composed.size()));
+
+		if(length > 0)
+		{
+			return pfc::stringcvt::string_utf8_from_wide(composed.data()).get_ptr();
+		}
+
+		// Otherwise the negated length is a better guess at how much room it needs.
+		if(GetLastError() != ERROR_INSUFFICIENT_BUFFER)
+		{
+			return str;
+		}
+
+		composed.resize(composed.size() + static_cast<size_t>(-length));
+	}
+}
+
+//------------------------------------------------------------------------------
+
+} // anonymous namespace
+
+namespace bestversion {
+
+//------------------------------------------------------------------------------
+
+std::string foldCase(const char* str)
+{
+	std::string folded;
+	foldCase(str, folded);
+	return folded;
+}
+
+//------------------------------------------------------------------------------
+
+void foldCase(const char* str, std::string& folded)
+{
+	const size_t strLength = strlen(str);
+
+	folded.clear();
+	folded.reserve(strLength);
+
+	// Most tags are plain ASCII, which is already composed and only needs its capitals lowering.
+	if(isAscii(str, strLength))
+	{
+		for(size_t index = 0; index < strLength; ++index)
+		{
+			const char c = str[index];
+			folded += c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+		}
+
+		return;
+	}
+
+	const std::string composed = composeAccents(str);
+	const char* c = composed.c_str();
+
+	for(;;)
+	{
+		unsigned codePoint = 0;
+		const t_size length = pfc::utf8_decode_char(c, codePoint);
+		if(length == 0)
+		{
+			break;
+		}
+
+		char encoded[8];
+		const t_size encodedLength = pfc::utf8_encode_char(uCharLower(codePoint), encoded);
+		folded.append(encoded, encodedLength);
+
+		c += length;
+	}
+}
+
+//------------------------------------------------------------------------------
+
+std::string simplifyTitle(const std::string& title)
+{
+	enum class Treatment
+	{
+		Keep,
+		Drop,
+		Space,
+		And,
+	};
+
+	const auto getTreatment = [](const unsigned c)
+	{
+		switch(c)
+		{
+			case '\'': case '"': case '`': case '.': case ',': case '!': case '?': case ':': case ';':
+			case 0x00B4:	// Acute accent, often typed for an apostrophe.
+			case 0x2018: case 0x2019: case 0x201C: case 0x201D:	// Curly quotes.
+			{
+				return Treatment::Drop;
+			}
+
+			case ' ': case '\t': case '-': case '/': case '\\': case '_': case '+': case '*': case '~': case '#':
+			case '(': case ')': case '[': case ']': case '{': case '}':
+			case 0x00A0:	// No-break space.
+			case 0x2010: case 0x2011: case 0x2012: case 0x2013: case 0x2014: case 0x2015:	// Hyphens and dashes.
+			{
+				return Treatment::Space;
+			}
+
+			case '&':
+			{
+				return Treatment::And;
+			}
+
+			default:
+			{
+				return Treatment::Keep;
+			}
+		}
+	};
+
+	const std::string folded = foldCase(title.c_str());
+
+	std::string simplified;
+	simplified.reserve(folded.size());
+
+	bool pendingSpace = false;
+	const char* str = folded.c_str();
+
+	for(;;)
+	{
+		unsigned c = 0;
+		const t_size length = pfc::utf8_decode_char(str, c);
+		if(length == 0)
+		{
+			break;
+		}
+
+		const Treatment treatment = getTreatment(c);
+
+		if(treatment == Treatment::Space)
+		{
+			pendingSpace = true;
+		}
+		else if(treatment != Treatment::Drop)
+		{
+			// Only put spaces between words, never at the start or end.
+			if(pendingSpace && !simplified.empty())
+			{
+				simplified += ' ';
+			}
+			pendingSpace = false;
+
+			if(treatment == Treatment::And)
+			{
+				simplified += "and";
+				pendingSpace = true;
+			}
+			else
+			{
+				simplified.append(str, length);
+			}
+		}
+
+		str += length;
+	}
+
+	return simplified;
+}
+
+//------------------------------------------------------------------------------
+
+std::string normaliseArtist(const std::string& artist)
+{
+	return foldCase(artist.c_str());
+}
+
+//------------------------------------------------------------------------------
+
+std::string normaliseTitle(const std::string& title)
+{
+	return simplifyTitle(canonicaliseTitle(title).base);
+}
+
+//------------------------------------------------------------------------------
+
+} // namespace bestversion
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstring>
+#include <string>
+
+namespace bestversion {
+
+// Lower-cases a UTF-8 string character by character, the same way stricmp_utf8 compares them, having first composed
+// any accents typed as separate combining characters, so "Bjo\xCC\x88rk" and "Bj\xC3\xB6rk" fold to the same thing.
+// Two strings compare equal case-insensitively, however their accents were written, exactly when their folded forms are equal.
+std::string foldCase(const char* str);
+
+// The same, into a string that can be reused to save allocating a new one each time.
+void foldCase(const char* str, std::string& folded);
+
+// A string that's been through foldCase, with its length, so that comparing it with lots of others that have too
+// is a length check and a memcmp rather than decoding and lower-casing both sides every time, as stricmp_utf8 does.
+struct FoldedString
+{
+	const char* str;
+	size_t length;
+};
+
+inline bool operator==(const FoldedString& lhs, const FoldedString& rhs)
+{
+	return lhs.length == rhs.length && memcmp(lhs.str, rhs.str, lhs.length) == 0;
+}
+
+// Case-folds a title and evens out punctuation, so "Don't Stop Me Now" and "Dont Stop Me Now" come out the same.
+// Quotes, apostrophes and full stops and the like are dropped, dashes, slashes and brackets become spaces, "&" becomes "and",
+// and runs of whitespace are collapsed to a single space. Whatever's in brackets is kept.
+std::string simplifyTitle(const std::string& title);
+
+// Keys used to look tracks up by artist and title without caring about case, punctuation or qualifiers like "(Live)" or " - Radio Edit".
+std::string normaliseArtist(const std::string& artist);
+std::string normaliseTitle(const std::string& title);
+
+} // namespace bestversion
@@ -0,0 +1,313 @@
+#include "ParallelFor.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+//------------------------------------------------------------------------------
+
+// A contiguous range of indices still to be processed by one worker.
+struct WorkQueue
+{
+	std::mutex mutex;
+	t_size begin;
+	t_size end;
+};
+
+//------------------------------------------------------------------------------
+
+bool takeFront(WorkQueue& queue, t_size& index)
+{
+	std::lock_guard<std::mutex> lock(queue.mutex);
+
+	if(queue.begin == queue.end)
+	{
+		return false;
+	}
+
+	index = queue.begin++;
+	return true;
+}
+
+//------------------------------------------------------------------------------
+
+// Moves the back half of the victim's remaining range into the thief's (empty) queue.
+bool stealHalf(WorkQueue& victim, WorkQueue& thief)
+{
+	t_size stolenBegin = 0;
+	t_size stolenEnd = 0;
+
+	{
+		std::lock_guard<std::mutex> lock(victim.mutex);
+
+		const t_size remaining = victim.end - victim.begin;
+		if(remaining == 0)
+		{
+			return false;
+		}
+
+		stolenEnd = victim.end;
+		stolenBegin = victim.end - (remaining + 1) / 2;
+		victim.end = stolenBegin;
+	}
+
+	std::lock_guard<std::mutex> lock(thief.mutex);
+	thief.begin = stolenBegin;
+	thief.end = stolenEnd;
+
+	return true;
+}
+
+//------------------------------------------------------------------------------
+
+// The threads parallelFor's workers run on. They're kept for the next call rather than started and joined every time.
+// A worker goes to an idle thread if there is one, otherwise a new thread is started for it, so a parallelFor from another
+// job at the same time never has to wait for this one's threads to come free. There are never more threads than were busy at once.
+class ThreadPool
+{
+public:
+	ThreadPool()
+		: stopping(false)
+		, numIdle(0)
+	{
+	}
+
+	~ThreadPool()
+	{
+		shutdown();
+	}
+
+	void run(std::function<void ()>&& job)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			if(!stopping)
+			{
+				jobs.push_back(std::move(job));
+
+				if(jobs.size() > numIdle)
+				{
+					threads.emplace_back([this]() { runJobs(); });
+				}
+				else
+				{
+					jobQueued.notify_one();
+				}
+
+				return;
+			}
+		}
+
+		// Shutting down, so there's nowhere else to run it.
+		job();
+	}
+
+	// Lets the threads finish any jobs already queued and waits for them.
+	void shutdown()
+	{
+		std::vector<std::thread> stoppingThreads;
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+			stoppingThreads.swap(threads);
+		}
+
+		jobQueued.notify_all();
+
+		for(auto& thread : stoppingThreads)
+		{
+			thread.join();
+		}
+	}
+
+private:
+	void runJobs()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+
+		for(;;)
+		{
+			++numIdle;
+			jobQueued.wait(lock, [this]() { return !jobs.empty() || stopping; });
+			--numIdle;
+
+			if(jobs.empty())
+			{
+				return;
+			}
+
+			const std::function<void ()> job = std::move(jobs.front());
+			jobs.pop_front();
+
+			lock.unlock();
+			job();
+			lock.lock();
+		}
+	}
+
+	std::mutex mutex;
+	std::condition_variable jobQueued;
+	bool stopping;
+	t_size numIdle;
+	std::deque<std::function<void ()>> jobs;
+	std::vector<std::thread> threads;
+};
+
+//------------------------------------------------------------------------------
+
+ThreadPool& getThreadPool()
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+//------------------------------------------------------------------------------
+
+} // anonymous namespace
+
+namespace bestversion {
+
+//------------------------------------------------------------------------------
+
+t_size getDefaultThreadCount()
+{
+	return std::max<t_size>(std::thread::hardware_concurrency(), 1);
+}
+
+//------------------------------------------------------------------------------
+
+void parallelFor(
+	const t_size count,
+	t_size numThreads,
+	const std::function<void (t_size)>& task,
+	const std::function<void ()>& onWait,
+	abort_callback& abort
+)
+{
+	numThreads = std::max<t_size>(std::min(numThreads, count), 1);
+
+	// Deal the indices out evenly to start with.
+	std::vector<std::unique_ptr<WorkQueue>> queues;
+	for(t_size worker = 0; worker < numThreads; ++worker)
+	{
+		std::unique_ptr<WorkQueue> queue(new WorkQueue);
+		queue->begin = count * worker / numThreads;
+		queue->end = count * (worker + 1) / numThreads;
+		queues.push_back(std::move(queue));
+	}
+
+	std::atomic<bool> stop(false);
+	std::exception_ptr firstException;
+	std::mutex doneMutex;
+	std::condition_variable doneCondition;
+	t_size workersRunning = numThreads;
+
+	const auto work = [&](const t_size worker)
+	{
+		WorkQueue& ownQueue = *queues[worker];
+
+		try
+		{
+			for(;;)
+			{
+				t_size index = 0;
+
+				if(!takeFront(ownQueue, index))
+				{
+					// Out of work; look for someone to steal from, starting with our neighbour.
+					bool stole = false;
+					for(t_size offset = 1; offset < numThreads && !stole; ++offset)
+					{
+						stole = stealHalf(*queues[(worker + offset) % numThreads], ownQueue);
+					}
+
+					if(!stole)
+					{
+						break;
+					}
+
+					continue;
+				}
+
+				if(stop || abort.is_aborting())
+				{
+					break;
+				}
+
+				task(index);
+			}
+		}
+		catch(...)
+		{
+			std::lock_guard<std::mutex> lock(doneMutex);
+			if(!firstException)
+			{
+				firstException = std::current_exception();
+			}
+			stop = true;
+		}
+
+		// The thread outlives this call, so once the count's down nothing of the call can be touched; it may already have returned.
+		std::lock_guard<std::mutex> lock(doneMutex);
+		--workersRunning;
+		doneCondition.notify_all();
+	};
+
+	for(t_size worker = 0; worker < numThreads; ++worker)
+	{
+		getThreadPool().run([&work, worker]() { work(worker); });
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(doneMutex);
+		while(workersRunning > 0)
+		{
+			doneCondition.wait_for(lock, std::chrono::milliseconds(100));
+
+			lock.unlock();
+			onWait();
+			lock.lock();
+		}
+	}
+
+	if(firstException)
+	{
+		std::rethrow_exception(firstException);
+	}
+}
+
+//------------------------------------------------------------------------------
+
+} // namespace bestversion
+
+namespace {
+
+//------------------------------------------------------------------------------
+
+class ThreadPoolInitQuit : public initquit
+{
+public:
+	virtual void on_quit()
+	{
+		getThreadPool().shutdown();
+	}
+};
+
+//------------------------------------------------------------------------------
+
+static initquit_factory_t<ThreadPoolInitQuit> threadPoolInitQuitFactory;
+
+//------------------------------------------------------------------------------
+
+} // anonymous namespace
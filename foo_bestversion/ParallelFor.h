@@ -0,0 +1,26 @@
+#pragma once
+
+#include "FoobarSDKWrapper.h"
+
+#include <functional>
+
+namespace bestversion {
+
+// Number of worker threads to use for CPU-bound work; one per hardware thread.
+t_size getDefaultThreadCount();
+
+// Calls task(index) for every index in [0, count), spread over numThreads workers. The workers run on a pool of threads
+// that's kept from one call to the next, so a call costs a few handoffs rather than starting and joining threads.
+// Each worker starts with an equal share of the indices and steals half of another worker's remaining share
+// when it runs out, so uneven task costs still keep every thread busy.
+// The calling thread waits, calling onWait every so often (e.g. to report progress) until all tasks are done.
+// Workers stop picking up new tasks once abort is signalled; if a task throws, the first exception is rethrown here.
+void parallelFor(
+	t_size count,
+	t_size numThreads,
+	const std::function<void (t_size)>& task,
+	const std::function<void ()>& onWait,
+	abort_callback& abort
+);
+
+} // namespace bestversion
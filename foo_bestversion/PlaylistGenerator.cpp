@@ -2,6 +2,8 @@
 
 #include "FoobarSDKWrapper.h"
 
+#include <unordered_map>
+
 namespace bestversion {
 
 //------------------------------------------------------------------------------
@@ -39,22 +41,84 @@ void generatePlaylistFromTracks(const pfc::list_t<metadb_handle_ptr>& tracks, co
 
 //------------------------------------------------------------------------------
 
-void replaceTrackInActivePlaylist(const metadb_handle_ptr& trackToReplace, const metadb_handle_ptr& replacement)
+t_size replaceTracksInActivePlaylist(metadb_handle_list_cref tracksToReplace, metadb_handle_list_cref replacements)
 {
-	t_size index = 0;
 	static_api_ptr_t<playlist_manager> pm;
 
-	if(!pm->activeplaylist_find_item(trackToReplace, index))
+	const t_size playlist = pm->get_active_playlist();
+	if(playlist == pfc_infinite)
 	{
-		console::printf("Couldn't find track in active playlist to replace it: %s", trackToReplace->get_path());
-		return;
+		console::print("Couldn't replace tracks: there's no active playlist");
+		return 0;
 	}
 
-	if(!pm->activeplaylist_replace_item(index, replacement))
+	std::unordered_map<const metadb_handle*, metadb_handle_ptr> replacementsByTrack;
+
+	for(t_size index = 0; index < tracksToReplace.get_count(); ++index)
+	{
+		if(replacements[index] != nullptr)
+		{
+			replacementsByTrack[tracksToReplace[index].get_ptr()] = replacements[index];
+		}
+	}
+
+	// One pass over the playlist finds every position of every track, duplicates included.
+	metadb_handle_list items;
+	pm->playlist_get_all_items(playlist, items);
+
+	metadb_handle_list itemReplacements;
+	itemReplacements.set_count(items.get_count());
+
+	for(t_size index = 0; index < items.get_count(); ++index)
 	{
-		console::printf("Couldn't replace track in active playlist: %s", trackToReplace->get_path());
-		return;
+		const auto replacement = replacementsByTrack.find(items[index].get_ptr());
+		if(replacement != replacementsByTrack.end())
+		{
+			itemReplacements[index] = replacement->second;
+		}
 	}
+
+	return replacePlaylistItems(playlist, items, itemReplacements);
+}
+
+//------------------------------------------------------------------------------
+
+t_size replacePlaylistItems(const t_size playlist, metadb_handle_list_cref items, metadb_handle_list_cref replacements)
+{
+	static_api_ptr_t<playlist_manager> pm;
+
+	metadb_handle_list currentItems;
+	pm->playlist_get_all_items(playlist, currentItems);
+
+	bit_array_bittable mask(currentItems.get_count());
+	metadb_handle_list maskedReplacements;
+
+	for(t_size index = 0; index < items.get_count() && index < currentItems.get_count(); ++index)
+	{
+		if(replacements[index] != nullptr && currentItems[index] == items[index])
+		{
+			mask.set(index, true);
+			maskedReplacements.add_item(replacements[index]);
+		}
+	}
+
+	if(maskedReplacements.get_count() == 0)
+	{
+		return 0;
+	}
+
+	pm->playlist_undo_backup(playlist);
+
+	// One call, so one on_items_replaced for the UI to deal with however many items there are.
+	if(!pm->playlist_replace_items(playlist, mask, maskedReplacements))
+	{
+		pfc::string8 playlistName;
+		pm->playlist_get_name(playlist, playlistName);
+		console::printf("Couldn't replace tracks in playlist %s", playlistName.get_ptr());
+		return 0;
+	}
+
+	return maskedReplacements.get_count();
 }
 
 //------------------------------------------------------------------------------
@@ -7,7 +7,13 @@ namespace bestversion {
 void generatePlaylistFromTracks(const pfc::list_t<metadb_handle_ptr>& tracks);
 void generatePlaylistFromTracks(const pfc::list_t<metadb_handle_ptr>& tracks, const std::string& playlistName);
 
-// Note that no undo backup is performed; make sure to set an undo point before calling this function.
-void replaceTrackInActivePlaylist(const metadb_handle_ptr& trackToReplace, const metadb_handle_ptr& replacement);
+// Replaces every occurrence of tracksToReplace[i] in the active playlist with replacements[i], unless it's null, in one go, with an undo point first.
+// Returns the number of items replaced.
+t_size replaceTracksInActivePlaylist(metadb_handle_list_cref tracksToReplace, metadb_handle_list_cref replacements);
+
+// Replaces items[i] with replacements[i] wherever the replacement isn't null, in one go, with an undo point first.
+// items is what was in the playlist when the replacements were worked out; anything that's moved since is left alone.
+// Returns the number of items replaced.
+t_size replacePlaylistItems(t_size playlist, metadb_handle_list_cref items, metadb_handle_list_cref replacements);
 
 } // namespace bestversion
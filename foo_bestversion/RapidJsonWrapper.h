@@ -6,5 +6,5 @@
 #pragma warning (disable: 4512) // X : assignment operator could not be generated
 #pragma warning (disable: 4611) // interaction between '_setjmp' and C++ object destruction is non-portable
 #include "rapidjson/rapidjson.h"
-#include "rapidjson/document.h"
+#include "rapidjson/reader.h"
 #pragma warning (pop)
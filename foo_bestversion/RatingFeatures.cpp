@@ -0,0 +1,315 @@
+#include "RatingFeatures.h"
+
+#include "Component.h"
+#include "ScoringKernels.h"
+#include "StringPool.h"
+#include "TitleCanonicaliser.h"
+
+#include <cstring>
+
+namespace {
+
+//------------------------------------------------------------------------------
+
+// These mirror the ratings in calculateTrackRating; keep them in sync. The weightings are applied by the scoring kernels.
+static const float ratingForExactTitleMatch = 2.0f;
+static const float ratingForTitleMatchWithBrackets = 1.0f;
+
+static const float releaseTypeRatings[] =
+{
+	0.55f,	// Unset; assume it's somewhere between a live album and a soundtrack.
+	1.0f,	// Album
+	0.9f,	// Single
+	0.8f,	// Compilation
+	0.7f,	// EP
+	0.6f,	// Soundtrack
+	0.5f,	// Live
+	0.4f,	// Other
+	0.3f,	// Remix
+	1.0f,	// Unrecognised
+};
+static_assert(sizeof(releaseTypeRatings) / sizeof(releaseTypeRatings[0]) == static_cast<size_t>(bestversion::ReleaseType::MAX), "Missing release type rating");
+
+static const float albumArtistRatings[] =
+{
+	1.0f,	// Unknown
+	1.0f,	// Same
+	0.333f,	// VariousArtists
+	0.666f,	// Different
+};
+static_assert(sizeof(albumArtistRatings) / sizeof(albumArtistRatings[0]) == static_cast<size_t>(bestversion::AlbumArtistRelation::MAX), "Missing album artist rating");
+
+static const GUID ratingBranchGUID = { 0xa981ee94, 0xc551, 0x4452, { 0x8d, 0xbc, 0x39, 0x2f, 0xe7, 0x32, 0x97, 0x63 } };
+static const GUID rateQualifiedTitlesLowerGUID = { 0xacd7e8ca, 0xb5a2, 0x4f4a, { 0xb2, 0x6a, 0xd5, 0x1e, 0xae, 0x2f, 0x5d, 0x4f } };
+
+static advconfig_branch_factory ratingBranch(COMPONENT_NAME ": rating", ratingBranchGUID, advconfig_entry::guid_branch_tools, 0);
+static advconfig_checkbox_factory rateQualifiedTitlesLower("Rate live, remix, edit, acoustic, demo and instrumental versions lower unless the title asks for them", rateQualifiedTitlesLowerGUID, ratingBranchGUID, 0, false);
+
+// Added for each qualifier a track has that the title being looked for doesn't, if rateQualifiedTitlesLower is ticked.
+// Remasters, features and anything unrecognised are as good as the original as far as we know. The penalties are guesses at
+// how unlikely each is to be the version that was meant, rather than anything measured, which is why they're off by default.
+static const struct
+{
+	t_uint16 qualifier;
+	float rating;
+} titleQualifierRatings[] =
+{
+	{ bestversion::TitleQualifier::Live, -0.5f },
+	{ bestversion::TitleQualifier::Remix, -0.5f },
+	{ bestversion::TitleQualifier::Edit, -0.25f },
+	{ bestversion::TitleQualifier::Acoustic, -0.25f },
+	{ bestversion::TitleQualifier::Demo, -0.5f },
+	{ bestversion::TitleQualifier::Instrumental, -1.0f },
+};
+
+//------------------------------------------------------------------------------
+
+bestversion::ReleaseType parseReleaseType(const char* albumType)
+{
+	using bestversion::ReleaseType;
+
+	static const struct
+	{
+		const char* name;
+		ReleaseType type;
+	} releaseTypeNames[] =
+	{
+		{ "album", ReleaseType::Album },
+		{ "single", ReleaseType::Single },
+		{ "compilation", ReleaseType::Compilation },
+		{ "ep", ReleaseType::EP },
+		{ "soundtrack", ReleaseType::Soundtrack },
+		{ "live", ReleaseType::Live },
+		{ "other", ReleaseType::Other },
+		{ "remix", ReleaseType::Remix },
+	};
+
+	for(const auto& releaseTypeName : releaseTypeNames)
+	{
+		if(strcmp(albumType, releaseTypeName.name) == 0)
+		{
+			return releaseTypeName.type;
+		}
+	}
+
+	return ReleaseType::Unrecognised;
+}
+
+//------------------------------------------------------------------------------
+
+} // anonymous namespace
+
+namespace bestversion {
+
+//------------------------------------------------------------------------------
+
+RatingFeatures readRatingFeatures(const file_info& fileInfo)
+{
+	RatingFeatures features = { false, 0.0f, 0.0f, ReleaseType::Unset, AlbumArtistRelation::Unknown, StringPool::noId, 0 };
+
+	if(!fileInfo.meta_exists("title"))
+	{
+		return features;
+	}
+
+	features.rateable = true;
+
+	if(fileInfo.meta_exists("PLAY_COUNTER"))
+	{
+		features.playCount = static_cast<float>(atoi(fileInfo.meta_get("PLAY_COUNTER", 0)));
+	}
+
+	features.bitrate = static_cast<float>(fileInfo.info_get_bitrate());
+
+	if(fileInfo.meta_exists("musicbrainz album type") || fileInfo.meta_exists("releasetype"))
+	{
+		const char* albumType = fileInfo.meta_exists("musicbrainz album type") ? fileInfo.meta_get("musicbrainz album type", 0) : fileInfo.meta_get("releasetype", 0);
+		features.releaseType = parseReleaseType(albumType);
+	}
+
+	if(fileInfo.meta_exists("album artist") && fileInfo.meta_exists("artist"))
+	{
+		const char* artist = fileInfo.meta_get("artist", 0);
+		const char* albumArtist = fileInfo.meta_get("album artist", 0);
+
+		if(strcmp(albumArtist, artist) == 0)
+		{
+			features.albumArtistRelation = AlbumArtistRelation::Same;
+		}
+		else if(strcmp(albumArtist, "Various Artists") == 0)
+		{
+			features.albumArtistRelation = AlbumArtistRelation::VariousArtists;
+		}
+		else
+		{
+			features.albumArtistRelation = AlbumArtistRelation::Different;
+		}
+	}
+
+	return features;
+}
+
+//------------------------------------------------------------------------------
+
+RatingFeatures readRatingFeatures(const metadb_handle_ptr& track)
+{
+	service_ptr_t<metadb_info_container> outInfo;
+	if(!track->get_async_info_ref(outInfo))
+	{
+		const RatingFeatures unrateable = { false, 0.0f, 0.0f, ReleaseType::Unset, AlbumArtistRelation::Unknown, StringPool::noId, 0 };
+		return unrateable;
+	}
+
+	return readRatingFeatures(outInfo->info());
+}
+
+//------------------------------------------------------------------------------
+
+float calculateTitleQualifierRating(const t_uint16 trackQualifiers, const t_uint16 wantedQualifiers)
+{
+	if(!rateQualifiedTitlesLower.get())
+	{
+		return 0.0f;
+	}
+
+	const t_uint16 unwantedQualifiers = static_cast<t_uint16>(trackQualifiers & ~wantedQualifiers);
+
+	float rating = 0.0f;
+
+	for(const auto& qualifierRating : titleQualifierRatings)
+	{
+		if((unwantedQualifiers & qualifierRating.qualifier) != 0)
+		{
+			rating += qualifierRating.rating;
+		}
+	}
+
+	return rating;
+}
+
+//------------------------------------------------------------------------------
+
+std::string getRatingSettingsKey()
+{
+	return rateQualifiedTitlesLower.get() ? "qualifiers rated lower" : "qualifiers rated the same";
+}
+
+//------------------------------------------------------------------------------
+
+t_uint32 RatingFeatureTable::add(const RatingFeatures& features)
+{
+	t_uint32 row = 0;
+
+	if(!freeRows.empty())
+	{
+		row = freeRows.back();
+		freeRows.pop_back();
+	}
+	else
+	{
+		row = static_cast<t_uint32>(rateable.size());
+
+		rateable.push_back(0);
+		bitrates.push_back(0.0f);
+		playCounts.push_back(0.0f);
+		releaseTypes.push_back(ReleaseType::Unset);
+		albumArtistRelations.push_back(AlbumArtistRelation::Unknown);
+		titleIds.push_back(StringPool::noId);
+		titleQualifiers.push_back(0);
+	}
+
+	set(row, features);
+
+	return row;
+}
+
+//------------------------------------------------------------------------------
+
+void RatingFeatureTable::set(const t_uint32 row, const RatingFeatures& features)
+{
+	rateable[row] = features.rateable ? 1 : 0;
+	bitrates[row] = features.bitrate;
+	playCounts[row] = features.playCount;
+	releaseTypes[row] = features.releaseType;
+	albumArtistRelations[row] = features.albumArtistRelation;
+	titleIds[row] = features.titleId;
+	titleQualifiers[row] = features.titleQualifiers;
+}
+
+//------------------------------------------------------------------------------
+
+void RatingFeatureTable::remove(const t_uint32 row)
+{
+	rateable[row] = 0;
+	freeRows.push_back(row);
+}
+
+//------------------------------------------------------------------------------
+
+void RatingFeatureTable::clear()
+{
+	rateable.clear();
+	bitrates.clear();
+	playCounts.clear();
+	releaseTypes.clear();
+	albumArtistRelations.clear();
+	titleIds.clear();
+	titleQualifiers.clear();
+	freeRows.clear();
+}
+
+//------------------------------------------------------------------------------
+
+void RatingFeatureTable::remapTitleIds(const std::vector<t_uint32>& newIds)
+{
+	for(auto& titleId : titleIds)
+	{
+		if(titleId != StringPool::noId)
+		{
+			titleId = newIds[titleId];
+		}
+	}
+}
+
+//------------------------------------------------------------------------------
+
+void RatingFeatureTable::calculateRatings(const t_uint32 titleId, const t_uint16 wantedQualifiers, const t_uint32* rows, const t_size numRows, float* ratings) const
+{
+	// Gather the candidates' features into contiguous arrays so they can be scored several at a time.
+	std::vector<float> columns(numRows * 6);
+	float* const candidateRateable = columns.data();
+	float* const candidateTitleRatings = candidateRateable + numRows;
+	float* const candidatePlayCounts = candidateTitleRatings + numRows;
+	float* const candidateBitrates = candidatePlayCounts + numRows;
+	float* const candidateReleaseTypeRatings = candidateBitrates + numRows;
+	float* const candidateAlbumArtistRatings = candidateReleaseTypeRatings + numRows;
+
+	for(t_size index = 0; index < numRows; ++index)
+	{
+		const t_uint32 row = rows[index];
+
+		candidateRateable[index] = rateable[row] ? 1.0f : 0.0f;
+		const float titleMatchRating = (titleId != StringPool::noId && titleIds[row] == titleId) ? ratingForExactTitleMatch : ratingForTitleMatchWithBrackets;
+		candidateTitleRatings[index] = titleMatchRating + calculateTitleQualifierRating(titleQualifiers[row], wantedQualifiers);
+		candidatePlayCounts[index] = playCounts[row];
+		candidateBitrates[index] = bitrates[row];
+		candidateReleaseTypeRatings[index] = releaseTypeRatings[static_cast<size_t>(releaseTypes[row])];
+		candidateAlbumArtistRatings[index] = albumArtistRatings[static_cast<size_t>(albumArtistRelations[row])];
+	}
+
+	const CandidateColumns candidates =
+	{
+		candidateRateable,
+		candidateTitleRatings,
+		candidatePlayCounts,
+		candidateBitrates,
+		candidateReleaseTypeRatings,
+		candidateAlbumArtistRatings,
+	};
+
+	scoreCandidates(candidates, numRows, ratings);
+}
+
+//------------------------------------------------------------------------------
+
+} // namespace bestversion
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "FoobarSDKWrapper.h"
+
+#include <string>
+#include <vector>
+
+namespace bestversion {
+
+enum class ReleaseType : t_uint8
+{
+	Unset,			// Neither "musicbrainz album type" nor "releasetype" is set.
+	Album,
+	Single,
+	Compilation,
+	EP,
+	Soundtrack,
+	Live,
+	Other,
+	Remix,
+	Unrecognised,	// Set, but to something we don't know about.
+	MAX
+};
+
+enum class AlbumArtistRelation : t_uint8
+{
+	Unknown,		// Artist or album artist is missing.
+	Same,
+	VariousArtists,
+	Different,		// Artist appearing on someone else's album.
+	MAX
+};
+
+// Everything calculateTrackRating looks at on a track, pulled out of its tags once so that rating doesn't have to touch them.
+struct RatingFeatures
+{
+	bool rateable;		// False if there's no info or no title; such tracks are never picked.
+	float bitrate;
+	float playCount;
+	ReleaseType releaseType;
+	AlbumArtistRelation albumArtistRelation;
+	t_uint32 titleId;	// The ID of the case-folded title in a StringPool; readRatingFeatures leaves it for the caller to fill in.
+	t_uint16 titleQualifiers;	// TitleQualifier flags from canonicaliseTitle; likewise left for the caller.
+};
+
+RatingFeatures readRatingFeatures(const file_info& fileInfo);
+RatingFeatures readRatingFeatures(const metadb_handle_ptr& track);
+
+// What a track's title qualifiers add to its rating: nothing for those that were asked for in the title being looked for,
+// and a penalty for versions it's less likely anyone wanted, like live versions and demos, if that's been ticked in advanced preferences.
+float calculateTitleQualifierRating(t_uint16 trackQualifiers, t_uint16 wantedQualifiers);
+
+// Different for every combination of the advanced preferences that change ratings, so that picks kept from one session to the next
+// can be told apart from those made with other settings.
+std::string getRatingSettingsKey();
+
+// The rating features of many tracks, stored column by column so that rating a set of candidates is a tight loop over plain arrays.
+// Rows are handed out by add() and recycled once removed.
+class RatingFeatureTable
+{
+public:
+	t_uint32 add(const RatingFeatures& features);
+	void set(t_uint32 row, const RatingFeatures& features);
+	void remove(t_uint32 row);
+	void clear();
+
+	// For when the string pool the title IDs are from is compacted; newIds is by old ID. See StringPool::compact.
+	void remapTitleIds(const std::vector<t_uint32>& newIds);
+
+	// Writes the rating of each of the given rows against the title with the given ID and qualifiers to ratings;
+	// gives the same results as calculateTrackRating.
+	void calculateRatings(t_uint32 titleId, t_uint16 wantedQualifiers, const t_uint32* rows, t_size numRows, float* ratings) const;
+
+private:
+	std::vector<t_uint8> rateable;
+	std::vector<float> bitrates;
+	std::vector<float> playCounts;
+	std::vector<ReleaseType> releaseTypes;
+	std::vector<AlbumArtistRelation> albumArtistRelations;
+	std::vector<t_uint32> titleIds;
+	std::vector<t_uint16> titleQualifiers;
+	std::vector<t_uint32> freeRows;
+};
+
+} // namespace bestversion
@@ -0,0 +1,282 @@
+#include "ScoringKernels.h"
+
+#include "Maths.h"
+
+#include <limits>
+
+#if PFC_HAVE_CPUID
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+namespace {
+
+//------------------------------------------------------------------------------
+
+// These mirror the weightings in calculateTrackRating; keep them in sync.
+static const float lowPlayCount = 0.0f;
+static const float highPlayCount = 10.0f;
+static const float lowPlayCountRating = 0.0f;
+static const float highPlayCountRating = 0.5f;
+
+static const float lowBitrate = 0.0f;
+static const float highBitrate = 1000.0f;
+static const float lowBitrateRating = 0.0f;
+static const float highBitrateRating = 2.0f;
+
+static const float releaseTypeWeighting = 3.0f;
+static const float albumArtistWeighting = 1.0f;
+
+//------------------------------------------------------------------------------
+
+// The sums are done in the same order as calculateTrackRating in every kernel so the results are identical, not just close.
+void scoreCandidatesScalar(const bestversion::CandidateColumns& candidates, const t_size begin, const t_size end, float* ratings)
+{
+	using namespace bestversion;
+
+	for(t_size index = begin; index < end; ++index)
+	{
+		if(candidates.rateable[index] == 0.0f)
+		{
+			ratings[index] = -1.0f;
+			continue;
+		}
+
+		float totalRating = 0.0f;
+
+		totalRating += candidates.titleRatings[index];
+		totalRating += maths::map(candidates.playCounts[index], lowPlayCount, highPlayCount, lowPlayCountRating, highPlayCountRating);
+		totalRating += maths::map(candidates.bitrates[index], lowBitrate, highBitrate, lowBitrateRating, highBitrateRating);
+		totalRating += candidates.releaseTypeRatings[index] * releaseTypeWeighting;
+		totalRating += candidates.albumArtistRatings[index] * albumArtistWeighting;
+
+		ratings[index] = totalRating;
+	}
+}
+
+//------------------------------------------------------------------------------
+
+#if PFC_HAVE_CPUID
+
+//------------------------------------------------------------------------------
+
+bool isAvx2Supported()
+{
+	int cpuInfo[4];
+
+	__cpuid(cpuInfo, 0);
+	if(cpuInfo[0] < 7)
+	{
+		return false;
+	}
+
+	// The CPU needs AVX, and the OS needs to save the upper halves of the registers on context switches.
+	__cpuid(cpuInfo, 1);
+	const bool hasOsxsave = (cpuInfo[2] & (1 << 27)) != 0;
+	const bool hasAvx = (cpuInfo[2] & (1 << 28)) != 0;
+	if(!hasOsxsave || !hasAvx || (_xgetbv(0) & 0x6) != 0x6)
+	{
+		return false;
+	}
+
+	__cpuidex(cpuInfo, 7, 0);
+	return (cpuInfo[1] & (1 << 5)) != 0;
+}
+
+//------------------------------------------------------------------------------
+
+// Vector equivalent of maths::map, i.e. lerp(outputRangeA, outputRangeB, clip((value - inputRangeA) / (inputRangeB - inputRangeA), 0, 1)).
+inline __m128 mapSSE2(const __m128 value, const float inputRangeA, const float inputRangeB, const float outputRangeA, const float outputRangeB)
+{
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+
+	const __m128 proportionOfInputRange = _mm_div_ps(_mm_sub_ps(value, _mm_set1_ps(inputRangeA)), _mm_set1_ps(inputRangeB - inputRangeA));
+	const __m128 clippedProportion = _mm_min_ps(_mm_max_ps(proportionOfInputRange, zero), one);
+
+	return _mm_add_ps(
+		_mm_mul_ps(_mm_set1_ps(outputRangeA), _mm_sub_ps(one, clippedProportion)),
+		_mm_mul_ps(_mm_set1_ps(outputRangeB), clippedProportion)
+	);
+}
+
+//------------------------------------------------------------------------------
+
+t_size scoreCandidatesSSE2(const bestversion::CandidateColumns& candidates, const t_size count, float* ratings)
+{
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 unrateableRating = _mm_set1_ps(-1.0f);
+
+	t_size index = 0;
+	for(; index + 4 <= count; index += 4)
+	{
+		__m128 totalRating = _mm_setzero_ps();
+
+		totalRating = _mm_add_ps(totalRating, _mm_loadu_ps(candidates.titleRatings + index));
+		totalRating = _mm_add_ps(totalRating, mapSSE2(_mm_loadu_ps(candidates.playCounts + index), lowPlayCount, highPlayCount, lowPlayCountRating, highPlayCountRating));
+		totalRating = _mm_add_ps(totalRating, mapSSE2(_mm_loadu_ps(candidates.bitrates + index), lowBitrate, highBitrate, lowBitrateRating, highBitrateRating));
+		totalRating = _mm_add_ps(totalRating, _mm_mul_ps(_mm_loadu_ps(candidates.releaseTypeRatings + index), _mm_set1_ps(releaseTypeWeighting)));
+		totalRating = _mm_add_ps(totalRating, _mm_mul_ps(_mm_loadu_ps(candidates.albumArtistRatings + index), _mm_set1_ps(albumArtistWeighting)));
+
+		const __m128 rateable = _mm_cmpneq_ps(_mm_loadu_ps(candidates.rateable + index), zero);
+		_mm_storeu_ps(ratings + index, _mm_or_ps(_mm_and_ps(rateable, totalRating), _mm_andnot_ps(rateable, unrateableRating)));
+	}
+
+	return index;
+}
+
+//------------------------------------------------------------------------------
+
+inline __m256 mapAVX2(const __m256 value, const float inputRangeA, const float inputRangeB, const float outputRangeA, const float outputRangeB)
+{
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one = _mm256_set1_ps(1.0f);
+
+	const __m256 proportionOfInputRange = _mm256_div_ps(_mm256_sub_ps(value, _mm256_set1_ps(inputRangeA)), _mm256_set1_ps(inputRangeB - inputRangeA));
+	const __m256 clippedProportion = _mm256_min_ps(_mm256_max_ps(proportionOfInputRange, zero), one);
+
+	// Deliberately not fused multiply-adds; they'd round differently to the scalar code.
+	return _mm256_add_ps(
+		_mm256_mul_ps(_mm256_set1_ps(outputRangeA), _mm256_sub_ps(one, clippedProportion)),
+		_mm256_mul_ps(_mm256_set1_ps(outputRangeB), clippedProportion)
+	);
+}
+
+//------------------------------------------------------------------------------
+
+t_size scoreCandidatesAVX2(const bestversion::CandidateColumns& candidates, const t_size count, float* ratings)
+{
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 unrateableRating = _mm256_set1_ps(-1.0f);
+
+	t_size index = 0;
+	for(; index + 8 <= count; index += 8)
+	{
+		__m256 totalRating = _mm256_setzero_ps();
+
+		totalRating = _mm256_add_ps(totalRating, _mm256_loadu_ps(candidates.titleRatings + index));
+		totalRating = _mm256_add_ps(totalRating, mapAVX2(_mm256_loadu_ps(candidates.playCounts + index), lowPlayCount, highPlayCount, lowPlayCountRating, highPlayCountRating));
+		totalRating = _mm256_add_ps(totalRating, mapAVX2(_mm256_loadu_ps(candidates.bitrates + index), lowBitrate, highBitrate, lowBitrateRating, highBitrateRating));
+		totalRating = _mm256_add_ps(totalRating, _mm256_mul_ps(_mm256_loadu_ps(candidates.releaseTypeRatings + index), _mm256_set1_ps(releaseTypeWeighting)));
+		totalRating = _mm256_add_ps(totalRating, _mm256_mul_ps(_mm256_loadu_ps(candidates.albumArtistRatings + index), _mm256_set1_ps(albumArtistWeighting)));
+
+		const __m256 rateable = _mm256_cmp_ps(_mm256_loadu_ps(candidates.rateable + index), zero, _CMP_NEQ_UQ);
+		_mm256_storeu_ps(ratings + index, _mm256_blendv_ps(unrateableRating, totalRating, rateable));
+	}
+
+	// Avoid the penalty for switching back to SSE code with the upper halves dirty.
+	_mm256_zeroupper();
+
+	return index;
+}
+
+//------------------------------------------------------------------------------
+
+#endif // PFC_HAVE_CPUID
+
+//------------------------------------------------------------------------------
+
+} // anonymous namespace
+
+namespace bestversion {
+
+//------------------------------------------------------------------------------
+
+ScoringKernel getBestScoringKernel()
+{
+	static const ScoringKernel bestKernel = []()
+	{
+#if PFC_HAVE_CPUID
+		if(isAvx2Supported())
+		{
+			return ScoringKernel::AVX2;
+		}
+
+		if(pfc::query_cpu_feature_set(pfc::CPU_HAVE_SSE2))
+		{
+			return ScoringKernel::SSE2;
+		}
+#endif
+
+		return ScoringKernel::Scalar;
+	}();
+
+	return bestKernel;
+}
+
+//------------------------------------------------------------------------------
+
+const char* getScoringKernelName(const ScoringKernel kernel)
+{
+	switch(kernel)
+	{
+		case ScoringKernel::Scalar:	return "scalar";
+		case ScoringKernel::SSE2:	return "SSE2";
+		case ScoringKernel::AVX2:	return "AVX2";
+		default:					return "unknown";
+	}
+}
+
+//------------------------------------------------------------------------------
+
+void scoreCandidates(const ScoringKernel kernel, const CandidateColumns& candidates, const t_size count, float* ratings)
+{
+	t_size numScored = 0;
+
+#if PFC_HAVE_CPUID
+	switch(kernel)
+	{
+		case ScoringKernel::AVX2:
+		{
+			numScored = scoreCandidatesAVX2(candidates, count, ratings);
+			break;
+		}
+
+		case ScoringKernel::SSE2:
+		{
+			numScored = scoreCandidatesSSE2(candidates, count, ratings);
+			break;
+		}
+
+		default:
+		{
+			break;
+		}
+	}
+#else
+	(void)kernel;
+#endif
+
+	// Whatever's left over that doesn't fill a whole vector.
+	scoreCandidatesScalar(candidates, numScored, count, ratings);
+}
+
+//------------------------------------------------------------------------------
+
+void scoreCandidates(const CandidateColumns& candidates, const t_size count, float* ratings)
+{
+	scoreCandidates(getBestScoringKernel(), candidates, count, ratings);
+}
+
+//------------------------------------------------------------------------------
+
+t_size pickBestCandidate(const float* ratings, const t_size count)
+{
+	t_size bestIndex = pfc_infinite;
+	float bestRating = std::numeric_limits<float>::min();
+
+	for(t_size index = 0; index < count; ++index)
+	{
+		if(ratings[index] >= 0.0f && ratings[index] > bestRating)
+		{
+			bestRating = ratings[index];
+			bestIndex = index;
+		}
+	}
+
+	return bestIndex;
+}
+
+//------------------------------------------------------------------------------
+
+} // namespace bestversion
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "FoobarSDKWrapper.h"
+
+namespace bestversion {
+
+// The rating features of a batch of candidates, gathered into contiguous arrays with one element per candidate.
+struct CandidateColumns
+{
+	const float* rateable;				// 1.0f if the candidate can be picked at all, 0.0f if not.
+	const float* titleRatings;
+	const float* playCounts;
+	const float* bitrates;
+	const float* releaseTypeRatings;	// Before weighting.
+	const float* albumArtistRatings;	// Before weighting.
+};
+
+enum class ScoringKernel
+{
+	Scalar,
+	SSE2,
+	AVX2,
+};
+
+// The fastest kernel this CPU supports; worked out once and then cached.
+ScoringKernel getBestScoringKernel();
+
+const char* getScoringKernelName(ScoringKernel kernel);
+
+// Writes the ratings of count candidates to ratings, 4 or 8 at a time where the kernel allows.
+// All kernels give exactly the same results as each other and as calculateTrackRating.
+void scoreCandidates(ScoringKernel kernel, const CandidateColumns& candidates, t_size count, float* ratings);
+void scoreCandidates(const CandidateColumns& candidates, t_size count, float* ratings);
+
+// Index of the best candidate: the first with the highest rating that isn't negative. pfc_infinite if there isn't one.
+t_size pickBestCandidate(const float* ratings, t_size count);
+
+} // namespace bestversion
@@ -0,0 +1,167 @@
+#include "StringPool.h"
+
+#include <cstring>
+
+namespace {
+
+//------------------------------------------------------------------------------
+
+const size_t initialNumSlots = 1024;
+
+//------------------------------------------------------------------------------
+
+} // anonymous namespace
+
+namespace bestversion {
+
+//------------------------------------------------------------------------------
+
+const t_uint32 StringPool::noId;
+
+//------------------------------------------------------------------------------
+
+StringPool::StringPool()
+	: slots(initialNumSlots, noId)
+{
+}
+
+//------------------------------------------------------------------------------
+
+t_uint32 StringPool::intern(const std::string& str)
+{
+	const t_uint32 strHash = hash(str.c_str(), str.size());
+	const size_t slot = findSlot(str.c_str(), str.size(), strHash);
+
+	if(slots[slot] != noId)
+	{
+		return slots[slot];
+	}
+
+	const t_uint32 id = static_cast<t_uint32>(offsets.size());
+
+	offsets.push_back(static_cast<t_uint32>(arena.size()));
+	hashes.push_back(strHash);
+	arena.insert(arena.end(), str.c_str(), str.c_str() + str.size() + 1);
+
+	slots[slot] = id;
+
+	if(offsets.size() * 2 > slots.size())
+	{
+		grow();
+	}
+
+	return id;
+}
+
+//------------------------------------------------------------------------------
+
+t_uint32 StringPool::find(const std::string& str) const
+{
+	return slots[findSlot(str.c_str(), str.size(), hash(str.c_str(), str.size()))];
+}
+
+//------------------------------------------------------------------------------
+
+const char* StringPool::get(const t_uint32 id) const
+{
+	return arena.data() + offsets[id];
+}
+
+//------------------------------------------------------------------------------
+
+t_size StringPool::getCount() const
+{
+	return offsets.size();
+}
+
+//------------------------------------------------------------------------------
+
+StringPool StringPool::compact(const std::vector<bool>& keep, std::vector<t_uint32>& newIds) const
+{
+	StringPool pool;
+	newIds.assign(offsets.size(), noId);
+
+	for(t_uint32 id = 0; id < offsets.size(); ++id)
+	{
+		if(keep[id])
+		{
+			newIds[id] = pool.intern(get(id));
+		}
+	}
+
+	return pool;
+}
+
+//------------------------------------------------------------------------------
+
+size_t StringPool::getMemoryUsage() const
+{
+	return arena.capacity() + (offsets.capacity() + hashes.capacity() + slots.capacity()) * sizeof(t_uint32);
+}
+
+//------------------------------------------------------------------------------
+
+t_uint32 StringPool::hash(const char* str, const size_t length)
+{
+	// FNV-1a.
+	t_uint32 strHash = 2166136261u;
+
+	for(size_t index = 0; index < length; ++index)
+	{
+		strHash ^= static_cast<unsigned char>(str[index]);
+		strHash *= 16777619u;
+	}
+
+	return strHash;
+}
+
+//------------------------------------------------------------------------------
+
+size_t StringPool::findSlot(const char* str, const size_t length, const t_uint32 strHash) const
+{
+	const size_t mask = slots.size() - 1;
+
+	for(size_t slot = strHash & mask; ; slot = (slot + 1) & mask)
+	{
+		const t_uint32 id = slots[slot];
+		if(id == noId)
+		{
+			return slot;
+		}
+
+		if(hashes[id] != strHash)
+		{
+			continue;
+		}
+
+		const char* pooled = arena.data() + offsets[id];
+		if(strncmp(pooled, str, length) == 0 && pooled[length] == '\0')
+		{
+			return slot;
+		}
+	}
+}
+
+//------------------------------------------------------------------------------
+
+void StringPool::grow()
+{
+	slots.assign(slots.size() * 2, noId);
+
+	const size_t mask = slots.size() - 1;
+
+	for(t_uint32 id = 0; id < offsets.size(); ++id)
+	{
+		size_t slot = hashes[id] & mask;
+		while(slots[slot] != noId)
+		{
+			slot = (slot + 1) & mask;
+		}
+
+		slots[slot] = id;
+	}
+}
+
+//------------------------------------------------------------------------------
+
+} // namespace bestversion
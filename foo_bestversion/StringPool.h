@@ -0,0 +1,53 @@
+#pragma once
+
+#include "FoobarSDKWrapper.h"
+
+#include <string>
+#include <vector>
+
+namespace bestversion {
+
+// Gives each distinct string a 32-bit ID and keeps a single copy of it in one contiguous arena, so strings that come up
+// over and over, like artist names and titles, cost four bytes a time and can be compared as integers.
+// Strings aren't removed one at a time; whoever owns the pool makes a compacted copy once enough of them have gone out of use.
+// Not thread-safe; whoever owns the pool has to guard it like the rest of their state.
+class StringPool
+{
+public:
+	static const t_uint32 noId = ~static_cast<t_uint32>(0);
+
+	StringPool();
+
+	// The ID of the string, adding it if it's not already in the pool.
+	t_uint32 intern(const std::string& str);
+
+	// The ID of the string, or noId if it's not in the pool.
+	t_uint32 find(const std::string& str) const;
+
+	// Valid until the next call to intern.
+	const char* get(t_uint32 id) const;
+
+	t_size getCount() const;
+
+	// A pool of only the strings marked in keep, which is by ID. newIds is filled in with the ID each string has in the new pool,
+	// or noId if it was left out.
+	StringPool compact(const std::vector<bool>& keep, std::vector<t_uint32>& newIds) const;
+
+	// Bytes allocated for the strings and the table that finds them.
+	size_t getMemoryUsage() const;
+
+private:
+	static t_uint32 hash(const char* str, size_t length);
+
+	// The slot the string is in, or the empty slot it would go in.
+	size_t findSlot(const char* str, size_t length, t_uint32 strHash) const;
+
+	void grow();
+
+	std::vector<char> arena;			// Every string, one after another, each with its terminator.
+	std::vector<t_uint32> offsets;		// By ID; where each string starts in arena.
+	std::vector<t_uint32> hashes;		// By ID.
+	std::vector<t_uint32> slots;		// An open-addressed hash table of IDs; a power of two in size, never more than half full.
+};
+
+} // namespace bestversion
@@ -0,0 +1,526 @@
+#include "SyntheticLibrary.h"
+
+#ifdef BESTVERSION_BENCHMARKS
+
+#include "ToString.h"
+
+#include <cstdio>
+#include <random>
+#include <unordered_set>
+
+namespace {
+
+//------------------------------------------------------------------------------
+
+// Deterministic on every platform, unlike the standard distributions.
+class Random
+{
+public:
+	explicit Random(const t_uint32 seed)
+		: engine(seed)
+	{
+	}
+
+	// Between 0 and 1, excluding 1.
+	float getFloat()
+	{
+		return static_cast<float>(engine() >> 8) * (1.0f / 16777216.0f);
+	}
+
+	bool getChance(const float probability)
+	{
+		return getFloat() < probability;
+	}
+
+	t_uint32 getInt(const t_uint32 max)
+	{
+		return engine() % max;
+	}
+
+private:
+	std::mt19937 engine;
+};
+
+//------------------------------------------------------------------------------
+
+class SyntheticTrackInfo : public metadb_info_container
+{
+public:
+	SyntheticTrackInfo()
+		: fileStats(filestats_invalid)
+	{
+	}
+
+	virtual file_info const& info() { return fileInfo; }
+	virtual t_filestats const& stats() { return fileStats; }
+	virtual bool isInfoPartial() { return false; }
+
+	file_info_impl fileInfo;
+	t_filestats fileStats;
+};
+
+//------------------------------------------------------------------------------
+
+// A track with info but no file. Only the calls the matching and rating code make are supported.
+class SyntheticTrack : public metadb_handle
+{
+public:
+	SyntheticTrack(const char* path, const metadb_info_container::ptr& info_)
+		: location(path, 0)
+		, info(info_)
+	{
+	}
+
+	virtual const playable_location& get_location() const { return location; }
+
+	virtual bool format_title(titleformat_hook*, pfc::string_base&, const service_ptr_t<titleformat_object>&, titleformat_text_filter*) { throw pfc::exception_not_implemented(); }
+	virtual void metadb_lock() {}
+	virtual void metadb_unlock() {}
+
+	virtual t_filestats get_filestats() const { return filestats_invalid; }
+
+	virtual bool is_info_loaded() const { return true; }
+	virtual bool get_info(file_info& p_info) const { p_info = info->info(); return true; }
+	virtual bool get_info_locked(const file_info*& p_info) const { p_info = &info->info(); return true; }
+	virtual bool is_info_loaded_async() const { return true; }
+	virtual bool get_info_async(file_info& p_info) const { return get_info(p_info); }
+	virtual bool get_info_async_locked(const file_info*& p_info) const { return get_info_locked(p_info); }
+
+	virtual void format_title_from_external_info(const file_info&, titleformat_hook*, pfc::string_base&, const service_ptr_t<titleformat_object>&, titleformat_text_filter*) { throw pfc::exception_not_implemented(); }
+	virtual bool format_title_nonlocking(titleformat_hook*, pfc::string_base&, const service_ptr_t<titleformat_object>&, titleformat_text_filter*) { throw pfc::exception_not_implemented(); }
+	virtual void format_title_from_external_info_nonlocking(const file_info&, titleformat_hook*, pfc::string_base&, const service_ptr_t<titleformat_object>&, titleformat_text_filter*) { throw pfc::exception_not_implemented(); }
+
+	virtual bool get_browse_info(file_info&, t_filetimestamp&) const { return false; }
+	virtual bool get_browse_info_locked(const file_info*&, t_filetimestamp&) const { return false; }
+
+	virtual bool get_info_ref(metadb_info_container::ptr& outInfo) const { outInfo = info; return true; }
+	virtual bool get_async_info_ref(metadb_info_container::ptr& outInfo) const { outInfo = info; return true; }
+	virtual void get_browse_info_ref(metadb_info_container::ptr& outInfo, metadb_info_container::ptr& outBrowse) const { outInfo = info; outBrowse.release(); }
+	virtual metadb_info_container::ptr get_info_ref() const { return info; }
+	virtual metadb_info_container::ptr get_async_info_ref() const { return info; }
+
+private:
+	playable_location_impl location;
+	metadb_info_container::ptr info;
+};
+
+//------------------------------------------------------------------------------
+
+// What the versions of each title are called. The first is the plain title; the rest are what turns up in real libraries.
+const char* const titleVariations[] =
+{
+	"%s",
+	"%s (Live)",
+	"%s (Remastered 2011)",
+	"%s - Radio Edit",
+	"%s [Demo]",
+	"%s!",
+};
+
+// Which of the variations are recordings of their own; the rest are the plain title's recording, remastered or mistagged.
+const bool titleVariationIsRecording[] =
+{
+	true,
+	true,
+	false,
+	true,
+	true,
+	false,
+};
+static_assert(sizeof(titleVariationIsRecording) / sizeof(titleVariationIsRecording[0]) == sizeof(titleVariations) / sizeof(titleVariations[0]), "Missing title variation");
+
+// What each release type is tagged as; Unset leaves the tag out.
+const char* const releaseTypeTags[] =
+{
+	nullptr,
+	"album",
+	"single",
+	"compilation",
+	"ep",
+	"soundtrack",
+	"live",
+	"other",
+	"remix",
+	"bootleg",
+};
+static_assert(sizeof(releaseTypeTags) / sizeof(releaseTypeTags[0]) == static_cast<size_t>(bestversion::ReleaseType::MAX), "Missing release type tag");
+
+//------------------------------------------------------------------------------
+
+const char* pickReleaseTypeTag(const bestversion::SyntheticLibrarySettings& settings, Random& random)
+{
+	float totalWeight = 0.0f;
+	for(const float weight : settings.releaseTypeWeights)
+	{
+		totalWeight += weight;
+	}
+
+	float choice = random.getFloat() * totalWeight;
+
+	for(size_t index = 0; index < static_cast<size_t>(bestversion::ReleaseType::MAX); ++index)
+	{
+		choice -= settings.releaseTypeWeights[index];
+		if(choice < 0.0f)
+		{
+			return releaseTypeTags[index];
+		}
+	}
+
+	return nullptr;
+}
+
+//------------------------------------------------------------------------------
+
+std::string getTitleVariation(const std::string& title, const t_size version)
+{
+	const size_t numVariations = sizeof(titleVariations) / sizeof(titleVariations[0]);
+	const std::string variation = titleVariations[version % numVariations];
+
+	std::string variedTitle = variation.substr(0, variation.find("%s")) + title + variation.substr(variation.find("%s") + 2);
+
+	// Past the first round of variations, mess with the case as well.
+	if(version >= numVariations)
+	{
+		for(auto& c : variedTitle)
+		{
+			c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+		}
+	}
+
+	return variedTitle;
+}
+
+//------------------------------------------------------------------------------
+
+// A made-up MusicBrainz ID, the same for the same numbers every time. Artists have no title.
+std::string getSyntheticMBID(const t_size artistIndex, const t_size titleIndex, const t_size variation)
+{
+	char mbid[40];
+	snprintf(
+		mbid,
+		sizeof(mbid),
+		"%08x-%04x-4000-8000-%012x",
+		static_cast<unsigned int>(artistIndex + 1),
+		static_cast<unsigned int>(variation),
+		static_cast<unsigned int>(titleIndex)
+	);
+
+	return mbid;
+}
+
+//------------------------------------------------------------------------------
+
+std::string getSyntheticRecordingMBID(const t_size artistIndex, const t_size titleIndex, const t_size version)
+{
+	const size_t numVariations = sizeof(titleVariations) / sizeof(titleVariations[0]);
+	const size_t variation = version % numVariations;
+
+	return getSyntheticMBID(artistIndex, titleIndex + 1, titleVariationIsRecording[variation] ? variation : 0);
+}
+
+//------------------------------------------------------------------------------
+
+} // anonymous namespace
+
+namespace bestversion {
+
+//------------------------------------------------------------------------------
+
+SyntheticLibrarySettings getDefaultSyntheticLibrarySettings()
+{
+	// Roughly the shape of a real library: mostly albums, a fair few compilations and live albums, and patchy tagging.
+	const SyntheticLibrarySettings settings =
+	{
+		1,
+		200,
+		50,
+		3,
+		0.3f,
+		{
+			2.0f,	// Unset
+			10.0f,	// Album
+			2.0f,	// Single
+			3.0f,	// Compilation
+			1.0f,	// EP
+			0.5f,	// Soundtrack
+			2.0f,	// Live
+			0.5f,	// Other
+			0.5f,	// Remix
+			0.2f,	// Unrecognised
+		}
+	};
+
+	return settings;
+}
+
+//------------------------------------------------------------------------------
+
+SyntheticLibrarySettings getLargeSyntheticLibrarySettings()
+{
+	SyntheticLibrarySettings settings = getDefaultSyntheticLibrarySettings();
+	settings.numArtists = 2000;
+	settings.numVersionsPerTitle = 4;
+
+	return settings;
+}
+
+//------------------------------------------------------------------------------
+
+metadb_handle_list generateSyntheticLibrary(const SyntheticLibrarySettings& settings)
+{
+	Random random(settings.seed);
+
+	metadb_handle_list tracks;
+	tracks.prealloc(settings.numArtists * settings.numTitlesPerArtist * settings.numVersionsPerTitle);
+
+	for(t_size artistIndex = 0; artistIndex < settings.numArtists; ++artistIndex)
+	{
+		const std::string artist = "Artist " + to_string(artistIndex + 1);
+
+		for(t_size titleIndex = 0; titleIndex < settings.numTitlesPerArtist; ++titleIndex)
+		{
+			const std::string title = "Title " + to_string(titleIndex + 1);
+
+			for(t_size version = 0; version < settings.numVersionsPerTitle; ++version)
+			{
+				service_ptr_t<SyntheticTrackInfo> info = new service_impl_t<SyntheticTrackInfo>();
+				file_info& fileInfo = info->fileInfo;
+
+				fileInfo.meta_set("artist", artist.c_str());
+				fileInfo.meta_set("title", getTitleVariation(title, version).c_str());
+				fileInfo.meta_set("musicbrainz_artistid", getSyntheticMBID(artistIndex, 0, 0).c_str());
+				fileInfo.meta_set("musicbrainz_trackid", getSyntheticRecordingMBID(artistIndex, titleIndex, version).c_str());
+				fileInfo.info_set_bitrate(128 + 32 * random.getInt(7));
+
+				if(!random.getChance(settings.tagSparsity))
+				{
+					const bool isCompilation = random.getChance(0.2f);
+					fileInfo.meta_set("album artist", isCompilation ? "Various Artists" : artist.c_str());
+				}
+
+				if(!random.getChance(settings.tagSparsity))
+				{
+					const char* releaseType = pickReleaseTypeTag(settings, random);
+					if(releaseType != nullptr)
+					{
+						fileInfo.meta_set("releasetype", releaseType);
+					}
+				}
+
+				if(!random.getChance(settings.tagSparsity))
+				{
+					fileInfo.meta_set("PLAY_COUNTER", to_string(random.getInt(50)).c_str());
+				}
+
+				const std::string path = "synthetic://" + artist + "/" + to_string(version + 1) + "/" + title;
+
+				tracks.add_item(new service_impl_t<SyntheticTrack>(path.c_str(), info));
+			}
+		}
+	}
+
+	return tracks;
+}
+
+//------------------------------------------------------------------------------
+
+std::string generateSyntheticTopTracks(const std::string& artist, const t_size artistIndex, const t_size numTracks)
+{
+	std::string json = "{\"toptracks\":{\"track\":[";
+
+	for(t_size index = 0; index < numTracks; ++index)
+	{
+		if(index > 0)
+		{
+			json += ",";
+		}
+
+		json += "{\"name\":\"Title " + to_string(index + 1) + "\",";
+		json += "\"playcount\":\"" + to_string((numTracks - index) * 1000) + "\",";
+		json += "\"mbid\":\"" + getSyntheticRecordingMBID(artistIndex, index, 0) + "\",";
+		json += "\"artist\":{\"name\":\"" + artist + "\",\"mbid\":\"" + getSyntheticMBID(artistIndex, 0, 0) + "\"}}";
+	}
+
+	json += "],\"@attr\":{\"artist\":\"" + artist + "\",\"page\":\"1\"}}}";
+
+	return json;
+}
+
+//------------------------------------------------------------------------------
+
+std::string generateSyntheticSimilarTracks(const t_size numArtists, const t_size numTracks)
+{
+	std::string json = "{\"similartracks\":{\"track\":[";
+
+	for(t_size index = 0; index < numTracks; ++index)
+	{
+		if(index > 0)
+		{
+			json += ",";
+		}
+
+		json += "{\"name\":\"Title " + to_string(index + 1) + "\",";
+		json += "\"playcount\":" + to_string((numTracks - index) * 100) + ",";
+		json += "\"mbid\":\"" + getSyntheticRecordingMBID(index % numArtists, index, 0) + "\",";
+		json += "\"match\":" + to_string(1.0 - static_cast<double>(index) / numTracks) + ",";
+		json += "\"artist\":{\"name\":\"Artist " + to_string(index % numArtists + 1) + "\",\"mbid\":\"" + getSyntheticMBID(index % numArtists, 0, 0) + "\"}}";
+	}
+
+	json += "],\"@attr\":{\"artist\":\"Artist 1\"}}}";
+
+	return json;
+}
+
+//------------------------------------------------------------------------------
+
+std::string generateSyntheticXspf(const SyntheticLibrarySettings& settings, const t_size numTracks)
+{
+	std::string xspf = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<playlist version=\"1\" xmlns=\"http://xspf.org/ns/0/\">\n<trackList>\n";
+
+	for(t_size index = 0; index < numTracks; ++index)
+	{
+		// Walk through the artists and titles so the same few come up again and again, as they do in real playlists,
+		// with one title in ten that's not in the library at all.
+		const t_size artist = index % settings.numArtists + 1;
+		const t_size title = index % 10 == 9 ? settings.numTitlesPerArtist + index : (index / settings.numArtists) % settings.numTitlesPerArtist + 1;
+
+		xspf += "<track><location>file:///C:/Music/Artist%20" + to_string(artist) + "/Title%20" + to_string(title) + ".mp3</location>";
+		xspf += "<creator>Artist " + to_string(artist) + "</creator>";
+		xspf += "<title>Title " + to_string(title) + "</title></track>\n";
+	}
+
+	xspf += "</trackList>\n</playlist>\n";
+
+	return xspf;
+}
+
+//------------------------------------------------------------------------------
+
+std::string generateSyntheticTrackList(const SyntheticLibrarySettings& settings, const t_size numLines)
+{
+	std::string text;
+
+	for(t_size index = 0; index < numLines; ++index)
+	{
+		const std::string artist = "Artist " + to_string(index % settings.numArtists + 1);
+		const std::string title = "Title " + to_string((index / settings.numArtists) % settings.numTitlesPerArtist + 1);
+
+		// Every format the parser understands, and the odd line it doesn't.
+		const t_size format = index % 5;
+
+		if(format == 0)
+		{
+			text += to_string(index + 1) + ". " + artist + " - " + title;
+		}
+		else if(format == 1)
+		{
+			text += "\"" + title + "\" by " + artist;
+		}
+		else if(format == 2)
+		{
+			text += to_string(index + 1) + "\t" + artist + "\t" + title;
+		}
+		else if(format == 3)
+		{
+			text += artist + " \xE2\x80\x93 " + title;
+		}
+		else if(index % 20 == 4)
+		{
+			text += "Now playing on the radio:";
+		}
+		else
+		{
+			text += "#" + to_string(index + 1) + " " + artist + " - " + title;
+		}
+
+		text += "\r\n";
+	}
+
+	return text;
+}
+
+//------------------------------------------------------------------------------
+
+CandidateColumns SyntheticCandidates::getColumns() const
+{
+	const CandidateColumns columns =
+	{
+		rateable.data(),
+		titleRatings.data(),
+		playCounts.data(),
+		bitrates.data(),
+		releaseTypeRatings.data(),
+		albumArtistRatings.data(),
+	};
+
+	return columns;
+}
+
+//------------------------------------------------------------------------------
+
+SyntheticCandidates generateSyntheticCandidates(const t_uint32 seed, const t_size count)
+{
+	Random random(seed);
+
+	SyntheticCandidates candidates;
+
+	for(t_size index = 0; index < count; ++index)
+	{
+		candidates.rateable.push_back(random.getChance(0.9f) ? 1.0f : 0.0f);
+
+		// An exact match, one with brackets, or neither, less any qualifier penalty.
+		candidates.titleRatings.push_back(static_cast<float>(random.getInt(3)) - 0.25f * static_cast<float>(random.getInt(3)));
+
+		// Some past the top of the range they're mapped from.
+		candidates.playCounts.push_back(static_cast<float>(random.getInt(50)));
+		candidates.bitrates.push_back(static_cast<float>(128 + 32 * random.getInt(40)));
+
+		candidates.releaseTypeRatings.push_back(random.getFloat());
+		candidates.albumArtistRatings.push_back(random.getFloat());
+	}
+
+	return candidates;
+}
+
+//------------------------------------------------------------------------------
+
+std::vector<std::string> generateSyntheticTitles(const t_uint32 seed, const t_size count)
+{
+	static const char* const words[] =
+	{
+		"love", "night", "heart", "time", "never", "the", "of", "in", "my", "you", "baby", "dance", "dream", "fire", "girl", "home",
+		"light", "blue", "rain", "road", "summer", "tonight", "forever", "river", "stars", "world", "down", "away", "crazy", "sweet",
+		"little", "running", "wild", "together", "yesterday", "morning", "city", "angel", "thunder", "street",
+	};
+	static const t_uint32 numWords = sizeof(words) / sizeof(words[0]);
+
+	Random random(seed);
+
+	std::vector<std::string> titles;
+	std::unordered_set<std::string> seen;
+
+	while(titles.size() < count)
+	{
+		std::string title = words[random.getInt(numWords)];
+
+		const t_uint32 numMoreWords = random.getInt(4);
+		for(t_uint32 index = 0; index < numMoreWords; ++index)
+		{
+			title += ' ';
+			title += words[random.getInt(numWords)];
+		}
+
+		if(seen.insert(title).second)
+		{
+			titles.push_back(title);
+		}
+	}
+
+	return titles;
+}
+
+//------------------------------------------------------------------------------
+
+} // namespace bestversion
+
+#endif
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "FoobarSDKWrapper.h"
+
+#include "RatingFeatures.h"
+#include "ScoringKernels.h"
+
+#include <string>
+#include <vector>
+
+// Only built when BESTVERSION_BENCHMARKS is defined (the Benchmark configuration), for the checks and benchmarks; release builds have no fake tracks.
+#ifdef BESTVERSION_BENCHMARKS
+
+namespace bestversion {
+
+struct SyntheticLibrarySettings
+{
+	t_uint32 seed;					// The same seed always gives the same library.
+	t_size numArtists;
+	t_size numTitlesPerArtist;
+	t_size numVersionsPerTitle;		// How many tracks share each artist and title, e.g. album, single and live versions.
+	float tagSparsity;				// The chance of each optional tag (album artist, release type, play count) being left out, 0 to 1.
+	float releaseTypeWeights[static_cast<size_t>(ReleaseType::MAX)];	// How often each release type turns up, relative to the others.
+};
+
+// 30000 tracks: 200 artists, 50 titles each, 3 versions of each.
+SyntheticLibrarySettings getDefaultSyntheticLibrarySettings();
+
+// The same shape, but 400000 tracks, like the biggest libraries out there: 2000 artists, 50 titles each, 4 versions of each.
+SyntheticLibrarySettings getLargeSyntheticLibrarySettings();
+
+// Makes up a library of tracks that aren't backed by any files, so the matching and rating code can be timed
+// against a library of any size and shape. The tracks only have the tags and info that code reads.
+// Artists are named "Artist <n>" and titles "Title <n>"; some versions get punctuation, case and bracket variations.
+// Every track has MusicBrainz artist and recording IDs, shared by the versions that are the same recording.
+metadb_handle_list generateSyntheticLibrary(const SyntheticLibrarySettings& settings);
+
+// A last.fm artist.getTopTracks response for one of the synthetic library's artists, with numTracks tracks.
+// artistIndex is one less than the number in the artist's name, for their MusicBrainz IDs.
+std::string generateSyntheticTopTracks(const std::string& artist, t_size artistIndex, t_size numTracks);
+
+// A last.fm track.getSimilar response naming numTracks tracks by the synthetic library's artists, with their MusicBrainz IDs.
+std::string generateSyntheticSimilarTracks(t_size numArtists, t_size numTracks);
+
+// An XSPF playlist of numTracks tracks by the synthetic library's artists, mostly of titles that are in it.
+std::string generateSyntheticXspf(const SyntheticLibrarySettings& settings, t_size numTracks);
+
+// A pasted track list of numLines lines by the synthetic library's artists, in every format parseTrackList understands.
+std::string generateSyntheticTrackList(const SyntheticLibrarySettings& settings, t_size numLines);
+
+// Made-up rating features of a batch of candidates, as the scoring kernels take them; a few of them can't be picked.
+struct SyntheticCandidates
+{
+	std::vector<float> rateable;
+	std::vector<float> titleRatings;
+	std::vector<float> playCounts;
+	std::vector<float> bitrates;
+	std::vector<float> releaseTypeRatings;
+	std::vector<float> albumArtistRatings;
+
+	CandidateColumns getColumns() const;
+};
+
+SyntheticCandidates generateSyntheticCandidates(t_uint32 seed, t_size count);
+
+// count different made-up titles of one to four words, like "never love the night", already normalised with simplifyTitle.
+// Unlike the synthetic library's, they're made of a small set of words, so plenty of them share words and trigrams as real titles do.
+std::vector<std::string> generateSyntheticTitles(t_uint32 seed, t_size count);
+
+} // namespace bestversion
+
+#endif
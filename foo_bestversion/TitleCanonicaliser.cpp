@@ -0,0 +1,354 @@
+#include "TitleCanonicaliser.h"
+
+#include <cstring>
+#include <vector>
+
+namespace {
+
+using namespace bestversion;
+
+//------------------------------------------------------------------------------
+
+// Every qualifier keyword is plain ASCII, so only ASCII needs lowering to look for them. Unlike foldCase, this keeps
+// every character the same length, so positions in the lowered title are positions in the title.
+std::string lowerAscii(const std::string& str)
+{
+	std::string lower(str);
+
+	for(auto& c : lower)
+	{
+		if(c >= 'A' && c <= 'Z')
+		{
+			c = static_cast<char>(c - 'A' + 'a');
+		}
+	}
+
+	return lower;
+}
+
+//------------------------------------------------------------------------------
+
+bool isWordCharacter(const char c)
+{
+	// Anything outside ASCII counts, so accented letters don't split a word.
+	return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || static_cast<unsigned char>(c) >= 0x80;
+}
+
+//------------------------------------------------------------------------------
+
+// Whether the lowered text has a word starting with the given prefix, e.g. "remaster" in "2011 remastered version".
+bool hasWordStartingWith(const std::string& text, const char* prefix)
+{
+	for(size_t pos = text.find(prefix); pos != std::string::npos; pos = text.find(prefix, pos + 1))
+	{
+		if(pos == 0 || !isWordCharacter(text[pos - 1]))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+//------------------------------------------------------------------------------
+
+bool hasWord(const std::string& text, const char* word)
+{
+	const size_t length = strlen(word);
+
+	for(size_t pos = text.find(word); pos != std::string::npos; pos = text.find(word, pos + 1))
+	{
+		const bool startsWord = pos == 0 || !isWordCharacter(text[pos - 1]);
+		const bool endsWord = pos + length == text.size() || !isWordCharacter(text[pos + length]);
+
+		if(startsWord && endsWord)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+//------------------------------------------------------------------------------
+
+bool startsWithWord(const std::string& text, const char* word)
+{
+	const size_t length = strlen(word);
+	return text.compare(0, length, word) == 0 && (length == text.size() || !isWordCharacter(text[length]));
+}
+
+//------------------------------------------------------------------------------
+
+// The qualifiers in some lowered text from the end of a title. Anything in brackets is a qualifier of some sort,
+// but a dash suffix has to be one as a whole (see isQualifierSuffix), or it's probably part of the title, like "Part 1 - The Beginning".
+t_uint16 parseQualifiers(const std::string& text, const bool bracketed)
+{
+	t_uint16 qualifiers = 0;
+
+	if(startsWithWord(text, "feat") || startsWithWord(text, "ft") || startsWithWord(text, "featuring") || startsWithWord(text, "with"))
+	{
+		qualifiers |= TitleQualifier::Featuring;
+	}
+
+	if(hasWord(text, "live"))
+	{
+		qualifiers |= TitleQualifier::Live;
+	}
+
+	if(hasWordStartingWith(text, "remaster"))
+	{
+		qualifiers |= TitleQualifier::Remastered;
+	}
+
+	if(hasWordStartingWith(text, "remix") || hasWord(text, "mix"))
+	{
+		qualifiers |= TitleQualifier::Remix;
+	}
+
+	if(hasWord(text, "edit"))
+	{
+		qualifiers |= TitleQualifier::Edit;
+	}
+
+	if(hasWord(text, "acoustic") || hasWord(text, "unplugged"))
+	{
+		qualifiers |= TitleQualifier::Acoustic;
+	}
+
+	if(hasWord(text, "demo"))
+	{
+		qualifiers |= TitleQualifier::Demo;
+	}
+
+	if(hasWord(text, "instrumental"))
+	{
+		qualifiers |= TitleQualifier::Instrumental;
+	}
+
+	if(qualifiers == 0 && (bracketed || hasWord(text, "version") || hasWord(text, "mono") || hasWord(text, "stereo")))
+	{
+		qualifiers |= TitleQualifier::Other;
+	}
+
+	return qualifiers;
+}
+
+//------------------------------------------------------------------------------
+
+// The words of some lowered text, leaving off any numbers at the end, e.g. the year of "Remastered 2009".
+std::vector<std::string> getWordsBeforeNumbers(const std::string& text)
+{
+	std::vector<std::string> words;
+
+	for(size_t pos = 0; pos < text.size(); )
+	{
+		if(!isWordCharacter(text[pos]))
+		{
+			++pos;
+			continue;
+		}
+
+		const size_t start = pos;
+		while(pos < text.size() && isWordCharacter(text[pos]))
+		{
+			++pos;
+		}
+
+		words.push_back(text.substr(start, pos - start));
+	}
+
+	while(!words.empty() && words.back().find_first_not_of("0123456789") == std::string::npos)
+	{
+		words.pop_back();
+	}
+
+	return words;
+}
+
+//------------------------------------------------------------------------------
+
+// Whether a dash suffix is a qualifier as a whole, like "Live", "Live at Wembley", "Radio Edit" or "2011 Remaster",
+// rather than just having a qualifier word somewhere in it, like "Live Forever".
+bool isQualifierSuffix(const std::string& text)
+{
+	static const char* const lastWords[] = {
+		"remix", "mix", "edit", "acoustic", "unplugged", "demo", "instrumental", "remaster", "remastered", "version", "mono", "stereo"
+	};
+	static const char* const wordsAfterLive[] = { "at", "from", "in", "on" };
+
+	if(startsWithWord(text, "feat") || startsWithWord(text, "ft") || startsWithWord(text, "featuring"))
+	{
+		return true;
+	}
+
+	const std::vector<std::string> words = getWordsBeforeNumbers(text);
+	if(words.empty())
+	{
+		return false;
+	}
+
+	if(words[0] == "live")
+	{
+		if(words.size() == 1)
+		{
+			return true;
+		}
+
+		for(const char* word : wordsAfterLive)
+		{
+			if(words[1] == word)
+			{
+				return true;
+			}
+		}
+	}
+
+	for(const char* word : lastWords)
+	{
+		if(words.back() == word)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+//------------------------------------------------------------------------------
+
+// Where the title ends once the whitespace before end is left off.
+size_t trimEnd(const std::string& title, size_t end)
+{
+	while(end > 0 && (title[end - 1] == ' ' || title[end - 1] == '\t'))
+	{
+		--end;
+	}
+
+	return end;
+}
+
+//------------------------------------------------------------------------------
+
+// The position of the bracket that the one at closePos closes, allowing for nested brackets; npos if there isn't one.
+size_t findOpeningBracket(const std::string& title, const size_t closePos)
+{
+	const char close = title[closePos];
+	const char open = close == ')' ? '(' : '[';
+
+	size_t depth = 0;
+
+	for(size_t pos = closePos; pos-- > 0; )
+	{
+		if(title[pos] == close)
+		{
+			++depth;
+		}
+		else if(title[pos] == open)
+		{
+			if(depth == 0)
+			{
+				return pos;
+			}
+
+			--depth;
+		}
+	}
+
+	return std::string::npos;
+}
+
+//------------------------------------------------------------------------------
+
+// The position of the last " feat. " or the like that starts before end; npos if there isn't one.
+size_t findFeaturing(const std::string& lowerTitle, const size_t end)
+{
+	static const char* const separators[] = { " feat. ", " feat ", " ft. ", " featuring " };
+
+	size_t featuringPos = std::string::npos;
+
+	for(const char* separator : separators)
+	{
+		// There has to be someone after it.
+		const size_t pos = lowerTitle.rfind(separator, end);
+		if(pos != std::string::npos && pos + strlen(separator) < end && (featuringPos == std::string::npos || pos > featuringPos))
+		{
+			featuringPos = pos;
+		}
+	}
+
+	return featuringPos;
+}
+
+//------------------------------------------------------------------------------
+
+} // anonymous namespace
+
+namespace bestversion {
+
+//------------------------------------------------------------------------------
+
+CanonicalTitle canonicaliseTitle(const std::string& title)
+{
+	CanonicalTitle canonical = { std::string(), 0 };
+
+	const std::string lowerTitle = lowerAscii(title);
+	size_t end = trimEnd(title, title.size());
+
+	// Take qualifiers off the end one at a time, e.g. "Song - Radio Edit (feat. Someone) [Remastered]" takes three goes.
+	while(end > 0)
+	{
+		t_uint16 qualifiers = 0;
+		size_t qualifierPos = std::string::npos;
+
+		if(title[end - 1] == ')' || title[end - 1] == ']')
+		{
+			const size_t openPos = findOpeningBracket(title, end - 1);
+			if(openPos != std::string::npos)
+			{
+				qualifiers = parseQualifiers(lowerTitle.substr(openPos + 1, end - openPos - 2), true);
+				qualifierPos = openPos;
+			}
+		}
+		else
+		{
+			const size_t dashPos = end >= 3 ? lowerTitle.rfind(" - ", end - 3) : std::string::npos;
+			if(dashPos != std::string::npos)
+			{
+				const std::string suffix = lowerTitle.substr(dashPos + 3, end - dashPos - 3);
+				if(isQualifierSuffix(suffix))
+				{
+					qualifiers = parseQualifiers(suffix, false);
+					qualifierPos = dashPos;
+				}
+			}
+
+			if(qualifiers == 0)
+			{
+				qualifierPos = findFeaturing(lowerTitle, end);
+				if(qualifierPos != std::string::npos)
+				{
+					qualifiers = TitleQualifier::Featuring;
+				}
+			}
+		}
+
+		// There has to be something left; a title that's all in brackets is just a title.
+		const size_t newEnd = qualifiers != 0 ? trimEnd(title, qualifierPos) : 0;
+		if(newEnd == 0)
+		{
+			break;
+		}
+
+		canonical.qualifiers |= qualifiers;
+		end = newEnd;
+	}
+
+	canonical.base = title.substr(0, end);
+
+	return canonical;
+}
+
+//------------------------------------------------------------------------------
+
+} // namespace bestversion
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "FoobarSDKWrapper.h"
+
+#include <string>
+
+namespace bestversion {
+
+// What the qualifiers on the end of a title say about the recording. Flags; a title can have several, e.g. "(Live) [Remastered 2011]".
+namespace TitleQualifier
+{
+	enum Flags : t_uint16
+	{
+		Live			= 1 << 0,
+		Remastered		= 1 << 1,
+		Remix			= 1 << 2,	// Including other mixes, e.g. "Extended Mix".
+		Edit			= 1 << 3,	// "Radio Edit", "Single Edit" and the like.
+		Featuring		= 1 << 4,
+		Acoustic		= 1 << 5,
+		Demo			= 1 << 6,
+		Instrumental	= 1 << 7,
+		Other			= 1 << 8,	// Something in brackets that isn't any of the above.
+	};
+}
+
+struct CanonicalTitle
+{
+	std::string base;		// The title with its qualifiers taken off, e.g. "Heroes" for "Heroes (Live) [Remastered 2017]".
+	t_uint16 qualifiers;	// TitleQualifier flags.
+};
+
+// Splits a title into its base and qualifiers. Qualifiers are whatever's in brackets at the end of the title, suffixes like
+// " - Radio Edit" or " - 2011 Remaster" and a trailing "feat. X". A dash suffix that isn't a known qualifier is part of the title,
+// as is a title in brackets, like "(I Can't Get No) Satisfaction", and brackets in the middle of a title.
+CanonicalTitle canonicaliseTitle(const std::string& title);
+
+} // namespace bestversion
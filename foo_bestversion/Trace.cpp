@@ -0,0 +1,405 @@
+#include "Trace.h"
+
+#include "Component.h"
+#include "ToString.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+using namespace bestversion;
+
+//------------------------------------------------------------------------------
+
+static const GUID tracingBranchGUID = { 0xd1c80929, 0x5f1d, 0x4d60, { 0xbc, 0x6f, 0xad, 0x6e, 0x3d, 0xf6, 0x0e, 0x3c } };
+static const GUID recordTracesGUID = { 0x1c781ca8, 0x094e, 0x41e4, { 0x8a, 0xee, 0xb2, 0x2c, 0x3b, 0x20, 0xde, 0x97 } };
+
+static advconfig_branch_factory tracingBranch(COMPONENT_NAME ": tracing", tracingBranchGUID, advconfig_entry::guid_branch_tools, 0);
+static advconfig_checkbox_factory recordTraces("Save a trace of each job to the profile directory", recordTracesGUID, tracingBranchGUID, 0, false);
+
+//------------------------------------------------------------------------------
+
+static const t_uint64 notStarted = ~static_cast<t_uint64>(0);
+static const size_t numCounters = static_cast<size_t>(TraceCounter::MAX);
+
+static const char* const counterNames[] =
+{
+	"picks",
+	"candidates",
+	"track ratings",
+	"MusicBrainz ID matches",
+};
+static_assert(sizeof(counterNames) / sizeof(counterNames[0]) == numCounters, "Missing trace counter name");
+
+//------------------------------------------------------------------------------
+
+struct TraceEvent
+{
+	const char* name;
+	t_uint64 start;
+	t_uint64 duration;
+};
+
+struct JobEvent
+{
+	std::string name;
+	t_uint64 start;
+	t_uint64 duration;
+};
+
+// What one thread has recorded. Only that thread adds to it, so its lock is only contended while the trace is being written out.
+struct ThreadBuffer
+{
+	explicit ThreadBuffer(const t_uint32 threadId_)
+		: threadId(threadId_)
+		, threadEnded(false)
+	{
+		for(auto& counter : counters)
+		{
+			counter.store(0, std::memory_order_relaxed);
+		}
+	}
+
+	const t_uint32 threadId;
+	std::mutex mutex;
+	std::vector<TraceEvent> events;
+	std::atomic<t_uint64> counters[numCounters];
+	std::atomic<bool> threadEnded;	// Jobs' own threads come and go, so their buffers are let go once they've been written out.
+};
+
+// Lets the buffer know when its thread's gone.
+struct ThreadBufferHolder
+{
+	~ThreadBufferHolder()
+	{
+		if(buffer != nullptr)
+		{
+			buffer->threadEnded = true;
+		}
+	}
+
+	std::shared_ptr<ThreadBuffer> buffer;
+};
+
+struct TraceSession
+{
+	TraceSession()
+		: nextThreadId(1)
+		, mainThreadId(0)
+		, numJobsRunning(0)
+		, start(0)
+	{
+	}
+
+	std::mutex mutex;
+	std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+	t_uint32 nextThreadId;
+	t_uint32 mainThreadId;
+	std::vector<JobEvent> jobs;
+	t_size numJobsRunning;
+	t_uint64 start;
+};
+
+//------------------------------------------------------------------------------
+
+std::atomic<bool> tracing(false);
+
+thread_local ThreadBufferHolder threadBufferHolder;
+
+//------------------------------------------------------------------------------
+
+TraceSession& getTraceSession()
+{
+	static TraceSession session;
+	return session;
+}
+
+//------------------------------------------------------------------------------
+
+// Microseconds since some fixed point.
+t_uint64 now()
+{
+	return static_cast<t_uint64>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+//------------------------------------------------------------------------------
+
+ThreadBuffer& getThreadBuffer()
+{
+	if(threadBufferHolder.buffer == nullptr)
+	{
+		TraceSession& session = getTraceSession();
+		std::lock_guard<std::mutex> lock(session.mutex);
+
+		threadBufferHolder.buffer = std::make_shared<ThreadBuffer>(session.nextThreadId++);
+		session.buffers.push_back(threadBufferHolder.buffer);
+	}
+
+	return *threadBufferHolder.buffer;
+}
+
+//------------------------------------------------------------------------------
+
+std::string escapeJson(const std::string& str)
+{
+	static const char hexDigits[] = "0123456789abcdef";
+
+	std::string escaped;
+	escaped.reserve(str.size());
+
+	for(const char c : str)
+	{
+		if(c == '"' || c == '\\')
+		{
+			escaped += '\\';
+			escaped += c;
+		}
+		else if(static_cast<unsigned char>(c) < 0x20)
+		{
+			escaped += "\\u00";
+			escaped += hexDigits[c >> 4];
+			escaped += hexDigits[c & 0xf];
+		}
+		else
+		{
+			escaped += c;
+		}
+	}
+
+	return escaped;
+}
+
+//------------------------------------------------------------------------------
+
+void appendEvent(std::string& json, const std::string& name, const t_uint64 start, const t_uint64 duration, const t_uint32 threadId)
+{
+	json += ",\n{\"name\":\"" + escapeJson(name) + "\",\"ph\":\"X\",\"ts\":" + to_string(start) + ",\"dur\":" + to_string(duration) +
+		",\"pid\":1,\"tid\":" + to_string(threadId) + "}";
+}
+
+//------------------------------------------------------------------------------
+
+void appendCounters(std::string& json, const t_uint64 timestamp, const t_uint64 (&counters)[numCounters])
+{
+	json += ",\n{\"name\":\"" COMPONENT_NAME "\",\"ph\":\"C\",\"ts\":" + to_string(timestamp) + ",\"pid\":1,\"args\":{";
+
+	for(size_t counter = 0; counter < numCounters; ++counter)
+	{
+		json += std::string(counter > 0 ? "," : "") + "\"" + counterNames[counter] + "\":" + to_string(counters[counter]);
+	}
+
+	json += "}}";
+}
+
+//------------------------------------------------------------------------------
+
+// Takes everything recorded out of the session, as the contents of a trace file, with times from the start of the session.
+// The session's lock must be held.
+std::string takeTrace(TraceSession& session, const t_uint64 end)
+{
+	std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	json += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + to_string(session.mainThreadId) + ",\"args\":{\"name\":\"Main thread\"}}";
+
+	for(const auto& job : session.jobs)
+	{
+		appendEvent(json, job.name, job.start - session.start, job.duration, session.mainThreadId);
+	}
+
+	session.jobs.clear();
+
+	t_uint64 counters[numCounters] = {};
+
+	for(const auto& buffer : session.buffers)
+	{
+		std::vector<TraceEvent> events;
+
+		{
+			std::lock_guard<std::mutex> lock(buffer->mutex);
+			events.swap(buffer->events);
+		}
+
+		for(const auto& event : events)
+		{
+			// Anything that started before the session did is left over from the last one.
+			if(event.start >= session.start)
+			{
+				appendEvent(json, event.name, event.start - session.start, event.duration, buffer->threadId);
+			}
+		}
+
+		for(size_t counter = 0; counter < numCounters; ++counter)
+		{
+			counters[counter] += buffer->counters[counter].exchange(0, std::memory_order_relaxed);
+		}
+	}
+
+	const t_uint64 noCounts[numCounters] = {};
+	appendCounters(json, 0, noCounts);
+	appendCounters(json, end - session.start, counters);
+
+	json += "\n]}\n";
+
+	session.buffers.erase(
+		std::remove_if(session.buffers.begin(), session.buffers.end(), [](const std::shared_ptr<ThreadBuffer>& buffer) { return buffer->threadEnded.load(); }),
+		session.buffers.end()
+	);
+
+	return json;
+}
+
+//------------------------------------------------------------------------------
+
+void writeTrace(const std::string& json, const std::string& jobName)
+{
+	const pfc::string8 path = core_api::pathInProfile(("foo_bestversion-trace-" + to_string(std::time(nullptr)) + ".json").c_str());
+
+	try
+	{
+		abort_callback_dummy abort;
+
+		file::ptr traceFile;
+		filesystem::g_open_write_new(traceFile, path.get_ptr(), abort);
+		traceFile->write_object(json.data(), json.size(), abort);
+
+		console::printf(COMPONENT_NAME ": saved a trace of %s to %s", jobName.c_str(), path.get_ptr());
+	}
+	catch(const std::exception& e)
+	{
+		console::printf(COMPONENT_NAME ": couldn't save the trace: %s", e.what());
+	}
+}
+
+//------------------------------------------------------------------------------
+
+} // anonymous namespace
+
+namespace bestversion {
+
+//------------------------------------------------------------------------------
+
+bool isTracing()
+{
+	return tracing.load(std::memory_order_relaxed);
+}
+
+//------------------------------------------------------------------------------
+
+void countTrace(const TraceCounter counter, const t_uint64 amount)
+{
+	if(isTracing())
+	{
+		getThreadBuffer().counters[static_cast<size_t>(counter)].fetch_add(amount, std::memory_order_relaxed);
+	}
+}
+
+//------------------------------------------------------------------------------
+
+JobTrace::JobTrace(const std::string& name_)
+	: name(name_)
+	, start(0)
+	, recording(false)
+{
+}
+
+//------------------------------------------------------------------------------
+
+void JobTrace::begin()
+{
+	if(!recordTraces.get())
+	{
+		return;
+	}
+
+	const t_uint32 threadId = getThreadBuffer().threadId;
+
+	TraceSession& session = getTraceSession();
+	std::lock_guard<std::mutex> lock(session.mutex);
+
+	// Jobs that overlap share a session, which is written out when the last of them ends.
+	if(session.numJobsRunning++ == 0)
+	{
+		session.start = now();
+		session.mainThreadId = threadId;
+
+		for(const auto& buffer : session.buffers)
+		{
+			for(auto& counter : buffer->counters)
+			{
+				counter.store(0, std::memory_order_relaxed);
+			}
+		}
+
+		tracing = true;
+	}
+
+	recording = true;
+	start = now();
+}
+
+//------------------------------------------------------------------------------
+
+void JobTrace::end()
+{
+	if(!recording)
+	{
+		return;
+	}
+
+	recording = false;
+
+	const t_uint64 end = now();
+	const JobEvent job = { name, start, end - start };
+
+	std::string json;
+
+	{
+		TraceSession& session = getTraceSession();
+		std::lock_guard<std::mutex> lock(session.mutex);
+
+		session.jobs.push_back(job);
+
+		if(--session.numJobsRunning > 0)
+		{
+			return;
+		}
+
+		tracing = false;
+		json = takeTrace(session, end);
+	}
+
+	writeTrace(json, name);
+}
+
+//------------------------------------------------------------------------------
+
+TraceScope::TraceScope(const char* name_)
+	: name(name_)
+	, start(isTracing() ? now() : notStarted)
+{
+}
+
+//------------------------------------------------------------------------------
+
+TraceScope::~TraceScope()
+{
+	if(start == notStarted)
+	{
+		return;
+	}
+
+	const TraceEvent event = { name, start, now() - start };
+
+	ThreadBuffer& buffer = getThreadBuffer();
+	std::lock_guard<std::mutex> lock(buffer.mutex);
+	buffer.events.push_back(event);
+}
+
+//------------------------------------------------------------------------------
+
+} // namespace bestversion
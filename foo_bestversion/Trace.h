@@ -0,0 +1,58 @@
+#pragma once
+
+#include "FoobarSDKWrapper.h"
+
+#include <string>
+
+namespace bestversion {
+
+// Counted on every call while a trace is being recorded, and written out with it.
+enum class TraceCounter
+{
+	Picks,			// pickBestTrack calls.
+	Candidates,		// Candidates pickBestTrack picked from.
+	TrackRatings,	// calculateTrackRating calls, i.e. candidates rated from their tags rather than from the library index.
+	MBIDMatches,	// Tracks found by their MusicBrainz recording ID rather than their names.
+
+	MAX
+};
+
+// Whether a trace is being recorded. Cheap; any thread.
+bool isTracing();
+
+void countTrace(TraceCounter counter, t_uint64 amount = 1);
+
+// Records a job, from on_init to on_done, if tracing's switched on in advanced preferences. Once the last job being traced has ended,
+// the phases and counters recorded on every thread are written to the profile directory as Chrome trace-event JSON,
+// for chrome://tracing or ui.perfetto.dev to show. Main thread only.
+class JobTrace
+{
+public:
+	explicit JobTrace(const std::string& name);
+
+	void begin();
+	void end();
+
+private:
+	std::string name;
+	t_uint64 start;
+	bool recording;
+};
+
+// Records the time until the end of the scope as a phase of the trace, if one's being recorded. Any thread.
+// Only the pointer to the name is kept, so it has to be a string literal.
+class TraceScope
+{
+public:
+	explicit TraceScope(const char* name);
+	~TraceScope();
+
+private:
+	TraceScope(const TraceScope&) = delete;
+	TraceScope& operator=(const TraceScope&) = delete;
+
+	const char* name;
+	t_uint64 start;
+};
+
+} // namespace bestversion
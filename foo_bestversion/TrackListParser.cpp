@@ -0,0 +1,487 @@
+#include "TrackListParser.h"
+
+#include "BestVersionMemo.h"
+#include "LibraryIndex.h"
+#include "Log.h"
+#include "PlaylistGenerator.h"
+#include "ToString.h"
+
+#include <cstring>
+#include <memory>
+#include <unordered_set>
+
+namespace {
+
+using namespace bestversion;
+
+//------------------------------------------------------------------------------
+
+const char byteOrderMark[] = "\xEF\xBB\xBF";
+const char enDash[] = "\xE2\x80\x93";
+const char emDash[] = "\xE2\x80\x94";
+const char leftDoubleQuote[] = "\xE2\x80\x9C";
+const char rightDoubleQuote[] = "\xE2\x80\x9D";
+
+//------------------------------------------------------------------------------
+
+bool isSpace(const char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+//------------------------------------------------------------------------------
+
+bool isDigit(const char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+//------------------------------------------------------------------------------
+
+void trim(const char*& begin, const char*& end)
+{
+	while(begin < end && isSpace(*begin))
+	{
+		++begin;
+	}
+
+	while(end > begin && isSpace(end[-1]))
+	{
+		--end;
+	}
+}
+
+//------------------------------------------------------------------------------
+
+// Whether the text at c, which ends at end, starts with the given string.
+bool startsWith(const char* c, const char* end, const char* str, const size_t length)
+{
+	return static_cast<size_t>(end - c) >= length && memcmp(c, str, length) == 0;
+}
+
+//------------------------------------------------------------------------------
+
+// Whether the text at c starts with " by ", in any case.
+bool startsWithBy(const char* c, const char* end)
+{
+	return end - c >= 4 && c[0] == ' ' && (c[1] == 'b' || c[1] == 'B') && (c[2] == 'y' || c[2] == 'Y') && c[3] == ' ';
+}
+
+//------------------------------------------------------------------------------
+
+// Skips numbering like "1. ", "01) ", "3: " or "#12 " at the start of a line.
+// A bare number isn't numbering, as it could be the start of an artist's name, like "10 Years - Wasteland".
+const char* skipNumbering(const char* begin, const char* end)
+{
+	static const ptrdiff_t maxDigits = 4;
+
+	const char* c = begin;
+	const bool hasHash = c < end && *c == '#';
+
+	if(hasHash)
+	{
+		++c;
+	}
+
+	const char* digitsBegin = c;
+	while(c < end && c - digitsBegin < maxDigits && isDigit(*c))
+	{
+		++c;
+	}
+
+	if(c == digitsBegin)
+	{
+		return begin;
+	}
+
+	if(c < end && (*c == '.' || *c == ')' || *c == ':'))
+	{
+		++c;
+	}
+	else if(!hasHash)
+	{
+		return begin;
+	}
+
+	// Otherwise it's something like "2.0" or "1:23".
+	if(c == end || *c != ' ')
+	{
+		return begin;
+	}
+
+	return c;
+}
+
+//------------------------------------------------------------------------------
+
+void stripQuotes(const char*& begin, const char*& end)
+{
+	const size_t curlyQuoteLength = sizeof(leftDoubleQuote) - 1;
+
+	if(end - begin >= 2 && *begin == '"' && end[-1] == '"')
+	{
+		++begin;
+		--end;
+	}
+	else if(static_cast<size_t>(end - begin) >= 2 * curlyQuoteLength && startsWith(begin, end, leftDoubleQuote, curlyQuoteLength) && startsWith(end - curlyQuoteLength, end, rightDoubleQuote, curlyQuoteLength))
+	{
+		begin += curlyQuoteLength;
+		end -= curlyQuoteLength;
+	}
+}
+
+//------------------------------------------------------------------------------
+
+bool isNumberField(const char* begin, const char* end)
+{
+	if(end > begin && end[-1] == '.')
+	{
+		--end;
+	}
+
+	if(begin == end)
+	{
+		return false;
+	}
+
+	for(const char* c = begin; c < end; ++c)
+	{
+		if(!isDigit(*c))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+//------------------------------------------------------------------------------
+
+// The first two fields that aren't empty or a number.
+bool splitTabSeparatedLine(const char* begin, const char* end, std::string& artist, std::string& title)
+{
+	std::string* fields[] = { &artist, &title };
+	size_t numFields = 0;
+
+	const char* fieldBegin = begin;
+
+	while(fieldBegin <= end && numFields < 2)
+	{
+		const char* fieldEnd = static_cast<const char*>(memchr(fieldBegin, '\t', end - fieldBegin));
+		if(fieldEnd == nullptr)
+		{
+			fieldEnd = end;
+		}
+
+		const char* nextFieldBegin = fieldEnd + 1;
+
+		trim(fieldBegin, fieldEnd);
+
+		if(fieldBegin < fieldEnd && !isNumberField(fieldBegin, fieldEnd))
+		{
+			fields[numFields++]->assign(fieldBegin, fieldEnd);
+		}
+
+		fieldBegin = nextFieldBegin;
+	}
+
+	return numFields == 2;
+}
+
+//------------------------------------------------------------------------------
+
+bool parseLine(const char* begin, const char* end, TrackName& track)
+{
+	begin = skipNumbering(begin, end);
+	trim(begin, end);
+
+	// Find where every kind of separator is in one go, then use the most specific one.
+	const char* tab = nullptr;
+	const char* dash = nullptr;
+	size_t dashLength = 0;
+	const char* by = nullptr;
+
+	for(const char* c = begin; c < end; ++c)
+	{
+		if(*c == '\t')
+		{
+			if(tab == nullptr)
+			{
+				tab = c;
+			}
+		}
+		else if(*c == ' ')
+		{
+			if(dash == nullptr)
+			{
+				if(startsWith(c, end, " - ", 3))
+				{
+					dash = c;
+					dashLength = 3;
+				}
+				else if(startsWith(c + 1, end, enDash, 3) || startsWith(c + 1, end, emDash, 3))
+				{
+					if(startsWith(c + 4, end, " ", 1))
+					{
+						dash = c;
+						dashLength = 5;
+					}
+				}
+			}
+
+			// The last one, so "Stand by Me by Ben E. King" splits in the right place.
+			if(startsWithBy(c, end))
+			{
+				by = c;
+			}
+		}
+	}
+
+	if(tab != nullptr)
+	{
+		if(!splitTabSeparatedLine(begin, end, track.artist, track.title))
+		{
+			return false;
+		}
+	}
+	else if(dash != nullptr)
+	{
+		track.artist.assign(begin, dash);
+		track.title.assign(dash + dashLength, end);
+	}
+	else if(by != nullptr)
+	{
+		track.title.assign(begin, by);
+		track.artist.assign(by + 4, end);
+	}
+	else
+	{
+		return false;
+	}
+
+	const char* titleBegin = track.title.data();
+	const char* titleEnd = titleBegin + track.title.size();
+	trim(titleBegin, titleEnd);
+	stripQuotes(titleBegin, titleEnd);
+	trim(titleBegin, titleEnd);
+	track.title = std::string(titleBegin, titleEnd);
+
+	const char* artistBegin = track.artist.data();
+	const char* artistEnd = artistBegin + track.artist.size();
+	trim(artistBegin, artistEnd);
+	track.artist = std::string(artistBegin, artistEnd);
+
+	return !track.artist.empty() && !track.title.empty();
+}
+
+//------------------------------------------------------------------------------
+
+class TrackListPlaylistGenerator : public threaded_process_callback
+{
+private:
+	std::string text;
+	pfc::list_t<metadb_handle_ptr> tracks;
+	bool success;
+
+public:
+	TrackListPlaylistGenerator(const std::string& text_)
+		: text(text_)
+		, success(false)
+	{
+	}
+
+	virtual void run(threaded_process_status& p_status, abort_callback& p_abort)
+	{
+		try
+		{
+			const std::shared_ptr<const LibrarySnapshot> library = getLibraryIndex().getBuiltSnapshot(p_abort);
+
+			p_status.set_item("Reading track list...");
+			p_status.set_progress_float(0.0f);
+
+			std::vector<TrackName> names;
+			t_size numUnrecognisedLines = 0;
+			parseTrackList(text, names, numUnrecognisedLines);
+
+			p_abort.check();
+			p_status.set_item("Searching library for best versions of tracks...");
+
+			std::vector<metadb_handle_ptr> bestVersions;
+			findBestVersions(
+				*library,
+				names,
+				bestVersions,
+				[&](t_size numDone, t_size total)
+				{
+					p_status.set_progress(numDone, total);
+				},
+				p_abort
+			);
+
+			// The same track could be in the list more than once.
+			std::unordered_set<const metadb_handle*> added;
+
+			for(const auto& bestVersion : bestVersions)
+			{
+				if(bestVersion != nullptr && added.insert(bestVersion.get_ptr()).second)
+				{
+					tracks.add_item(bestVersion);
+				}
+			}
+
+			log(
+				LogLevel::Info,
+				"Read " + to_string(names.size()) + " tracks from the track list, and found " + to_string(tracks.get_count()) +
+				" of them in the library; " + to_string(numUnrecognisedLines) + " lines weren't recognised"
+			);
+
+			if(tracks.get_count() == 0)
+			{
+				throw pfc::exception("Did not find enough tracks to make a playlist");
+			}
+
+			success = true;
+			p_abort.check();
+		}
+		catch(exception_aborted&)
+		{
+			success = false;
+		}
+	}
+
+	virtual void on_done(HWND /*p_wnd*/, bool /*p_was_aborted*/)
+	{
+		flushLog();
+		logBestVersionMemoStats();
+
+		if(!success)
+		{
+			return;
+		}
+
+		generatePlaylistFromTracks(tracks, "Pasted track list");
+	}
+};
+
+//------------------------------------------------------------------------------
+
+class TrackListMenuCommands : public mainmenu_commands
+{
+public:
+	virtual t_uint32 get_command_count()
+	{
+		return 1;
+	}
+
+	virtual GUID get_command(t_uint32 /*p_index*/)
+	{
+		// {29D8A340-8592-4851-BDA6-C03E643E4901}
+		static const GUID generateTrackListPlaylistGUID = { 0x29d8a340, 0x8592, 0x4851, { 0xbd, 0xa6, 0xc0, 0x3e, 0x64, 0x3e, 0x49, 0x01 } };
+		return generateTrackListPlaylistGUID;
+	}
+
+	virtual void get_name(t_uint32 /*p_index*/, pfc::string_base& p_out)
+	{
+		p_out = "Make playlist from track list in clipboard";
+	}
+
+	virtual bool get_description(t_uint32 /*p_index*/, pfc::string_base& p_out)
+	{
+		p_out = "Makes a playlist of the best versions of the tracks listed in the clipboard, one per line, e.g. \"Artist - Title\".";
+		return true;
+	}
+
+	virtual GUID get_parent()
+	{
+		return mainmenu_groups::library;
+	}
+
+	virtual void execute(t_uint32 /*p_index*/, service_ptr_t<service_base> /*p_callback*/)
+	{
+		pfc::string8 text;
+
+		if(!uGetClipboardString(text) || text.is_empty())
+		{
+			console::error("There's no text in the clipboard to make a playlist from");
+			return;
+		}
+
+		generateTrackListPlaylist(text.get_ptr());
+	}
+};
+
+static mainmenu_commands_factory_t<TrackListMenuCommands> trackListMenuCommandsFactory;
+
+//------------------------------------------------------------------------------
+
+} // anonymous namespace
+
+namespace bestversion {
+
+//------------------------------------------------------------------------------
+
+void parseTrackList(const std::string& text, std::vector<TrackName>& tracks, t_size& numUnrecognisedLines)
+{
+	const char* c = text.data();
+	const char* const end = c + text.size();
+
+	if(startsWith(c, end, byteOrderMark, sizeof(byteOrderMark) - 1))
+	{
+		c += sizeof(byteOrderMark) - 1;
+	}
+
+	TrackName track;
+
+	while(c < end)
+	{
+		const char* lineEnd = static_cast<const char*>(memchr(c, '\n', end - c));
+		if(lineEnd == nullptr)
+		{
+			lineEnd = end;
+		}
+
+		const char* lineBegin = c;
+		const char* trimmedLineEnd = lineEnd;
+		trim(lineBegin, trimmedLineEnd);
+
+		if(lineBegin < trimmedLineEnd)
+		{
+			if(parseLine(lineBegin, trimmedLineEnd, track))
+			{
+				tracks.push_back(track);
+			}
+			else
+			{
+				++numUnrecognisedLines;
+			}
+		}
+
+		c = lineEnd + 1;
+	}
+}
+
+//------------------------------------------------------------------------------
+
+void generateTrackListPlaylist(const std::string& text)
+{
+	const auto title = std::string("Generating playlist from track list");
+
+	console::print(title.c_str());
+
+	// New this up since it's going to live on another thread, which will delete it when it's ready.
+	auto generator = new service_impl_t<TrackListPlaylistGenerator>(text);
+
+	static_api_ptr_t<threaded_process> tp;
+
+	tp->run_modeless(
+		generator,
+		tp->flag_show_abort | tp->flag_show_item | tp->flag_show_progress,
+		core_api::get_main_window(),
+		title.c_str(),
+		pfc_infinite
+	);
+}
+
+//------------------------------------------------------------------------------
+
+} // namespace bestversion
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "FoobarSDKWrapper.h"
+
+#include "BestVersionSearch.h"
+
+#include <string>
+#include <vector>
+
+namespace bestversion {
+
+// Reads a track list pasted from a chart or a blog, one track per line, in a single pass over the text.
+// Understands "Artist - Title" (with a hyphen, en dash or em dash), "Title by Artist" and tab-separated "Artist<tab>Title",
+// each optionally numbered ("1. ", "01) ", "#1: " or a column of numbers), with the title optionally in quotes.
+// Lines it can't make sense of are skipped and counted in numUnrecognisedLines.
+void parseTrackList(const std::string& text, std::vector<TrackName>& tracks, t_size& numUnrecognisedLines);
+
+// Makes a playlist of the best versions of the tracks in the list, as a background job.
+void generateTrackListPlaylist(const std::string& text);
+
+} // namespace bestversion
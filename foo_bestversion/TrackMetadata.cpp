@@ -0,0 +1,191 @@
+#include "TrackMetadata.h"
+
+#include <cstring>
+
+namespace {
+
+//------------------------------------------------------------------------------
+
+// A guess at the number of bytes of tags each track needs, folded copies and all, so the arena doesn't have to grow too often.
+const size_t expectedBytesPerTrack = 96;
+
+//------------------------------------------------------------------------------
+
+} // anonymous namespace
+
+namespace bestversion {
+
+//------------------------------------------------------------------------------
+
+TrackMetadata::TrackMetadata(metadb_handle_list_cref tracks)
+{
+	read(tracks, tracks.get_count());
+}
+
+//------------------------------------------------------------------------------
+
+TrackMetadata::TrackMetadata(metadb_handle_list_cref tracks, const t_size count)
+{
+	read(tracks, count < tracks.get_count() ? count : tracks.get_count());
+}
+
+//------------------------------------------------------------------------------
+
+t_size TrackMetadata::getCount() const
+{
+	return entries.size();
+}
+
+//------------------------------------------------------------------------------
+
+const char* TrackMetadata::getTitle(const t_size track) const
+{
+	return getString(entries[track].title.str);
+}
+
+//------------------------------------------------------------------------------
+
+const char* TrackMetadata::getMainArtist(const t_size track) const
+{
+	const Entry& entry = entries[track];
+
+	if(entry.numArtists + entry.numAlbumArtists == 0)
+	{
+		return nullptr;
+	}
+
+	return getString(values[entry.firstValue].str);
+}
+
+//------------------------------------------------------------------------------
+
+t_size TrackMetadata::getNumArtists(const t_size track) const
+{
+	return entries[track].numArtists;
+}
+
+//------------------------------------------------------------------------------
+
+const char* TrackMetadata::getArtist(const t_size track, const t_size index) const
+{
+	return getString(values[entries[track].firstValue + index].str);
+}
+
+//------------------------------------------------------------------------------
+
+t_size TrackMetadata::getNumAlbumArtists(const t_size track) const
+{
+	return entries[track].numAlbumArtists;
+}
+
+//------------------------------------------------------------------------------
+
+const char* TrackMetadata::getAlbumArtist(const t_size track, const t_size index) const
+{
+	const Entry& entry = entries[track];
+	return getString(values[entry.firstValue + entry.numArtists + index].str);
+}
+
+//------------------------------------------------------------------------------
+
+FoldedString TrackMetadata::getFoldedTitle(const t_size track) const
+{
+	return getFoldedString(entries[track].title);
+}
+
+//------------------------------------------------------------------------------
+
+FoldedString TrackMetadata::getFoldedArtist(const t_size track, const t_size index) const
+{
+	return getFoldedString(values[entries[track].firstValue + index]);
+}
+
+//------------------------------------------------------------------------------
+
+FoldedString TrackMetadata::getFoldedAlbumArtist(const t_size track, const t_size index) const
+{
+	const Entry& entry = entries[track];
+	return getFoldedString(values[entry.firstValue + entry.numArtists + index]);
+}
+
+//------------------------------------------------------------------------------
+
+void TrackMetadata::read(metadb_handle_list_cref tracks, const t_size count)
+{
+	entries.reserve(count);
+	values.reserve(count);
+	arena.reserve(count * expectedBytesPerTrack);
+
+	std::string folded;
+
+	for(t_size index = 0; index < count; ++index)
+	{
+		Entry entry = { { noString, noString, 0 }, static_cast<t_uint32>(values.size()), 0, 0 };
+
+		service_ptr_t<metadb_info_container> outInfo;
+		if(tracks[index]->get_async_info_ref(outInfo))
+		{
+			const file_info& fileInfo = outInfo->info();
+
+			if(fileInfo.meta_exists("title"))
+			{
+				entry.title = addValue(fileInfo.meta_get("title", 0), folded);
+			}
+
+			entry.numArtists = static_cast<t_uint32>(fileInfo.meta_get_count_by_name("artist"));
+			for(t_size artist = 0; artist < entry.numArtists; ++artist)
+			{
+				values.push_back(addValue(fileInfo.meta_get("artist", artist), folded));
+			}
+
+			entry.numAlbumArtists = static_cast<t_uint32>(fileInfo.meta_get_count_by_name("album artist"));
+			for(t_size albumArtist = 0; albumArtist < entry.numAlbumArtists; ++albumArtist)
+			{
+				values.push_back(addValue(fileInfo.meta_get("album artist", albumArtist), folded));
+			}
+		}
+
+		entries.push_back(entry);
+	}
+}
+
+//------------------------------------------------------------------------------
+
+TrackMetadata::Value TrackMetadata::addValue(const char* str, std::string& folded)
+{
+	foldCase(str, folded);
+
+	Value value;
+	value.str = addString(str, strlen(str));
+	value.folded = addString(folded.c_str(), folded.size());
+	value.foldedLength = static_cast<t_uint32>(folded.size());
+	return value;
+}
+
+//------------------------------------------------------------------------------
+
+t_uint32 TrackMetadata::addString(const char* str, const size_t length)
+{
+	const t_uint32 offset = static_cast<t_uint32>(arena.size());
+	arena.insert(arena.end(), str, str + length + 1);
+	return offset;
+}
+
+//------------------------------------------------------------------------------
+
+const char* TrackMetadata::getString(const t_uint32 offset) const
+{
+	return offset != noString ? arena.data() + offset : nullptr;
+}
+
+//------------------------------------------------------------------------------
+
+FoldedString TrackMetadata::getFoldedString(const Value& value) const
+{
+	const FoldedString folded = { getString(value.folded), value.foldedLength };
+	return folded;
+}
+
+//------------------------------------------------------------------------------
+
+} // namespace bestversion
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "FoobarSDKWrapper.h"
+#include "Normalise.h"
+
+#include <vector>
+
+namespace bestversion {
+
+// The tags the best version filters look at, read for a whole list of tracks in one pass: one info reference per track,
+// with every string copied into one arena. Nothing in it refers back to the metadb, so there's no lock to hold and the
+// strings stay valid for as long as the batch does, whatever happens to the tracks' tags in the meantime.
+// Each value is case-folded as it's read too, so the filters can compare it with what they're looking for as many times as they like.
+class TrackMetadata
+{
+public:
+	explicit TrackMetadata(metadb_handle_list_cref tracks);
+
+	// Only the first count tracks.
+	TrackMetadata(metadb_handle_list_cref tracks, t_size count);
+
+	t_size getCount() const;
+
+	// The first title tag, or null if the track hasn't got one, or any info at all.
+	const char* getTitle(t_size track) const;
+
+	// The first artist tag or, failing that, the first album artist tag; null if it has neither.
+	const char* getMainArtist(t_size track) const;
+
+	t_size getNumArtists(t_size track) const;
+	const char* getArtist(t_size track, t_size index) const;
+
+	t_size getNumAlbumArtists(t_size track) const;
+	const char* getAlbumArtist(t_size track, t_size index) const;
+
+	// The same values, run through foldCase. A missing title has a null string.
+	FoldedString getFoldedTitle(t_size track) const;
+	FoldedString getFoldedArtist(t_size track, t_size index) const;
+	FoldedString getFoldedAlbumArtist(t_size track, t_size index) const;
+
+private:
+	static const t_uint32 noString = ~static_cast<t_uint32>(0);
+
+	struct Value
+	{
+		t_uint32 str;				// Offset into arena.
+		t_uint32 folded;			// Likewise.
+		t_uint32 foldedLength;
+	};
+
+	struct Entry
+	{
+		Value title;
+		t_uint32 firstValue;		// Index into values of its first artist; its album artists follow them.
+		t_uint32 numArtists;
+		t_uint32 numAlbumArtists;
+	};
+
+	void read(metadb_handle_list_cref tracks, t_size count);
+	Value addValue(const char* str, std::string& folded);
+	t_uint32 addString(const char* str, size_t length);
+	const char* getString(t_uint32 offset) const;
+	FoldedString getFoldedString(const Value& value) const;
+
+	std::vector<char> arena;			// Every string, one after another, each with its terminator.
+	std::vector<Value> values;
+	std::vector<Entry> entries;
+};
+
+} // namespace bestversion
@@ -0,0 +1,622 @@
+#include "Xspf.h"
+
+#include "BestVersionSearch.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+//------------------------------------------------------------------------------
+
+// Once this much of the buffer has been read, it's thrown away rather than kept around.
+const size_t bufferCompactionThreshold = 64 * 1024;
+
+// Tracks are resolved and handed on this many at a time, so the first ones turn up before the whole file's been read.
+const size_t tracksPerBatch = 1000;
+
+//------------------------------------------------------------------------------
+
+bool isWhitespace(const char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+//------------------------------------------------------------------------------
+
+bool startsWith(const std::string& str, const size_t position, const char* prefix)
+{
+	return str.compare(position, strlen(prefix), prefix) == 0;
+}
+
+//------------------------------------------------------------------------------
+
+std::string trim(const std::string& str)
+{
+	size_t begin = 0;
+	size_t end = str.size();
+
+	while(begin < end && isWhitespace(str[begin]))
+	{
+		++begin;
+	}
+
+	while(end > begin && isWhitespace(str[end - 1]))
+	{
+		--end;
+	}
+
+	return str.substr(begin, end - begin);
+}
+
+//------------------------------------------------------------------------------
+
+// The name of the element a start or end tag is for, without its namespace prefix or attributes.
+std::string getElementName(const char* begin, const char* end)
+{
+	const char* nameEnd = begin;
+	while(nameEnd < end && !isWhitespace(*nameEnd) && *nameEnd != '/')
+	{
+		++nameEnd;
+	}
+
+	const char* nameBegin = begin;
+	for(const char* c = begin; c < nameEnd; ++c)
+	{
+		if(*c == ':')
+		{
+			nameBegin = c + 1;
+		}
+	}
+
+	return std::string(nameBegin, nameEnd);
+}
+
+//------------------------------------------------------------------------------
+
+// Appends the character an entity (without its & and ;) stands for, or the entity itself if it's not one we know.
+void appendEntity(const char* begin, const char* end, std::string& out)
+{
+	static const struct
+	{
+		const char* name;
+		char c;
+	} namedEntities[] =
+	{
+		{ "amp", '&' },
+		{ "lt", '<' },
+		{ "gt", '>' },
+		{ "quot", '"' },
+		{ "apos", '\'' },
+	};
+
+	const std::string name(begin, end);
+
+	for(const auto& namedEntity : namedEntities)
+	{
+		if(name == namedEntity.name)
+		{
+			out += namedEntity.c;
+			return;
+		}
+	}
+
+	if(name.size() > 1 && name[0] == '#')
+	{
+		const bool isHex = name[1] == 'x' || name[1] == 'X';
+		const unsigned c = strtoul(name.c_str() + (isHex ? 2 : 1), nullptr, isHex ? 16 : 10);
+
+		char encoded[8] = {};
+		const t_size length = pfc::utf8_encode_char(c, encoded);
+		if(c != 0 && length > 0)
+		{
+			out.append(encoded, length);
+			return;
+		}
+	}
+
+	out += '&';
+	out += name;
+	out += ';';
+}
+
+//------------------------------------------------------------------------------
+
+std::string decodePercentEscapes(const std::string& str)
+{
+	std::string decoded;
+	decoded.reserve(str.size());
+
+	for(size_t index = 0; index < str.size(); ++index)
+	{
+		if(str[index] == '%' && index + 2 < str.size() && isxdigit(static_cast<unsigned char>(str[index + 1])) && isxdigit(static_cast<unsigned char>(str[index + 2])))
+		{
+			decoded += static_cast<char>(strtoul(str.substr(index + 1, 2).c_str(), nullptr, 16));
+			index += 2;
+		}
+		else
+		{
+			decoded += str[index];
+		}
+	}
+
+	return decoded;
+}
+
+//------------------------------------------------------------------------------
+
+// Turns an XSPF location into a path foobar2000 understands. Local files are file:// URIs or relative to the playlist;
+// anything else (http and so on) is passed on as it is.
+std::string getPathFromLocation(const char* playlistPath, const std::string& location)
+{
+	static const char fileScheme[] = "file://";
+
+	std::string path;
+
+	if(location.compare(0, strlen(fileScheme), fileScheme) == 0)
+	{
+		path = decodePercentEscapes(location.substr(strlen(fileScheme)));
+
+		// Anything before the first slash is the host: file://server/share/... is the UNC path \\server\share\...,
+		// but file://localhost/... is just a local path.
+		static const char localhost[] = "localhost/";
+
+		if(!path.empty() && path[0] != '/')
+		{
+			if(pfc::stricmp_ascii(path.substr(0, strlen(localhost)).c_str(), localhost) == 0)
+			{
+				path.erase(0, strlen(localhost) - 1);
+			}
+			else
+			{
+				path.insert(0, "//");
+			}
+		}
+
+		// file:///C:/Music/... has a slash before the drive letter that's not part of the path.
+		if(path.size() > 2 && path[0] == '/' && path[2] == ':')
+		{
+			path.erase(0, 1);
+		}
+	}
+	else if(location.find("://") != std::string::npos)
+	{
+		return location;
+	}
+	else
+	{
+		path = std::string(pfc::string_directory(playlistPath).get_ptr()) + "\\" + decodePercentEscapes(location);
+	}
+
+	for(auto& c : path)
+	{
+		if(c == '/')
+		{
+			c = '\\';
+		}
+	}
+
+	pfc::string8 canonicalPath;
+	filesystem::g_get_canonical_path(path.c_str(), canonicalPath);
+	return canonicalPath.get_ptr();
+}
+
+//------------------------------------------------------------------------------
+
+class XspfPlaylistLoader : public playlist_loader
+{
+public:
+	virtual void open(const char* p_path, const service_ptr_t<file>& p_file, playlist_loader_callback::ptr p_callback, abort_callback& p_abort)
+	{
+		using namespace bestversion;
+
+		// Building the index on the main thread would hold the whole UI up, so there the tracks are only looked for in the library
+		// if it's already built; if it isn't, they're all loaded from their locations.
+		const std::shared_ptr<const LibrarySnapshot> library = core_api::is_main_thread() ? getLibraryIndex().getSnapshot() : getLibraryIndex().getBuiltSnapshot(p_abort);
+
+		std::vector<XspfTrack> batch;
+		std::vector<metadb_handle_ptr> bestVersions;
+		t_size numFromLibrary = 0;
+		t_size numFromLocation = 0;
+		t_size numNotFound = 0;
+
+		const auto flush = [&]()
+		{
+			p_callback->on_progress(p_path);
+
+			if(library != nullptr)
+			{
+				resolveXspfTracks(*library, batch, bestVersions, p_abort);
+			}
+			else
+			{
+				bestVersions.assign(batch.size(), metadb_handle_ptr());
+			}
+
+			for(size_t index = 0; index < batch.size(); ++index)
+			{
+				metadb_handle_ptr item = bestVersions[index];
+
+				if(item != nullptr)
+				{
+					++numFromLibrary;
+				}
+				else if(!batch[index].location.empty())
+				{
+					// Not in the library, but the playlist says where it was.
+					p_callback->handle_create(item, make_playable_location(getPathFromLocation(p_path, batch[index].location).c_str(), 0));
+					++numFromLocation;
+				}
+				else
+				{
+					++numNotFound;
+					continue;
+				}
+
+				p_callback->on_entry(item, playlist_loader_callback::entry_from_playlist, filestats_invalid, false);
+			}
+
+			batch.clear();
+		};
+
+		XspfReader reader([&](const XspfTrack& track)
+		{
+			batch.push_back(track);
+
+			if(batch.size() >= tracksPerBatch)
+			{
+				flush();
+			}
+		});
+
+		std::vector<char> chunk(64 * 1024);
+
+		for(;;)
+		{
+			const t_size numRead = p_file->read(chunk.data(), chunk.size(), p_abort);
+			if(numRead == 0)
+			{
+				break;
+			}
+
+			reader.feed(chunk.data(), numRead);
+		}
+
+		reader.finish();
+		flush();
+
+		console::printf(
+			"XSPF playlist %s: %u tracks, %u from the library, %u from their locations, %u not found",
+			p_path,
+			static_cast<unsigned int>(reader.getNumTracks()),
+			static_cast<unsigned int>(numFromLibrary),
+			static_cast<unsigned int>(numFromLocation),
+			static_cast<unsigned int>(numNotFound)
+		);
+	}
+
+	virtual void write(const char* /*p_path*/, const service_ptr_t<file>& /*p_file*/, metadb_handle_list_cref /*p_data*/, abort_callback& /*p_abort*/)
+	{
+		throw pfc::exception_not_implemented();
+	}
+
+	virtual const char* get_extension()
+	{
+		return "xspf";
+	}
+
+	virtual bool can_write()
+	{
+		return false;
+	}
+
+	virtual bool is_our_content_type(const char* p_content_type)
+	{
+		return strcmp(p_content_type, "application/xspf+xml") == 0;
+	}
+
+	virtual bool is_associatable()
+	{
+		return true;
+	}
+};
+
+//------------------------------------------------------------------------------
+
+static playlist_loader_factory_t<XspfPlaylistLoader> xspfPlaylistLoaderFactory;
+
+//------------------------------------------------------------------------------
+
+} // anonymous namespace
+
+namespace bestversion {
+
+//------------------------------------------------------------------------------
+
+XspfReader::XspfReader(const OnTrack& onTrack_)
+	: onTrack(onTrack_)
+	, position(0)
+	, field(nullptr)
+	, numTracks(0)
+{
+}
+
+//------------------------------------------------------------------------------
+
+void XspfReader::feed(const char* data, const size_t size)
+{
+	buffer.append(data, size);
+	parse(false);
+
+	if(position >= bufferCompactionThreshold)
+	{
+		buffer.erase(0, position);
+		position = 0;
+	}
+}
+
+//------------------------------------------------------------------------------
+
+void XspfReader::finish()
+{
+	parse(true);
+
+	if(elements.empty() && numTracks == 0 && position == 0)
+	{
+		throw exception_io_unsupported_format();
+	}
+
+	if(!elements.empty() || position != buffer.size())
+	{
+		throw exception_io_data("XSPF playlist is cut short");
+	}
+}
+
+//------------------------------------------------------------------------------
+
+t_size XspfReader::getNumTracks() const
+{
+	return numTracks;
+}
+
+//------------------------------------------------------------------------------
+
+void XspfReader::parse(const bool isFinal)
+{
+	static const char commentStart[] = "<!--";
+	static const char cdataStart[] = "<![CDATA[";
+	static const char processingInstructionStart[] = "<?";
+
+	for(;;)
+	{
+		const size_t markupStart = buffer.find('<', position);
+		if(markupStart == std::string::npos)
+		{
+			// Text at the end of the buffer; it might carry on in the next chunk.
+			if(isFinal)
+			{
+				onText(buffer.data() + position, buffer.data() + buffer.size(), true);
+				position = buffer.size();
+			}
+			return;
+		}
+
+		if(markupStart > position)
+		{
+			onText(buffer.data() + position, buffer.data() + markupStart, true);
+			position = markupStart;
+		}
+
+		// Not enough of it yet to tell what sort of markup it is.
+		if(!isFinal && buffer.size() - position < sizeof(cdataStart) - 1 && buffer.find('>', position) == std::string::npos)
+		{
+			return;
+		}
+
+		if(startsWith(buffer, position, commentStart))
+		{
+			const size_t end = buffer.find("-->", position + strlen(commentStart));
+			if(end == std::string::npos)
+			{
+				return;
+			}
+
+			position = end + 3;
+		}
+		else if(startsWith(buffer, position, cdataStart))
+		{
+			const size_t end = buffer.find("]]>", position + strlen(cdataStart));
+			if(end == std::string::npos)
+			{
+				return;
+			}
+
+			onText(buffer.data() + position + strlen(cdataStart), buffer.data() + end, false);
+			position = end + 3;
+		}
+		else if(startsWith(buffer, position, processingInstructionStart))
+		{
+			const size_t end = buffer.find("?>", position + strlen(processingInstructionStart));
+			if(end == std::string::npos)
+			{
+				return;
+			}
+
+			position = end + 2;
+		}
+		else
+		{
+			// A tag, or a doctype. Attribute values can have a '>' in them, so skip over those.
+			size_t end = position + 1;
+			char quote = 0;
+
+			for(; end < buffer.size(); ++end)
+			{
+				const char c = buffer[end];
+
+				if(quote != 0)
+				{
+					if(c == quote)
+					{
+						quote = 0;
+					}
+				}
+				else if(c == '"' || c == '\'')
+				{
+					quote = c;
+				}
+				else if(c == '>')
+				{
+					break;
+				}
+			}
+
+			if(end == buffer.size())
+			{
+				return;
+			}
+
+			const char* tagBegin = buffer.data() + position + 1;
+			const char* tagEnd = buffer.data() + end;
+
+			if(*tagBegin == '/')
+			{
+				onEndTag(tagBegin + 1, tagEnd);
+			}
+			else if(*tagBegin != '!')
+			{
+				const bool isEmptyElement = tagEnd > tagBegin && tagEnd[-1] == '/';
+
+				onStartTag(tagBegin, isEmptyElement ? tagEnd - 1 : tagEnd);
+
+				if(isEmptyElement)
+				{
+					onEndTag(tagBegin, tagEnd - 1);
+				}
+			}
+
+			position = end + 1;
+		}
+	}
+}
+
+//------------------------------------------------------------------------------
+
+void XspfReader::onStartTag(const char* begin, const char* end)
+{
+	const std::string name = getElementName(begin, end);
+
+	if(elements.empty() && name != "playlist")
+	{
+		throw exception_io_unsupported_format();
+	}
+
+	elements.push_back(name);
+
+	const bool isInTrackList = elements.size() >= 3 && elements[1] == "trackList" && elements[2] == "track";
+
+	if(isInTrackList && elements.size() == 3)
+	{
+		track = XspfTrack();
+	}
+	else if(isInTrackList && elements.size() == 4)
+	{
+		if(name == "location" && track.location.empty())
+		{
+			field = &track.location;
+		}
+		else if(name == "creator")
+		{
+			field = &track.creator;
+		}
+		else if(name == "title")
+		{
+			field = &track.title;
+		}
+	}
+}
+
+//------------------------------------------------------------------------------
+
+void XspfReader::onEndTag(const char* begin, const char* end)
+{
+	const std::string name = getElementName(begin, end);
+
+	if(elements.empty() || elements.back() != name)
+	{
+		throw exception_io_data("XSPF playlist has mismatched tags");
+	}
+
+	const bool isInTrackList = elements.size() >= 3 && elements[1] == "trackList" && elements[2] == "track";
+
+	if(isInTrackList && elements.size() == 4)
+	{
+		field = nullptr;
+	}
+	else if(isInTrackList && elements.size() == 3)
+	{
+		track.location = trim(track.location);
+		track.creator = trim(track.creator);
+		track.title = trim(track.title);
+
+		++numTracks;
+		onTrack(track);
+	}
+
+	elements.pop_back();
+}
+
+//------------------------------------------------------------------------------
+
+void XspfReader::onText(const char* begin, const char* end, const bool decodeEntities)
+{
+	if(field == nullptr)
+	{
+		return;
+	}
+
+	if(!decodeEntities)
+	{
+		field->append(begin, end);
+		return;
+	}
+
+	for(const char* c = begin; c < end; ++c)
+	{
+		if(*c != '&')
+		{
+			*field += *c;
+			continue;
+		}
+
+		const char* entityEnd = std::find(c + 1, end, ';');
+		if(entityEnd == end)
+		{
+			*field += *c;
+			continue;
+		}
+
+		appendEntity(c + 1, entityEnd, *field);
+		c = entityEnd;
+	}
+}
+
+//------------------------------------------------------------------------------
+
+void resolveXspfTracks(const LibrarySnapshot& library, const std::vector<XspfTrack>& tracks, std::vector<metadb_handle_ptr>& bestVersions, abort_callback& abort)
+{
+	std::vector<TrackName> names;
+	names.reserve(tracks.size());
+
+	for(const auto& track : tracks)
+	{
+		const TrackName name = { track.creator, track.title, std::string(), std::string() };
+		names.push_back(name);
+	}
+
+	findBestVersions(library, names, bestVersions, [](t_size, t_size){}, abort);
+}
+
+//------------------------------------------------------------------------------
+
+} // namespace bestversion
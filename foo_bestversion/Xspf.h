@@ -0,0 +1,58 @@
+#pragma once
+
+#include "FoobarSDKWrapper.h"
+
+#include "LibraryIndex.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace bestversion {
+
+// One <track> of an XSPF playlist; any of these may be empty.
+struct XspfTrack
+{
+	std::string location;	// The first one, if there's more than one; a URI, possibly relative to the playlist.
+	std::string creator;
+	std::string title;
+};
+
+// Reads the tracks out of an XSPF playlist a chunk at a time, without holding on to more of the file than the markup being read.
+// Only the XML XSPF actually uses is understood: elements, attributes, text, entities, CDATA, comments and processing instructions.
+class XspfReader
+{
+public:
+	typedef std::function<void (const XspfTrack& track)> OnTrack;
+
+	explicit XspfReader(const OnTrack& onTrack);
+
+	// Reads as much of the data as makes whole pieces of markup, calling onTrack at the end of each track; the rest is kept for next time.
+	// Throws exception_io_unsupported_format if it's not an XSPF playlist, and exception_io_data if it's broken.
+	void feed(const char* data, size_t size);
+
+	// Call at the end of the file; throws exception_io_data if the playlist is cut short.
+	void finish();
+
+	t_size getNumTracks() const;
+
+private:
+	void parse(bool isFinal);
+	void onStartTag(const char* begin, const char* end);
+	void onEndTag(const char* begin, const char* end);
+	void onText(const char* begin, const char* end, bool decodeEntities);
+
+	OnTrack onTrack;
+	std::string buffer;
+	size_t position;
+	std::vector<std::string> elements;	// The names of the elements we're in, outermost first, without namespace prefixes.
+	XspfTrack track;
+	std::string* field;					// The field of track the text being read belongs to, if any.
+	t_size numTracks;
+};
+
+// Finds the best version in the library of each of the tracks, going by creator and title; bestVersions[i] is null if tracks[i] hasn't got one.
+// See findBestVersions.
+void resolveXspfTracks(const LibrarySnapshot& library, const std::vector<XspfTrack>& tracks, std::vector<metadb_handle_ptr>& bestVersions, abort_callback& abort);
+
+} // namespace bestversion